@@ -10,11 +10,95 @@
 #include <Wire.h>
 #include "APDS9960.h"
 
+/* Start the Wire controller with the bus clock set by setBusClock() (0
+   keeps the core's default) and the per-transaction timeout, if supported */
+static void wireBegin(uint32_t clock)
+{
+    Wire.begin();
+    if( clock ) {
+        Wire.setClock(clock);
+    }
+#ifdef WIRE_HAS_TIMEOUT
+    Wire.setWireTimeout(I2C_TIMEOUT, true);
+#endif
+}
+
+/* Count an I2C event in i2c_stats_, when diagnostics are built */
+#if APDS9960_DIAGNOSTICS
+#define I2C_STAT(counter)       i2c_stats_.counter++
+#else
+#define I2C_STAT(counter)
+#endif
+
+APDS9960::APDS9960()
+{
+#if APDS9960_GESTURE
+    gesture_motion_ = 0;
+    gesture_active_ = false;
+    gesture_next_read_ = 0;
+    fifo_fill_ = 0;
+    fifo_ready_ = 0;
+    gesture_arming_ = false;
+    gesture_armed_ = false;
+    gesture_boost_ = DEFAULT_GLED_BOOST;
+#endif
+#if APDS9960_PROXIMITY
+    prox_filter_.size = 0;
+    prox_ppulse_ = DEFAULT_PROX_PPULSE;
+    prox_rate_ = 0;
+    prox_track_.active = false;
+    prox_track_.near = false;
+    prox_highrate_.active = false;
+#endif
+    sat_.active = false;
+    sat_.flags = 0;
+#if APDS9960_ALS
+    als_band_ = 0;
+    als_next_us_ = 0;
+    als_synced_ = false;
+    als_missed_ = false;
+#endif
+#if APDS9960_STREAMING
+    stream_buf_ = NULL;
+    stream_size_ = 0;
+    stream_head_ = 0;
+    stream_count_ = 0;
+    stream_dropped_ = 0;
+    stream_channels_ = 0;
+#endif
+#if DEBUG
+    clearTrace();
+#endif
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+    capture_buf_ = NULL;
+    capture_len_ = 0;
+    capture_on_ = false;
+    capture_open_ = false;
+    capture_gestures_ = 0;
+    capture_dropped_ = 0;
+    capture_records_ = 0;
+#endif
+    recovery_sda_ = I2C_NO_PIN;
+    recovery_scl_ = I2C_NO_PIN;
+    bus_clock_ = 0;
+    wire_timed_out_ = false;
+    xfer_head_ = NULL;
+    xfer_tail_ = NULL;
+    async_ = NULL;
+    xfer_async_ = false;
+    xfer_expired_ = false;
+#if APDS9960_DIAGNOSTICS
+    clearI2CStats();
+#endif
+    clearShadow();
+}
+
 // Setup of HW registers
 bool APDS9960::init()
 {
     // Initialize I2C
-    Wire.begin();
+    wireBegin(bus_clock_);
+    clearShadow();
 
     // disable all features
     if( !setMode(ALL, OFF) ) {
@@ -31,6 +115,9 @@ bool APDS9960::init()
     if( !wireWriteDataByte(APDS9960_PPULSE, DEFAULT_PROX_PPULSE) ) {
         return false;
     }
+#if APDS9960_PROXIMITY
+    prox_ppulse_ = DEFAULT_PROX_PPULSE;
+#endif
     if( !wireWriteDataByte(APDS9960_POFFSET_UR, DEFAULT_POFFSET_UR) ) {
         return false;
     }
@@ -40,27 +127,31 @@ bool APDS9960::init()
     if( !wireWriteDataByte(APDS9960_CONFIG1, DEFAULT_CONFIG1) ) {
         return false;
     }
-    if( !setLEDDrive(DEFAULT_LDRIVE) ) {
+    if( !setField<ldrive_field>(DEFAULT_LDRIVE) ) {
         return false;
     }
-    if( !setProximityGain(DEFAULT_PGAIN) ) {
+    if( !setField<pgain_field>(DEFAULT_PGAIN) ) {
         return false;
     }
-    if( !setAmbientLightGain(DEFAULT_AGAIN) ) {
+    if( !setField<again_field>(DEFAULT_AGAIN) ) {
         return false;
     }
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
     if( !setProxIntLowThresh(DEFAULT_PILT) ) {
         return false;
     }
     if( !setProxIntHighThresh(DEFAULT_PIHT) ) {
         return false;
     }
+#endif
+#if APDS9960_ALS && APDS9960_INTERRUPTS
     if( !setLightIntLowThreshold(DEFAULT_AILT) ) {
         return false;
     }
     if( !setLightIntHighThreshold(DEFAULT_AIHT) ) {
         return false;
     }
+#endif
     if( !wireWriteDataByte(APDS9960_PERS, DEFAULT_PERS) ) {
         return false;
     }
@@ -71,6 +162,7 @@ bool APDS9960::init()
         return false;
     }
 
+#if APDS9960_GESTURE
     // Set default values for gesture sense registers
     if( !setGestureEnterThresh(DEFAULT_GPENTH) ) {
         return false;
@@ -113,6 +205,37 @@ bool APDS9960::init()
     }
 
 	resetGestureParameters();
+    gesture_arming_ = false;
+    gesture_armed_ = false;
+    gesture_boost_ = DEFAULT_GLED_BOOST;
+#endif
+#if APDS9960_PROXIMITY
+    prox_filter_.size = 0;
+    resetProximityFilter();
+    prox_rate_ = 0;
+    prox_track_.active = false;
+    prox_track_.near = false;
+    prox_highrate_.active = false;
+#endif
+    sat_.active = false;
+    sat_.flags = 0;
+#if APDS9960_ALS
+    als_band_ = 0;
+    als_synced_ = false;
+    als_missed_ = false;
+    als_next_us_ = micros();
+#endif
+#if APDS9960_STREAMING
+    stream_channels_ = 0;
+#endif
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+    capture_len_ = 0;
+    capture_on_ = false;
+    capture_open_ = false;
+    capture_gestures_ = 0;
+    capture_dropped_ = 0;
+    capture_records_ = 0;
+#endif
     return true;
 }
 
@@ -184,6 +307,7 @@ bool APDS9960::setMode(uint8_t mode, uint8_t enable)
     return true;
 }
 
+#if APDS9960_ALS
 /**
  * @brief Starts the light (R/G/B/Ambient) sensor on the APDS-9960
  *
@@ -196,7 +320,7 @@ bool APDS9960::enableLightSensor(bool interrupts)
     if( !setAmbientLightGain(DEFAULT_AGAIN) ) {
         return false;
     }
-    if( interrupts ) {
+    if( APDS9960_INTERRUPTS && interrupts ) {
         if( !setAmbientLightIntEnable(1) ) {
             return false;
         }
@@ -211,6 +335,9 @@ bool APDS9960::enableLightSensor(bool interrupts)
     if( !setMode(AMBIENT_LIGHT, 1) ) {
         return false;
     }
+    als_synced_ = false;
+    als_missed_ = false;
+    als_next_us_ = micros();
 
     return true;
 }
@@ -231,7 +358,9 @@ bool APDS9960::disableLightSensor()
 
     return true;
 }
+#endif
 
+#if APDS9960_PROXIMITY
 /**
  * @brief Starts the proximity sensor on the APDS-9960
  *
@@ -247,7 +376,7 @@ bool APDS9960::enableProximitySensor(bool interrupts)
     if( !setLEDDrive(DEFAULT_LDRIVE) ) {
         return false;
     }
-    if( interrupts ) {
+    if( APDS9960_INTERRUPTS && interrupts ) {
         if( !setProximityIntEnable(1) ) {
             return false;
         }
@@ -282,7 +411,9 @@ bool APDS9960::disableProximitySensor()
 
 	return true;
 }
+#endif
 
+#if APDS9960_GESTURE
 /**
  * @brief Starts the gesture recognition engine on the APDS-9960
  *
@@ -294,7 +425,7 @@ bool APDS9960::enableGestureSensor(bool interrupts)
     /* Enable gesture mode
        Set ENABLE to 0 (power off)
        Set WTIME to 0xFF
-       Set AUX to DEFAULT_GLED_BOOST
+       Set AUX to the gesture LED boost (DEFAULT_GLED_BOOST unless tuned)
        Enable PON, WEN, PEN, GEN in ENABLE 
     */
     resetGestureParameters();
@@ -304,7 +435,10 @@ bool APDS9960::enableGestureSensor(bool interrupts)
     if( !wireWriteDataByte(APDS9960_PPULSE, DEFAULT_GESTURE_PPULSE) ) {
         return false;
     }
-    if( !setLEDBoost(DEFAULT_GLED_BOOST) ) {
+#if APDS9960_PROXIMITY
+    prox_ppulse_ = DEFAULT_GESTURE_PPULSE;
+#endif
+    if( !setLEDBoost(gesture_boost_) ) {
         return false;
     }
     if( interrupts ) {
@@ -378,287 +512,2597 @@ bool APDS9960::isGestureAvailable()
     }
 }
 
-gesture_record_t fifo_buf[32];
 #if DEBUG
-gesture_record_t rec_data[MAX_RECORDS];
-#endif
 /**
- * @brief Processes a gesture event and returns best guessed gesture
+ * @brief Appends an event to the trace ring, O(1) from the acquisition loop
  *
- * @return Number corresponding to gesture. -1 on error.
+ * The oldest event is overwritten once TRACE_SIZE events are kept.
  */
-int APDS9960::readGesture()
+void APDS9960::trace(uint8_t id, uint8_t arg, uint32_t data)
 {
-    /* Make sure that power and gesture is on and data is valid */
-    if( !isGestureAvailable() || !(getMode() & 0b01000001) ) {
-        return 0;
-    }
-
-    // Keep looping as long as gesture data is valid
-    while(1)
-	{
-		uint8_t gstatus;
-        /* Get the contents of the STATUS register. Is data still valid? */
-        if( !wireReadDataByte(APDS9960_GSTATUS, gstatus) ) {
-            return ERROR;
-        }
-
-        // If we have valid data, read in FIFO
-        if( (gstatus & APDS9960_GVALID) )
-		{
-            // Read the current FIFO level
-			uint8_t fifo_level;
-            if( !wireReadDataByte(APDS9960_GFLVL, fifo_level) ) {
-                return ERROR;
-            }
-#if DEBUG
-            Serial.print("> FIFO Level: "); Serial.println(fifo_level);
-#endif
-
-            if ( fifo_level==0 ) continue; // no data read and to process
-
-			if ( fifo_level>8 ) fifo_level = 8; // limit to 32 records
-			
-            /* Read the FIFO into our data buffer */
-			int bytes_read = wireReadDataBlock( APDS9960_GFIFO_U,
-												(uint8_t*)fifo_buf,
-												(fifo_level * 4));
-#if DEBUG
-            Serial.print("Bytes read: "); Serial.println(bytes_read);
-#endif
-			if ( bytes_read<0 )	return ERROR; // something went wrong
-
-            if ( bytes_read<4 ) continue; // not enough data to process
-
-			// check if already too many data processed
-			if ( gesture_data_.total_records>=MAX_RECORDS )
-			{
-#if DEBUG
-				Serial.println("<<< MAX_RECORDS >>>");
-#endif
-				break;
-			}
-
-			gesture_data_.current_records = bytes_read/4;
-			// limit the data to available buffer lenght
-			if ( gesture_data_.current_records>(MAX_RECORDS-gesture_data_.total_records) )
-				gesture_data_.current_records = (MAX_RECORDS-gesture_data_.total_records);
-
-#if DEBUG
-			Serial.print("FIFO Dump:");
-			for (uint8_t i = 0; i < bytes_read; i++ )
-			{
-				Serial.print(" ");
-				Serial.print(((uint8_t*)fifo_buf)[i]);
-				if ( (i&3)==3 ) Serial.write(',');
-			}
-			Serial.write('\n');
-			// copy fifo buffer to record
-			
-			for (uint8_t i=0; i<gesture_data_.current_records; i++)
-			{
-				uint8_t j = gesture_data_.total_records+i;
-				rec_data[j].u_data = fifo_buf[i].u_data;
-				rec_data[j].d_data = fifo_buf[i].d_data;
-				rec_data[j].l_data = fifo_buf[i].l_data;
-				rec_data[j].r_data = fifo_buf[i].r_data;
-			}
-#endif
-			gesture_data_.total_records += gesture_data_.current_records;
-			// Process gesture data.
-			processGestureData();
-        }
-		else break;
-        // Wait some time to collect next batch of FIFO data
-        delay(FIFO_PAUSE_TIME);
-	}
-	// Determine best guessed gesture and clean up
-	decodeGesture();
-	//int motion = gesture_motion_;
-	int motion = gesture_motion_;
-	resetGestureParameters();
-	return motion;
+    trace_event_t *ev = &trace_buf_[trace_next_];
+    trace_next_ = (trace_next_ + 1) & (TRACE_SIZE-1);
+    if ( trace_fill_<TRACE_SIZE ) trace_fill_++;
+    trace_total_++;
+    ev->time = (uint16_t)(micros() >> 4);
+    ev->id = id;
+    ev->arg = arg;
+    ev->data[0] = data;
+    ev->data[1] = data >> 8;
+    ev->data[2] = data >> 16;
+    ev->data[3] = data >> 24;
 }
-
+#define TRACE(id, arg, data)    trace((id), (arg), (data))
+#else
+#define TRACE(id, arg, data)
+#endif
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
 /**
- * Turn the APDS-9960 on
+ * @brief Runs gesture detection only while something is in front
  *
+ * Idle, only proximity runs, DEFAULT_IDLE_WTIME apart, with a PIHT
+ * interrupt learnt as in enableProximityTracking(). When an object comes
+ * near, pollArmedGesture() starts the gesture engine in forced mode; when
+ * the engine exits on GEXTH, it is stopped again. Nothing may be in front
+ * of the sensor while this runs. ALS is off while armed; the ENABLE
+ * register and LED boost are given back by disableGestureArming().
+ *
+ * @param[in] margin counts above the idle level that arm the engine
  * @return True if operation successful. False otherwise.
  */
-bool APDS9960::enablePower()
+bool APDS9960::enableGestureArming(uint8_t margin)
 {
-    if( !setMode(POWER, 1) ) {
+    /* Keep the settings armed mode overrides, unless already armed */
+    if( !gesture_arming_ ) {
+        arm_led_boost_ = getLEDBoost();
+        if( arm_led_boost_ == ERROR || !readShadow(APDS9960_ENABLE, arm_enable_) ) {
+            return false;
+        }
+    }
+
+    /* ALS would stretch the idle cycle and is not needed while armed */
+    if( !setMode(AMBIENT_LIGHT, 0) ) {
+        return false;
+    }
+
+    /* Gesture settings first: the baseline is learnt with the gesture PPULSE */
+    if( !enableGestureSensor(true) ) {
+        return false;
+    }
+    if( !setMode(GESTURE, 0) ) {
+        return false;
+    }
+    if( !setGestureMode(0) ) {
+        return false;
+    }
+    if( !enableProximityTracking(margin, DEFAULT_ARM_PPERS) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_WTIME, DEFAULT_IDLE_WTIME) ) {
+        return false;
+    }
+    if( !setMode(WAIT, 1) ) {
         return false;
     }
+    gesture_armed_ = false;
+    gesture_arming_ = true;
 
     return true;
 }
 
 /**
- * Turn the APDS-9960 off
+ * @brief Leaves armed mode, stopping the gesture engine and proximity interrupts
+ *
+ * The LED boost and the engines enabled before enableGestureArming(),
+ * ALS included, are restored.
  *
  * @return True if operation successful. False otherwise.
  */
-bool APDS9960::disablePower()
+bool APDS9960::disableGestureArming()
 {
-    if( !setMode(POWER, 0) ) {
+    bool was_arming = gesture_arming_;
+
+    gesture_arming_ = false;
+    gesture_armed_ = false;
+    if( !disableGestureSensor() ) {
+        return false;
+    }
+    if( !disableProximityTracking() ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_WTIME, DEFAULT_WTIME) ) {
+        return false;
+    }
+    if( !was_arming ) {
+        return true;
+    }
+    if( !setLEDBoost(arm_led_boost_) ) {
         return false;
     }
 
-    return true;
+    return wireWriteDataByte(APDS9960_ENABLE, arm_enable_);
 }
 
-/*******************************************************************************
- * Ambient light and color sensor controls
- ******************************************************************************/
-
 /**
- * @brief Reads the ambient (clear) light level as a 16-bit value
+ * @brief Arms the engine on approach and reads gestures while it runs
  *
- * @param[out] val value of the light sensor.
- * @return True if operation successful. False otherwise.
+ * Unarmed, a call costs one STATUS read, so it can be made on INT low or
+ * at a slow poll rate. Armed, it behaves like readGesture(budget_us).
+ *
+ * @param[in] budget_us time allowed in this call (us), 0 for no limit
+ * @return Gesture flags, 0 if none, GESTURE_PENDING while a gesture is
+ *  being read. ERROR on failure.
  */
-bool APDS9960::readAmbientLight(uint16_t &val)
+int APDS9960::pollArmedGesture(uint32_t budget_us)
 {
-    uint8_t val_byte;
-    val = 0;
+    if( !gesture_arming_ ) {
+        return ERROR;
+    }
 
-    /* Read value from clear channel, low byte register */
-    if( !wireReadDataByte(APDS9960_CDATAL, val_byte) ) {
-        return false;
+    if( !gesture_armed_ ) {
+        uint8_t event = updateProximityTracking();
+        if( event == ERROR ) {
+            return ERROR;
+        }
+        if( event != PROX_EVENT_ENTER ) {
+            return 0;
+        }
+        if( !armGestureEngine() ) {
+            return ERROR;
+        }
     }
-    val = val_byte;
 
-    /* Read value from clear channel, high byte register */
-    if( !wireReadDataByte(APDS9960_CDATAH, val_byte) ) {
-        return false;
+    int result = readGesture(budget_us);
+    if( result == GESTURE_PENDING || result == ERROR ) {
+        return result;
     }
-    val = val + ((uint16_t)val_byte << 8);
 
-    return true;
+    /* The engine clears GMODE when it exits on GEXTH */
+    uint8_t mode = getGestureMode();
+    if( mode == ERROR ) {
+        return ERROR;
+    }
+    if( !mode && !disarmGestureEngine() ) {
+        return ERROR;
+    }
+
+    return result;
 }
 
 /**
- * @brief Reads the red light level as a 16-bit value
+ * @brief Tells if the gesture engine is currently running in armed mode
  *
- * @param[out] val value of the light sensor.
- * @return True if operation successful. False otherwise.
+ * @return True if armed. False otherwise.
  */
-bool APDS9960::readRedLight(uint16_t &val)
+bool APDS9960::isGestureArmed()
 {
-    uint8_t val_byte;
-    val = 0;
+    return gesture_armed_;
+}
 
-    /* Read value from clear channel, low byte register */
-    if( !wireReadDataByte(APDS9960_RDATAL, val_byte) ) {
+/**
+ * @brief Starts the gesture engine at full rate with an object in front
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::armGestureEngine()
+{
+    resetGestureParameters();
+    if( !setProximityIntEnable(0) ) {
         return false;
     }
-    val = val_byte;
-
-    /* Read value from clear channel, high byte register */
-    if( !wireReadDataByte(APDS9960_RDATAH, val_byte) ) {
+    if( !wireWriteDataByte(APDS9960_WTIME, 0xFF) ) {
         return false;
     }
-    val = val + ((uint16_t)val_byte << 8);
+    if( !setGestureMode(1) ) {
+        return false;
+    }
+    if( !setMode(GESTURE, 1) ) {
+        return false;
+    }
+    gesture_armed_ = true;
 
     return true;
 }
- 
+
 /**
- * @brief Reads the green light level as a 16-bit value
+ * @brief Stops the gesture engine and waits for the next approach
  *
- * @param[out] val value of the light sensor.
  * @return True if operation successful. False otherwise.
  */
-bool APDS9960::readGreenLight(uint16_t &val)
+bool APDS9960::disarmGestureEngine()
 {
-    uint8_t val_byte;
-    val = 0;
+    gesture_armed_ = false;
+    if( !setMode(GESTURE, 0) ) {
+        return false;
+    }
 
-    /* Read value from clear channel, low byte register */
-    if( !wireReadDataByte(APDS9960_GDATAL, val_byte) ) {
+    /* Datasets left in the FIFO would keep GINT asserted */
+    if( !setField<gfifo_clr_field>(1) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_WTIME, DEFAULT_IDLE_WTIME) ) {
         return false;
     }
-    val = val_byte;
 
-    /* Read value from clear channel, high byte register */
-    if( !wireReadDataByte(APDS9960_GDATAH, val_byte) ) {
+    /* The object went below GEXTH, so look for the next enter */
+    prox_track_.near = false;
+    if( !armProximityThresholds() ) {
+        return false;
+    }
+    if( !clearProximityInt() ) {
         return false;
     }
-    val = val + ((uint16_t)val_byte << 8);
 
-    return true;
+    return setProximityIntEnable(1);
 }
+#endif
 
 /**
- * @brief Reads the red light level as a 16-bit value
+ * @brief Tunes the gesture engine for a dataset rate and signal level
  *
- * @param[out] val value of the light sensor.
- * @return True if operation successful. False otherwise.
+ * Hold a hand at the working distance while tuning. Pulse trains are
+ * tried from the shortest dataset time up. Each is first measured with
+ * gain, LED drive and boost at their strongest; if the mean peak count
+ * stays below min_signal the next, longer train is tried. Otherwise the
+ * weakest gain/drive/boost step still reaching min_signal is searched
+ * for, so the LED runs no harder than needed, and the train is rejected
+ * if that step saturates. GWTIME is then made as long as target_hz
+ * allows, which lowers LED duty, but short enough that GFIFOTH datasets
+ * arrive between the FIFO reads of readGesture(). A train is rejected if
+ * its datasets, as set or as measured, arrive faster than readGesture()
+ * drains them (FIFO_READ_RECORDS per FIFO_PAUSE_TIME and the reads at the
+ * bus clock) with TUNE_DRAIN_MARGIN to spare, since the FIFO would then
+ * overflow during a long gesture. Every candidate is measured on the live
+ * sensor in forced gesture mode. ENABLE, GEXTH and GCONF4 are restored
+ * afterwards.
+ *
+ * @param[in] target_hz minimum dataset rate (datasets per second)
+ * @param[in] min_signal minimum mean of the strongest photodiode
+ * @param[out] result applied settings with the measured rate and signal
+ * @return True if a configuration met both. False otherwise, also when
+ *         target_hz is above what readGesture() can drain, in which case
+ *         the previous gesture settings are restored.
  */
-bool APDS9960::readBlueLight(uint16_t &val)
+bool APDS9960::tuneGestureRate(uint16_t target_hz, uint8_t min_signal,
+                               gesture_tuning_type &result)
 {
-    uint8_t val_byte;
-    val = 0;
+    static const uint8_t fifo_thresholds[4] = { 1, 4, 8, 16 };
+    uint8_t enable, gexth, gconf1, gconf4, gpulse, gconf2, config2;
 
-    /* Read value from clear channel, low byte register */
-    if( !wireReadDataByte(APDS9960_BDATAL, val_byte) ) {
+    if( !target_hz || !readShadow(APDS9960_GCONF1, gconf1) ) {
         return false;
     }
-    val = val_byte;
 
-    /* Read value from clear channel, high byte register */
-    if( !wireReadDataByte(APDS9960_BDATAH, val_byte) ) {
+    /* readGesture() stops once GVALID drops between two FIFO reads */
+    uint32_t period = 1000000UL / target_hz;
+    uint32_t max_period = FIFO_PAUSE_TIME * 1000UL / fifo_thresholds[gconf1 >> 6];
+    if( period > max_period ) {
+        period = max_period;
+    }
+
+    /* Time readGesture() takes per dataset: a FIFO_PAUSE_TIME pause and
+       the GSTATUS, GFLVL and FIFO reads (11 bytes of addressing) per batch */
+    uint32_t clock = bus_clock_ ? bus_clock_ : 100000UL;
+    uint32_t drain = FIFO_PAUSE_TIME * 1000UL +
+                     (FIFO_READ_RECORDS * 4 + 11) * 9UL * 1000000UL / clock;
+    uint32_t min_period = drain * (100 + TUNE_DRAIN_MARGIN) /
+                          (100UL * FIFO_READ_RECORDS);
+    if( min_period > period ) {
         return false;
     }
-    val = val + ((uint16_t)val_byte << 8);
 
-    return true;
-}
+    /* Save the registers the search overwrites */
+    if( !readShadow(APDS9960_ENABLE, enable) ||
+        !readShadow(APDS9960_GEXTH, gexth) ||
+        !wireReadDataByte(APDS9960_GCONF4, gconf4) ||
+        !readShadow(APDS9960_GPULSE, gpulse) ||
+        !readShadow(APDS9960_GCONF2, gconf2) ||
+        !readShadow(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
 
-/*******************************************************************************
- * Proximity sensor controls
- ******************************************************************************/
+    /* Only proximity and gesture cycles, and no exit on a weak signal */
+    if( !wireWriteDataByte(APDS9960_GEXTH, 0) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_ENABLE,
+                           APDS9960_PON | APDS9960_PEN | APDS9960_GEN) ) {
+        return false;
+    }
+    if( !(enable & APDS9960_PON) ) {
+        delay(POWER_ON_TIME);
+    }
 
-/**
- * @brief Reads the proximity level as an 8-bit value
- *
- * @param[out] val value of the proximity sensor.
- * @return True if operation successful. False otherwise.
- */
-bool APDS9960::readProximity(uint8_t &val)
-{
-    val = 0;
+    bool found = searchGestureRate(min_period, period, min_signal, result);
 
-    /* Read value from proximity data register */
-    if( !wireReadDataByte(APDS9960_PDATA, val) ) {
+    if( !found ) {
+        if( !wireWriteDataByte(APDS9960_GPULSE, gpulse) ||
+            !wireWriteDataByte(APDS9960_GCONF2, gconf2) ||
+            !wireWriteDataByte(APDS9960_CONFIG2, config2) ) {
+            return false;
+        }
+    }
+
+    /* Leave forced gesture mode with an empty FIFO */
+    gconf4 &= ~APDS9960_GMODE;
+    if( !wireWriteDataByte(APDS9960_GCONF4, gconf4 | APDS9960_GFIFO_CLR) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_GEXTH, gexth) ||
+        !wireWriteDataByte(APDS9960_ENABLE, enable) ) {
         return false;
     }
 
-    return true;
+    return found;
 }
 
-/*******************************************************************************
- * High-level gesture controls
- ******************************************************************************/
-
 /**
- * @brief Resets all the parameters in the gesture data member
+ * @brief Search behind tuneGestureRate(), with the engine set up
+ *
+ * @param[in] min_period_us shortest dataset time readGesture() keeps up with
+ * @param[in] period_us longest dataset time allowed
+ * @param[in] min_signal minimum mean of the strongest photodiode
+ * @param[out] result settings left configured and their measurement
+ * @return True if a configuration met both limits. False otherwise.
  */
-void APDS9960::resetGestureParameters()
+bool APDS9960::searchGestureRate(uint32_t min_period_us, uint32_t period_us,
+                                 uint8_t min_signal, gesture_tuning_type &result)
 {
-    gesture_data_.delta_ud = 0;
-    gesture_data_.delta_lr = 0;
-    gesture_data_.sum_udlr  = 0;
-    gesture_data_.prev_udlr  = 0;
-    gesture_data_.delta_udlr = 0;
-//    gesture_data_.delta_ud_var = 0;
-//    gesture_data_.delta_lr_var = 0;
-    gesture_data_.dir_up    = 0;
-    gesture_data_.dir_down  = 0;
-    gesture_data_.dir_left  = 0;
-    gesture_data_.dir_right = 0;
-    gesture_data_.current_records = 0;
+    /* GPLEN/GPULSE candidates by increasing dataset time */
+    static const uint8_t trains[] = {
+        0x00,   // 4us, 1 pulse
+        0x40,   // 8us, 1 pulse
+        0x80,   // 16us, 1 pulse
+        0xC0,   // 32us, 1 pulse
+        0xC1,   // 32us, 2 pulses
+        0xC3,   // 32us, 4 pulses
+        0xC7,   // 32us, 8 pulses
+        0xCF,   // 32us, 16 pulses
+        0xDF,   // 32us, 32 pulses
+        0xFF    // 32us, 64 pulses
+    };
+    /* GGAIN << 4 | GLDRIVE << 2 | LED_BOOST by increasing signal, using
+       the least LED current for each step (LED_BOOST_300 not working) */
+    static const uint8_t levels[] = {
+        0x03 << 2,                      // 1x, 12.5mA
+        0x03 << 2 | 1,                  // 1x, 12.5mA, 150%
+        0x10 | 0x03 << 2,               // 2x, 12.5mA
+        0x10 | 0x03 << 2 | 1,           // 2x, 12.5mA, 150%
+        0x20 | 0x03 << 2,               // 4x, 12.5mA
+        0x20 | 0x03 << 2 | 1,           // 4x, 12.5mA, 150%
+        0x30 | 0x03 << 2,               // 8x, 12.5mA
+        0x30 | 0x03 << 2 | 1,           // 8x, 12.5mA, 150%
+        0x30 | 0x02 << 2,               // 8x, 25mA
+        0x30 | 0x02 << 2 | 1,           // 8x, 25mA, 150%
+        0x30 | 0x01 << 2,               // 8x, 50mA
+        0x30 | 0x01 << 2 | 1,           // 8x, 50mA, 150%
+        0x30,                           // 8x, 100mA
+        0x30 | 1                        // 8x, 100mA, 150%
+    };
+    gesture_tuning_type best;
+
+    for (uint8_t t = 0; t < sizeof(trains); t++)
+    {
+        if( getGestureTime(trains[t], GWTIME_0MS) > period_us ) {
+            return false;
+        }
+        result.gpulse = trains[t];
+
+        /* Binary search for the weakest level reaching min_signal */
+        uint8_t lo = 0;
+        uint8_t hi = sizeof(levels) - 1;
+        bool reached = false;
+        while( true )
+        {
+            uint8_t mid = reached ? (lo + hi) / 2 : hi;
+            result.gconf2 = (levels[mid] >> 4) << 5 |
+                            ((levels[mid] >> 2) & 0b11) << 3 | GWTIME_0MS;
+            result.led_boost = levels[mid] & 0b11;
+            if( !measureGesture(result) ) {
+                return false;
+            }
+            if( result.signal >= min_signal ) {
+                best = result;
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+            if( !reached && result.signal < min_signal ) {
+                break;
+            }
+            reached = true;
+            if( lo >= hi ) {
+                break;
+            }
+        }
+        if( !reached || best.saturated ) {
+            continue;
+        }
+
+        /* Longest gesture wait that still meets the rate */
+        uint8_t gwtime = GWTIME_39_2MS;
+        while( gwtime > GWTIME_0MS &&
+               getGestureTime(best.gpulse, best.gconf2 | gwtime) > period_us ) {
+            gwtime--;
+        }
+        if( getGestureTime(best.gpulse, best.gconf2 | gwtime) < min_period_us ) {
+            continue;
+        }
+
+        /* Confirm the rate, giving up wait if the device runs slow, and
+           drop the train if it runs faster than readGesture() drains */
+        while( true )
+        {
+            result = best;
+            result.gconf2 |= gwtime;
+            if( !measureGesture(result) ) {
+                return false;
+            }
+            if( (uint32_t)result.rate_hz * min_period_us > 1000000UL ) {
+                break;
+            }
+            if( (uint32_t)result.rate_hz * period_us >= 1000000UL ) {
+                gesture_boost_ = result.led_boost;
+                return true;
+            }
+            if( gwtime == GWTIME_0MS ||
+                getGestureTime(best.gpulse, best.gconf2 | (gwtime - 1)) <
+                min_period_us ) {
+                break;
+            }
+            gwtime--;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Measures one gesture configuration on the live sensor
+ *
+ * The settings are written, the FIFO is cleared and gesture mode forced,
+ * then TUNE_DATASETS datasets are collected. GFLVL is polled four times
+ * per dataset time rather than back to back, and the rate is taken from
+ * the arrival times of the datasets after the first.
+ *
+ * @param[in,out] result gpulse, gconf2 and led_boost to measure; the
+ *                signal, saturation and rate are filled in
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::measureGesture(gesture_tuning_type &result)
+{
+    uint8_t fifo[TUNE_DATASETS * 4];
+    uint8_t config2;
+
+    if( !readShadow(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+    config2 &= 0b11001111;
+    config2 |= result.led_boost << 4;
+    if( !wireWriteDataByte(APDS9960_GPULSE, result.gpulse) ||
+        !wireWriteDataByte(APDS9960_GCONF2, result.gconf2) ||
+        !wireWriteDataByte(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_GCONF4, APDS9960_GFIFO_CLR | APDS9960_GMODE) ) {
+        return false;
+    }
+
+    /* Time the datasets as the FIFO fills */
+    uint32_t dataset_us = getGestureTime(result.gpulse, result.gconf2);
+    uint32_t timeout = 2UL * (TUNE_DATASETS + 1) * dataset_us + 10000;
+    unsigned long start = micros();
+    unsigned long first = start;
+    unsigned long last = start;
+    uint8_t first_level = 0;
+    uint8_t level = 0;
+    while( level < TUNE_DATASETS )
+    {
+        if( !wireReadDataByte(APDS9960_GFLVL, level) ) {
+            return false;
+        }
+        last = micros();
+        if( !first_level && level ) {
+            first_level = level;
+            first = last;
+        }
+        if( last - start > timeout ) {
+            return false;
+        }
+        if( level < TUNE_DATASETS ) {
+            delayMicroseconds(dataset_us / 4);
+        }
+    }
+    if( wireReadDataBlock(APDS9960_GFIFO_U, fifo, sizeof(fifo)) != sizeof(fifo) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_GCONF4, APDS9960_GFIFO_CLR) ) {
+        return false;
+    }
+
+    if( level > first_level && last != first ) {
+        result.rate_hz = (uint32_t)(level - first_level) * 1000000UL /
+                         (last - first);
+    } else {
+        result.rate_hz = 1000000UL / getGestureTime(result.gpulse, result.gconf2);
+    }
+
+    /* Mean of the strongest photodiode in each dataset */
+    uint16_t sum = 0;
+    result.saturated = false;
+    for (uint8_t i = 0; i < TUNE_DATASETS; i++)
+    {
+        uint8_t peak = 0;
+        for (uint8_t j = 0; j < 4; j++)
+        {
+            uint8_t val = fifo[i * 4 + j];
+            if( val == 255 ) {
+                result.saturated = true;
+            }
+            if( val > peak ) {
+                peak = val;
+            }
+        }
+        sum += peak;
+    }
+    result.signal = sum / TUNE_DATASETS;
+
+    return true;
+}
+
+/**
+ * @brief Processes a gesture event and returns best guessed gesture
+ *
+ * With a budget the call returns GESTURE_PENDING once budget_us has been
+ * used or the next FIFO read is not due yet, and the following call picks
+ * up where it stopped. At least one FIFO read is made per call, so a call
+ * can overrun the budget by one read (3 transactions). With no gesture
+ * running, GSTATUS is read at most once per FIFO_PAUSE_TIME and calls in
+ * between return 0 without bus traffic, so the call can be polled often.
+ * Without a budget the call blocks until the gesture ends, as before.
+ *
+ * @param[in] budget_us time allowed in this call (us), 0 for no limit
+ * @return Number corresponding to gesture. GESTURE_PENDING if not done.
+ *  -1 on error.
+ */
+int APDS9960::readGesture(uint32_t budget_us)
+{
+    unsigned long start = micros();
+
+    /* Armed, the engine was started on approach and its data is on the way */
+    if( !gesture_active_ && !gesture_armed_ ) {
+        /* A polling caller waits for the next GSTATUS read like a FIFO read */
+        if( budget_us && (long)(gesture_next_read_ - start) > 0 ) {
+            return 0;
+        }
+        /* Make sure that power and gesture is on and data is valid */
+        if( !isGestureAvailable() || !(getMode() & 0b01000001) ) {
+            gesture_next_read_ = start + FIFO_PAUSE_TIME * 1000UL;
+            return 0;
+        }
+    }
+    if( !gesture_active_ ) {
+        gesture_active_ = true;
+        gesture_next_read_ = start;
+    }
+
+    // Keep looping as long as gesture data is valid
+    while(1)
+    {
+        /* Wait for the next batch of FIFO data, or give the time back */
+        long wait = (long)(gesture_next_read_ - micros());
+        if( wait > 0 ) {
+            if( budget_us ) {
+                return GESTURE_PENDING;
+            }
+            delay((wait + 999) / 1000);
+        }
+
+        int result = readGestureStep();
+        if( result != GESTURE_PENDING ) {
+            gesture_active_ = false;
+            return result;
+        }
+
+        if( budget_us && micros() - start >= budget_us ) {
+            return GESTURE_PENDING;
+        }
+    }
+}
+
+/**
+ * @brief Reads one batch of the gesture FIFO and schedules the next one
+ *
+ * The FIFO is read into one of two buffers while the batch read by the
+ * previous step is processed from the other, so where submitTransfer()
+ * runs in the background the processing overlaps the bus transfer.
+ *
+ * @return Gesture once GVALID clears or MAX_RECORDS is reached,
+ *  GESTURE_PENDING if more data is expected. ERROR on I2C failure.
+ */
+int APDS9960::readGestureStep()
+{
+	uint8_t gstatus;
+    /* Get the contents of the STATUS register. Is data still valid? */
+    if( !wireReadDataByte(APDS9960_GSTATUS, gstatus) ) {
+        resetGestureParameters();
+        return ERROR;
+    }
+    bool valid = gstatus & APDS9960_GVALID;
+
+    /* GVALID only sets again at GFIFOTH, so datasets that arrived since the
+       FIFO was emptied can still be waiting. Armed, the gesture also lasts
+       until the engine has exited, so disarmGestureEngine() has no
+       datasets left to clear */
+    if( !valid ) {
+        uint8_t level;
+        if( !wireReadDataByte(APDS9960_GFLVL, level) ) {
+            resetGestureParameters();
+            return ERROR;
+        }
+        uint8_t mode = gesture_armed_ ? getGestureMode() : 0;
+        if( mode == ERROR ) {
+            resetGestureParameters();
+            return ERROR;
+        }
+        valid = mode || level;
+        if( valid && !level ) {
+            gesture_next_read_ = micros() + FIFO_PAUSE_TIME * 1000UL;
+            return GESTURE_PENDING;
+        }
+    }
+
+    // If we have valid data, read in FIFO
+    if( valid )
+	{
+        // Read the current FIFO level
+		uint8_t fifo_level;
+        if( !wireReadDataByte(APDS9960_GFLVL, fifo_level) ) {
+            resetGestureParameters();
+            return ERROR;
+        }
+        TRACE(TRACE_FIFO_LEVEL, fifo_level, 0);
+
+        if ( fifo_level==0 ) return GESTURE_PENDING; // no data read and to process
+
+		if ( fifo_level>FIFO_READ_RECORDS ) fifo_level = FIFO_READ_RECORDS;
+
+        /* Read the FIFO into one buffer, process the other meanwhile */
+        startFifoRead(fifo_level * 4);
+        processFifoBuffer();
+		int bytes_read = waitTransfer(fifo_xfer_);
+        TRACE(TRACE_FIFO_READ, bytes_read, 0);
+		if ( bytes_read<0 )	// something went wrong
+		{
+			resetGestureParameters();
+			return ERROR;
+		}
+
+        if ( bytes_read<4 ) return GESTURE_PENDING; // not enough data to process
+
+		// check if already too many data processed
+		if ( gesture_data_.total_records<MAX_RECORDS )
+		{
+			// process these records in the next step
+			fifo_ready_ = bytes_read/4;
+			fifo_fill_ ^= 1;
+
+			// Wait some time to collect next batch of FIFO data
+			gesture_next_read_ = micros() + FIFO_PAUSE_TIME * 1000UL;
+			return GESTURE_PENDING;
+		}
+		TRACE(TRACE_MAX_RECORDS, 0, 0);
+    }
+    else
+    {
+        // Process the last batch read
+        processFifoBuffer();
+    }
+
+	// Determine best guessed gesture and clean up
+	decodeGesture();
+	int motion = gesture_motion_;
+#if APDS9960_CAPTURE
+    captureEnd(motion);
+#endif
+	resetGestureParameters();
+	return motion;
+}
+
+/**
+ * @brief Processes the records waiting in the buffer not being read into
+ */
+void APDS9960::processFifoBuffer()
+{
+    gesture_record_t *records = fifo_buf_[fifo_fill_ ^ 1];
+
+    // limit the data to available buffer lenght
+    gesture_data_.current_records = fifo_ready_;
+    if ( gesture_data_.current_records>(MAX_RECORDS-gesture_data_.total_records) )
+        gesture_data_.current_records = (MAX_RECORDS-gesture_data_.total_records);
+    fifo_ready_ = 0;
+    if ( gesture_data_.current_records==0 ) return;
+
+#if DEBUG
+    // trace the records, the host decoder rebuilds dump and chart
+    for (uint8_t i=0; i<gesture_data_.current_records; i++)
+    {
+        TRACE(TRACE_RECORD, gesture_data_.total_records+i,
+              records[i].u_data | ((uint32_t)records[i].d_data<<8) |
+              ((uint32_t)records[i].l_data<<16) | ((uint32_t)records[i].r_data<<24));
+    }
+#endif
+#if APDS9960_CAPTURE
+    if ( gesture_data_.total_records==0 ) captureStart();
+    for (uint8_t i=0; i<gesture_data_.current_records; i++)
+    {
+        captureRecord(records[i]);
+    }
+#endif
+    gesture_data_.total_records += gesture_data_.current_records;
+    // Process gesture data.
+    processGestureData(records);
+}
+
+/**
+ * @brief Submits the read of the gesture FIFO into the buffer being filled
+ *
+ * @param[in] len bytes to read
+ */
+void APDS9960::startFifoRead(uint8_t len)
+{
+    fifo_xfer_.reg = APDS9960_GFIFO_U;
+    fifo_xfer_.buf = (uint8_t*)fifo_buf_[fifo_fill_];
+    fifo_xfer_.len = len;
+    fifo_xfer_.read = true;
+    fifo_xfer_.done = NULL;
+    submitTransfer(fifo_xfer_);
+}
+#endif
+
+/**
+ * Turn the APDS-9960 on
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::enablePower()
+{
+    if( !setMode(POWER, 1) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Turn the APDS-9960 off
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::disablePower()
+{
+    if( !setMode(POWER, 0) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Ambient light and color sensor controls
+ ******************************************************************************/
+
+#if APDS9960_ALS
+/**
+ * @brief Reads the ambient (clear) light level as a 16-bit value
+ *
+ * @param[out] val value of the light sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readAmbientLight(uint16_t &val)
+{
+    uint8_t val_byte;
+    uint8_t status = 0;
+    val = 0;
+
+    /* Saturation flags are only needed with saturation control on */
+    if( sat_.active && !wireReadDataByte(APDS9960_STATUS, status) ) {
+        return false;
+    }
+
+    /* Read value from clear channel, low byte register */
+    if( !wireReadDataByte(APDS9960_CDATAL, val_byte) ) {
+        return false;
+    }
+    val = val_byte;
+
+    /* Read value from clear channel, high byte register */
+    if( !wireReadDataByte(APDS9960_CDATAH, val_byte) ) {
+        return false;
+    }
+    val = val + ((uint16_t)val_byte << 8);
+
+    if( sat_.active && !updateLightRange(status, val) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the red light level as a 16-bit value
+ *
+ * @param[out] val value of the light sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readRedLight(uint16_t &val)
+{
+    uint8_t val_byte;
+    val = 0;
+
+    /* Read value from clear channel, low byte register */
+    if( !wireReadDataByte(APDS9960_RDATAL, val_byte) ) {
+        return false;
+    }
+    val = val_byte;
+
+    /* Read value from clear channel, high byte register */
+    if( !wireReadDataByte(APDS9960_RDATAH, val_byte) ) {
+        return false;
+    }
+    val = val + ((uint16_t)val_byte << 8);
+
+    return true;
+}
+ 
+/**
+ * @brief Reads the green light level as a 16-bit value
+ *
+ * @param[out] val value of the light sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readGreenLight(uint16_t &val)
+{
+    uint8_t val_byte;
+    val = 0;
+
+    /* Read value from clear channel, low byte register */
+    if( !wireReadDataByte(APDS9960_GDATAL, val_byte) ) {
+        return false;
+    }
+    val = val_byte;
+
+    /* Read value from clear channel, high byte register */
+    if( !wireReadDataByte(APDS9960_GDATAH, val_byte) ) {
+        return false;
+    }
+    val = val + ((uint16_t)val_byte << 8);
+
+    return true;
+}
+
+/**
+ * @brief Reads the red light level as a 16-bit value
+ *
+ * @param[out] val value of the light sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readBlueLight(uint16_t &val)
+{
+    uint8_t val_byte;
+    val = 0;
+
+    /* Read value from clear channel, low byte register */
+    if( !wireReadDataByte(APDS9960_BDATAL, val_byte) ) {
+        return false;
+    }
+    val = val_byte;
+
+    /* Read value from clear channel, high byte register */
+    if( !wireReadDataByte(APDS9960_BDATAH, val_byte) ) {
+        return false;
+    }
+    val = val + ((uint16_t)val_byte << 8);
+
+    return true;
+}
+
+/**
+ * @brief Tells when readColorIfNew() next expects a fresh ALS result
+ *
+ * While the cycle phase is still being found this is the next poll.
+ *
+ * @return micros() timestamp of the next expected AVALID, possibly past.
+ */
+unsigned long APDS9960::nextAlsReadyAt()
+{
+    return als_next_us_;
+}
+
+/**
+ * @brief Reads all four color channels once per ALS integration
+ *
+ * Does nothing before nextAlsReadyAt(). After that STATUS is checked and,
+ * if AVALID is set, CDATAL..BDATAH are read in one 8-byte block. The
+ * cycle phase is found by polling every 1/ALS_RETRY_DIVIDER of a period
+ * once, then followed from the AVALID edges: a result found on the first
+ * poll moves the next poll one step earlier, a result found after a miss
+ * fixes the edge to within one step. This costs about 1.5 STATUS reads
+ * per integration and tracks clock drift.
+ *
+ * @param[out] clear value of the clear channel
+ * @param[out] red value of the red channel
+ * @param[out] green value of the green channel
+ * @param[out] blue value of the blue channel
+ * @return 1 if new values were read, 0 if not. ERROR on failure.
+ */
+uint8_t APDS9960::readColorIfNew(uint16_t &clear, uint16_t &red,
+                                 uint16_t &green, uint16_t &blue)
+{
+    cycle_timing_type timing;
+    unsigned long now = micros();
+    uint8_t status;
+    uint8_t data[8];
+
+    if( (long)(als_next_us_ - now) > 0 ) {
+        return 0;
+    }
+    if( !getCycleTiming(timing) || !timing.als_us ) {
+        return ERROR;
+    }
+    uint32_t step = timing.period_us / ALS_RETRY_DIVIDER;
+
+    if( !wireReadDataByte(APDS9960_STATUS, status) ) {
+        return ERROR;
+    }
+    if( !(status & APDS9960_AVALID) ) {
+        als_next_us_ = now + step;
+        als_missed_ = true;
+        return 0;
+    }
+
+    /* Read the four channels in one transaction */
+    if( wireReadDataBlock(APDS9960_CDATAL, data, 8) != 8 ) {
+        return ERROR;
+    }
+    clear = data[0] | ((uint16_t)data[1] << 8);
+    red = data[2] | ((uint16_t)data[3] << 8);
+    green = data[4] | ((uint16_t)data[5] << 8);
+    blue = data[6] | ((uint16_t)data[7] << 8);
+    if( sat_.active && !updateLightRange(status, clear) ) {
+        return ERROR;
+    }
+
+    /* Schedule the next poll from what this one told about the phase */
+    if( !als_synced_ ) {
+        als_next_us_ = now + step;
+        if( als_missed_ ) {
+            als_next_us_ = now + timing.period_us;
+            als_synced_ = true;
+        }
+    } else if( als_missed_ ) {
+        als_next_us_ = now + timing.period_us;
+    } else {
+        als_next_us_ = now + timing.period_us - step;
+    }
+    als_missed_ = false;
+
+    return 1;
+}
+
+#if APDS9960_INTERRUPTS
+/**
+ * @brief Starts moving the ALS interrupt window with the clear level
+ *
+ * ALS runs with interrupts enabled. The first window forces an interrupt;
+ * every updateLightTracking() that finds AINT set then re-centres the
+ * window on the new clear level, so the interrupt only fires when the
+ * level leaves the band for 'persistence' consecutive cycles.
+ *
+ * @param[in] band half-width of the window in percent of the clear level
+ * @param[in] persistence APERS value, 0-15 (see setLightIntPersistence)
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::enableLightTracking(uint8_t band, uint8_t persistence)
+{
+    if( band == 0 || band > 100 ) {
+        return false;
+    }
+    if( !setLightIntPersistence(persistence) ) {
+        return false;
+    }
+    if( !setLightIntWindow(DEFAULT_AILT, DEFAULT_AIHT) ) {
+        return false;
+    }
+    if( !clearAmbientLightInt() ) {
+        return false;
+    }
+    if( !enableLightSensor(true) ) {
+        return false;
+    }
+    als_band_ = band;
+
+    return true;
+}
+
+/**
+ * @brief Stops ALS window tracking, leaving ALS running without interrupts
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::disableLightTracking()
+{
+    als_band_ = 0;
+    if( !setAmbientLightIntEnable(0) ) {
+        return false;
+    }
+
+    return clearAmbientLightInt();
+}
+
+/**
+ * @brief Accepts a new clear level if the ALS interrupt fired
+ *
+ * Costs a single STATUS read while the level stays in band. On AINT the
+ * clear channel is read, AILTL..AIHTH are written in one burst and the
+ * interrupt is cleared. Call it when INT goes low, or at a low poll rate.
+ *
+ * @param[out] clear new clear level, untouched if nothing changed
+ * @return 1 if a new level was accepted, 0 if not. ERROR on failure.
+ */
+uint8_t APDS9960::updateLightTracking(uint16_t &clear)
+{
+    uint8_t status;
+    uint8_t data[2];
+
+    if( !als_band_ ) {
+        return ERROR;
+    }
+    if( !wireReadDataByte(APDS9960_STATUS, status) ) {
+        return ERROR;
+    }
+    if( !(status & APDS9960_AINT) ) {
+        return 0;
+    }
+
+    /* Read CDATAL and CDATAH together so the bytes match */
+    if( wireReadDataBlock(APDS9960_CDATAL, data, 2) != 2 ) {
+        return ERROR;
+    }
+    uint16_t level = data[0] | ((uint16_t)data[1] << 8);
+    if( sat_.active && !updateLightRange(status, level) ) {
+        return ERROR;
+    }
+
+    /* Band of +/- als_band_ %, never narrower than the noise floor */
+    uint16_t half = (uint32_t)level * als_band_ / 100;
+    if( half < ALS_MIN_BAND ) {
+        half = ALS_MIN_BAND;
+    }
+    uint16_t low = level > half ? level - half : 0;
+    uint16_t high = (uint32_t)level + half > 0xFFFF ? 0xFFFF : level + half;
+
+    if( !setLightIntWindow(low, high) ) {
+        return ERROR;
+    }
+    if( !clearAmbientLightInt() ) {
+        return ERROR;
+    }
+    clear = level;
+
+    return 1;
+}
+#endif
+#endif
+
+/*******************************************************************************
+ * Proximity sensor controls
+ ******************************************************************************/
+
+#if APDS9960_PROXIMITY
+/**
+ * @brief Reads the proximity level as an 8-bit value
+ *
+ * @param[out] val value of the proximity sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readProximity(uint8_t &val)
+{
+    uint8_t status = 0;
+    val = 0;
+
+    /* Saturation flags are only needed with saturation control on */
+    if( sat_.active && !wireReadDataByte(APDS9960_STATUS, status) ) {
+        return false;
+    }
+
+    /* Read value from proximity data register */
+    if( !wireReadDataByte(APDS9960_PDATA, val) ) {
+        return false;
+    }
+
+    if( sat_.active && !updateProximityRange(status, val) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Configures the proximity filter used by readProximityFiltered()
+ *
+ * Each sample goes through a running median of the last 'size' samples,
+ * which drops isolated spikes, then an exponential moving average with
+ * weight 1/2^ema_shift. The median keeps its window sorted, an insert
+ * shifts up to N-1 entries, so a sample costs O(N) with N <= 9; the EMA
+ * is O(1).
+ *
+ * @param[in] size median window length (1-9), 0 to turn the filter off
+ * @param[in] ema_shift EMA weight as a power of two (0-7), 0 for no EMA
+ * @return True if operation successful. False on invalid parameters.
+ */
+bool APDS9960::setProximityFilter(uint8_t size, uint8_t ema_shift)
+{
+    if( size > PROX_FILTER_MAX || ema_shift > 7 ) {
+        return false;
+    }
+
+    prox_filter_.size = size;
+    prox_filter_.ema_shift = ema_shift;
+    resetProximityFilter();
+
+    return true;
+}
+
+/**
+ * @brief Reads the proximity level and passes it through the filter
+ *
+ * @param[out] val filtered value of the proximity sensor.
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::readProximityFiltered(uint8_t &val)
+{
+    uint8_t raw;
+
+    if( !readProximity(raw) ) {
+        return false;
+    }
+    val = filterProximity(raw);
+
+    return true;
+}
+
+/**
+ * @brief Empties the proximity filter windows
+ */
+void APDS9960::resetProximityFilter()
+{
+    prox_filter_.count = 0;
+    prox_filter_.head = 0;
+    prox_filter_.ema = 0;
+}
+
+/**
+ * @brief Adds a sample to the proximity filter
+ *
+ * The sorted copy of the window is kept up to date incrementally: the
+ * oldest sample is located by binary search and the entries between it
+ * and the new sample's place are shifted by one.
+ *
+ * @param[in] sample raw proximity value
+ * @return Filtered proximity value.
+ */
+uint8_t APDS9960::filterProximity(uint8_t sample)
+{
+    prox_filter_type &f = prox_filter_;
+    uint8_t lo, hi, i;
+
+    if( f.size == 0 ) {
+        return sample;
+    }
+
+    if( f.count < f.size ) {
+        /* Window filling up: insert into the sorted array */
+        lo = 0;
+        hi = f.count;
+        while( lo < hi ) {
+            uint8_t mid = (lo + hi) >> 1;
+            if( f.sorted[mid] < sample ) lo = mid + 1;
+            else hi = mid;
+        }
+        for (i = f.count; i > lo; i--) {
+            f.sorted[i] = f.sorted[i-1];
+        }
+        f.sorted[lo] = sample;
+        f.count++;
+    } else {
+        /* Replace the oldest sample, moving it to the new place */
+        uint8_t old = f.window[f.head];
+        lo = 0;
+        hi = f.count - 1;
+        while( lo < hi ) {
+            uint8_t mid = (lo + hi) >> 1;
+            if( f.sorted[mid] < old ) lo = mid + 1;
+            else hi = mid;
+        }
+        i = lo;
+        while( i + 1 < f.count && f.sorted[i+1] < sample ) {
+            f.sorted[i] = f.sorted[i+1];
+            i++;
+        }
+        while( i > 0 && f.sorted[i-1] > sample ) {
+            f.sorted[i] = f.sorted[i-1];
+            i--;
+        }
+        f.sorted[i] = sample;
+    }
+    f.window[f.head] = sample;
+    if( ++f.head >= f.size ) {
+        f.head = 0;
+    }
+
+    /* EMA of the median, 8.8 fixed point */
+    uint16_t median = (uint16_t)f.sorted[f.count >> 1] << 8;
+    if( f.count == 1 ) {
+        f.ema = median;
+    } else {
+        f.ema += ((int32_t)median - f.ema) >> f.ema_shift;
+    }
+
+    return (f.ema + 0x80) >> 8;
+}
+
+#if APDS9960_INTERRUPTS
+/**
+ * @brief Learns the idle proximity level and arms enter/leave thresholds
+ *
+ * Nothing may be in front of the sensor while this runs: it averages
+ * PROX_LEARN_SAMPLES readings, one per getCycleTiming() period (about
+ * half a second with the default wait time, longer with ALS on), polling
+ * PVALID every 1/PROX_LEARN_DIVIDER of the period. The enter threshold
+ * sits 'margin' counts, or four times the noise if larger, above the idle
+ * level; the leave threshold is half way back, so a hand at the edge of
+ * the range does not chatter.
+ *
+ * @param[in] margin counts above the idle level that mean "near"
+ * @param[in] persistence PPERS value, consecutive cycles before PINT
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::enableProximityTracking(uint8_t margin, uint8_t persistence)
+{
+    cycle_timing_type timing;
+    uint8_t samples[PROX_LEARN_SAMPLES];
+    uint16_t sum = 0;
+    uint16_t dev = 0;
+
+    prox_track_.active = false;
+    if( !enableProximitySensor(false) ) {
+        return false;
+    }
+
+    /* A sample takes one cycle (wait and ALS included); allow two and a
+       half for the cycle in progress and the oscillator tolerance, and
+       the power-on time before the first one */
+    if( !getCycleTiming(timing) ) {
+        return false;
+    }
+    unsigned long timeout = timing.period_us * 5UL / 2 + POWER_ON_TIME * 1000UL;
+    unsigned long poll_ms = (timing.period_us / PROX_LEARN_DIVIDER + 999) / 1000;
+
+    /* Collect idle samples, one per completed cycle */
+    for( uint8_t i = 0; i < PROX_LEARN_SAMPLES; i++ ) {
+        unsigned long start = micros();
+        uint8_t status;
+        while( true ) {
+            if( !wireReadDataByte(APDS9960_STATUS, status) ) {
+                return false;
+            }
+            if( status & APDS9960_PVALID ) {
+                break;
+            }
+            if( micros() - start > timeout ) {
+                return false;
+            }
+            delay(poll_ms);
+        }
+        if( !wireReadDataByte(APDS9960_PDATA, samples[i]) ) {
+            return false;
+        }
+        sum += samples[i];
+    }
+    uint8_t mean = (sum + PROX_LEARN_SAMPLES / 2) / PROX_LEARN_SAMPLES;
+    for( uint8_t i = 0; i < PROX_LEARN_SAMPLES; i++ ) {
+        dev += samples[i] > mean ? samples[i] - mean : mean - samples[i];
+    }
+
+    /* Thresholds, with room above enter for the signal itself */
+    uint16_t span = margin;
+    prox_track_.baseline = mean;
+    prox_track_.noise = (dev + PROX_LEARN_SAMPLES / 2) / PROX_LEARN_SAMPLES;
+    if( span < 4 * prox_track_.noise ) {
+        span = 4 * prox_track_.noise;
+    }
+    if( span < 2 ) {
+        span = 2;
+    }
+    if( mean + span > 254 ) {
+        return false;
+    }
+    prox_track_.enter = mean + span;
+    prox_track_.leave = mean + span / 2;
+    prox_track_.near = false;
+
+    if( !setProximityIntPersistence(persistence) ) {
+        return false;
+    }
+    if( !armProximityThresholds() ) {
+        return false;
+    }
+    if( !clearProximityInt() ) {
+        return false;
+    }
+    if( !setProximityIntEnable(1) ) {
+        return false;
+    }
+    prox_track_.active = true;
+
+    return true;
+}
+
+/**
+ * @brief Stops threshold tracking, leaving proximity running without interrupts
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::disableProximityTracking()
+{
+    prox_track_.active = false;
+    if( !setProximityIntEnable(0) ) {
+        return false;
+    }
+
+    return clearProximityInt();
+}
+
+/**
+ * @brief Checks for a proximity enter or leave transition
+ *
+ * Costs a single STATUS read when nothing happened. On PINT the level is
+ * read, the state flips if it crossed the threshold of the current state,
+ * the thresholds are re-armed for the opposite transition and the
+ * interrupt is cleared. Call it when INT goes low, or at a low poll rate.
+ *
+ * @return PROX_EVENT_ENTER, PROX_EVENT_LEAVE or PROX_EVENT_NONE. ERROR on
+ *  failure.
+ */
+uint8_t APDS9960::updateProximityTracking()
+{
+    uint8_t status;
+    uint8_t level;
+    uint8_t event = PROX_EVENT_NONE;
+
+    if( !prox_track_.active ) {
+        return ERROR;
+    }
+    if( !wireReadDataByte(APDS9960_STATUS, status) ) {
+        return ERROR;
+    }
+    if( !(status & APDS9960_PINT) ) {
+        return PROX_EVENT_NONE;
+    }
+    if( !wireReadDataByte(APDS9960_PDATA, level) ) {
+        return ERROR;
+    }
+
+    if( !prox_track_.near && level >= prox_track_.enter ) {
+        prox_track_.near = true;
+        event = PROX_EVENT_ENTER;
+    } else if( prox_track_.near && level <= prox_track_.leave ) {
+        prox_track_.near = false;
+        event = PROX_EVENT_LEAVE;
+    }
+    if( event != PROX_EVENT_NONE && !armProximityThresholds() ) {
+        return ERROR;
+    }
+    if( !clearProximityInt() ) {
+        return ERROR;
+    }
+
+    return event;
+}
+
+/**
+ * @brief Tells if the last tracked transition was an enter
+ *
+ * @return True if an object is near. False otherwise.
+ */
+bool APDS9960::isProximityNear()
+{
+    return prox_track_.near;
+}
+
+/**
+ * @brief Programs PILT/PIHT for the transition out of the current state
+ *
+ * While far only PIHT can fire (PILT is 0); while near only PILT can
+ * fire (PIHT is 255).
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::armProximityThresholds()
+{
+    if( prox_track_.near ) {
+        if( !setProximityIntLowThreshold(prox_track_.leave) ) {
+            return false;
+        }
+        return setProximityIntHighThreshold(255);
+    }
+
+    if( !setProximityIntLowThreshold(0) ) {
+        return false;
+    }
+    return setProximityIntHighThreshold(prox_track_.enter);
+}
+#endif
+
+/**
+ * @brief Runs proximity alone at the highest rate the chip allows
+ *
+ * ALS, wait and gesture are turned off so the state machine only runs
+ * proximity cycles. Gain and LED drive are set to maximum, then PPULSE
+ * candidates are tried from the shortest cycle up, keeping the first one
+ * whose samples reach the requested mean/noise ratio (noise estimated
+ * from the mean absolute deviation). A saturated sample (255) does not
+ * count: gain, then LED drive, is lowered and the candidate tried again.
+ * Calibrate with the target object in front of the sensor. A 400 kHz
+ * bus is needed to keep up, set it with setBusClock(). ENABLE, PPULSE,
+ * WTIME and CONTROL are saved for disableProximityHighRate().
+ *
+ * @param[in] min_snr minimum mean/noise ratio of the proximity samples
+ * @return True if a configuration met min_snr. False otherwise, in which
+ *         case the last configuration tried is left running.
+ */
+bool APDS9960::enableProximityHighRate(uint8_t min_snr)
+{
+    /* PPLEN/PPULSE candidates by increasing cycle time */
+    static const uint8_t candidates[] = {
+        0x00,   // 4us, 1 pulse
+        0x01,   // 4us, 2 pulses
+        0x03,   // 4us, 4 pulses
+        0x43,   // 8us, 4 pulses
+        0x47,   // 8us, 8 pulses
+        0x87,   // 16us, 8 pulses
+        0x8F,   // 16us, 16 pulses
+        0xCF,   // 32us, 16 pulses
+        0xDF,   // 32us, 32 pulses
+        0xFF    // 32us, 64 pulses
+    };
+    uint8_t samples[HIGHRATE_SAMPLES];
+    uint8_t mode = getMode();
+
+    if( mode == ERROR ) {
+        return false;
+    }
+    if( !prox_highrate_.active ) {
+        if( !readShadow(APDS9960_PPULSE, prox_highrate_.ppulse) ||
+            !readShadow(APDS9960_WTIME, prox_highrate_.wtime) ||
+            !readShadow(APDS9960_CONTROL, prox_highrate_.control) ) {
+            return false;
+        }
+        prox_highrate_.enable = mode;
+        prox_highrate_.active = true;
+    }
+    if( !setMode(AMBIENT_LIGHT, 0) || !setMode(WAIT, 0) ||
+        !setMode(GESTURE, 0) || !setProximityIntEnable(0) ) {
+        return false;
+    }
+    uint8_t gain = PGAIN_8X;
+    uint8_t drive = LED_DRIVE_100MA;
+    if( !setProximityGain(gain) || !setLEDDrive(drive) ) {
+        return false;
+    }
+    if( !enablePower() || !setMode(PROXIMITY, 1) ) {
+        return false;
+    }
+    if( !(mode & APDS9960_PON) ) {
+        delay(POWER_ON_TIME);
+    }
+
+    for (uint8_t c = 0; c < sizeof(candidates); c++)
+    {
+        if( !wireWriteDataByte(APDS9960_PPULSE, candidates[c]) ) {
+            return false;
+        }
+        prox_ppulse_ = candidates[c];
+
+        /* Clipped samples hide the noise, retry less sensitive */
+        uint16_t sum;
+        bool saturated;
+        do {
+            /* First sample may still come from the previous setting */
+            if( captureProximity(samples, 1) != 1 ||
+                captureProximity(samples, HIGHRATE_SAMPLES) != HIGHRATE_SAMPLES ) {
+                return false;
+            }
+
+            sum = 0;
+            saturated = false;
+            for (uint8_t i = 0; i < HIGHRATE_SAMPLES; i++) {
+                sum += samples[i];
+                saturated |= (samples[i] == 255);
+            }
+
+            if( saturated ) {
+                if( gain > PGAIN_1X ) {
+                    gain--;
+                    if( !setProximityGain(gain) ) {
+                        return false;
+                    }
+                } else if( drive < LED_DRIVE_12_5MA ) {
+                    drive++;
+                    if( !setLEDDrive(drive) ) {
+                        return false;
+                    }
+                } else {
+                    return false;
+                }
+            }
+        } while( saturated );
+
+        uint8_t mean = sum / HIGHRATE_SAMPLES;
+        uint16_t dev = 0;
+        for (uint8_t i = 0; i < HIGHRATE_SAMPLES; i++) {
+            dev += (samples[i] > mean) ? samples[i] - mean : mean - samples[i];
+        }
+
+        /* mean >= snr * sigma, sigma ~ 1.25 * MAD, at least 1 count */
+        uint32_t noise = (5UL * dev) / HIGHRATE_SAMPLES;
+        if( noise < 4 ) {
+            noise = 4;
+        }
+        if( 4UL * mean >= (uint32_t)min_snr * noise ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Leaves high-rate mode, restoring the configuration it replaced
+ *
+ * ENABLE, PPULSE, WTIME and CONTROL get the values saved by
+ * enableProximityHighRate(). Without a saved configuration the default
+ * proximity settings are applied.
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::disableProximityHighRate()
+{
+    if( !prox_highrate_.active ) {
+        if( !wireWriteDataByte(APDS9960_PPULSE, DEFAULT_PROX_PPULSE) ) {
+            return false;
+        }
+        prox_ppulse_ = DEFAULT_PROX_PPULSE;
+        if( !wireWriteDataByte(APDS9960_WTIME, DEFAULT_WTIME) ) {
+            return false;
+        }
+        return enableProximitySensor(false);
+    }
+
+    if( !wireWriteDataByte(APDS9960_PPULSE, prox_highrate_.ppulse) ||
+        !wireWriteDataByte(APDS9960_WTIME, prox_highrate_.wtime) ||
+        !wireWriteDataByte(APDS9960_CONTROL, prox_highrate_.control) ||
+        !wireWriteDataByte(APDS9960_ENABLE, prox_highrate_.enable) ) {
+        return false;
+    }
+    prox_ppulse_ = prox_highrate_.ppulse;
+    prox_highrate_.active = false;
+
+    return true;
+}
+
+/**
+ * @brief Captures proximity samples back to back on PVALID
+ *
+ * Each sample is read as soon as STATUS reports a completed proximity
+ * cycle. Capture stops early if no cycle completes within twice the
+ * expected cycle time, or once budget_us has been used; the caller can
+ * continue with the rest of the buffer later. The achieved rate is kept
+ * for getProximityRate().
+ *
+ * @param[out] buf buffer receiving the samples
+ * @param[in] count number of samples to capture
+ * @param[in] budget_us time allowed in this call (us), 0 for no limit
+ * @return Number of samples captured.
+ */
+uint16_t APDS9960::captureProximity(uint8_t *buf, uint16_t count, uint32_t budget_us)
+{
+    uint32_t timeout = 2 * getProximityTime(prox_ppulse_) + 1000;
+    unsigned long start = micros();
+    unsigned long last = start;
+    uint16_t n = 0;
+
+    while( n < count )
+    {
+        uint8_t status;
+        if( !wireReadDataByte(APDS9960_STATUS, status) ) {
+            break;
+        }
+        unsigned long now = micros();
+        if( budget_us && now - start >= budget_us ) {
+            break;
+        }
+        if( status & APDS9960_PVALID )
+        {
+            if( !wireReadDataByte(APDS9960_PDATA, buf[n]) ) {
+                break;
+            }
+            n++;
+            last = now;
+        } else if( now - last > timeout ) {
+            break;
+        }
+    }
+
+    unsigned long elapsed = micros() - start;
+    if( n && elapsed ) {
+        prox_rate_ = (uint32_t)n * 1000000UL / elapsed;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Returns the sample rate achieved by the last capture
+ *
+ * @return Proximity samples per second.
+ */
+uint16_t APDS9960::getProximityRate()
+{
+    return prox_rate_;
+}
+#endif
+
+/**
+ * @brief Expected duration of one proximity cycle
+ *
+ * @param[in] ppulse PPULSE register value (pulse length and count)
+ * @return Proximity cycle time in microseconds.
+ */
+uint32_t APDS9960::getProximityTime(uint8_t ppulse)
+{
+    uint32_t pulses = (ppulse & 0b00111111) + 1;
+    uint32_t len = 4 << (ppulse >> 6);
+
+    /* LED pulses at 50% duty, then the conversion */
+    return 2 * pulses * len + PROX_CONVERSION_TIME;
+}
+
+/**
+ * @brief Expected duration of one ALS integration
+ *
+ * @param[in] atime ATIME register value
+ * @return Integration time (us)
+ */
+uint32_t APDS9960::getAlsTime(uint8_t atime)
+{
+    return (256UL - atime) * WAIT_STEP_TIME;
+}
+
+/**
+ * @brief Expected duration of the wait between cycles
+ *
+ * @param[in] wtime WTIME register value
+ * @param[in] config1 CONFIG1 register value, for WLONG
+ * @return Wait time (us)
+ */
+uint32_t APDS9960::getWaitTime(uint8_t wtime, uint8_t config1)
+{
+    uint32_t wait = (256UL - wtime) * WAIT_STEP_TIME;
+
+    if( config1 & APDS9960_WLONG ) {
+        wait *= WLONG_FACTOR;
+    }
+
+    return wait;
+}
+
+/**
+ * @brief Expected duration of one gesture dataset
+ *
+ * @param[in] gpulse GPULSE register value
+ * @param[in] gconf2 GCONF2 register value, for GWTIME
+ * @return Dataset time (us)
+ */
+uint32_t APDS9960::getGestureTime(uint8_t gpulse, uint8_t gconf2)
+{
+    static const uint16_t gwtime_us[8] = {
+        0, 2800, 5600, 8400, 14000, 22400, 30800, 39200
+    };
+    uint32_t pulses = (gpulse & 0b00111111) + 1;
+    uint32_t len = 4 << (gpulse >> 6);
+
+    /* U/D and L/R pairs are pulsed in turn, then the gesture wait */
+    return 2 * (2 * pulses * len) + GESTURE_CONVERSION_TIME +
+           gwtime_us[gconf2 & 0b00000111];
+}
+
+/**
+ * @brief Estimates the average LED current of proximity cycles
+ *
+ * The LED is on for half of each pulse period. Peak current is the
+ * LDRIVE current scaled by LED_BOOST. Gesture cycles are not included.
+ *
+ * @param[in] period_us length of one full cycle
+ * @return Average LED current (uA). 0 if proximity is off or on error.
+ */
+uint32_t APDS9960::getLEDCurrent(uint32_t period_us)
+{
+    static const uint16_t boost_pct[] = {100, 150, 200, 300};
+    uint8_t enable, ppulse, control, config2;
+
+    if( !readShadow(APDS9960_ENABLE, enable) ||
+        !readShadow(APDS9960_PPULSE, ppulse) ||
+        !readShadow(APDS9960_CONTROL, control) ||
+        !readShadow(APDS9960_CONFIG2, config2) ) {
+        return 0;
+    }
+    if( !(enable & APDS9960_PEN) || !period_us ) {
+        return 0;
+    }
+
+    uint32_t pulses = (ppulse & 0b00111111) + 1;
+    uint32_t on_us = pulses * (4 << (ppulse >> 6));
+    uint32_t peak_ua = (100000UL >> (control >> 6)) *
+                       boost_pct[(config2 >> 4) & 0b11] / 100;
+
+    return (peak_ua * on_us + period_us / 2) / period_us;
+}
+
+/*******************************************************************************
+ * Saturation control
+ ******************************************************************************/
+
+/**
+ * @brief Steps gains down on saturation and back up when the signal falls
+ *
+ * After this call readProximity() and readAmbientLight() also read STATUS,
+ * and readColorIfNew() and updateLightTracking() use the STATUS they
+ * already read. A sample with PGSAT set or PDATA at 255 lowers PGAIN one
+ * step, then LDRIVE once PGAIN is at 1x. A sample with CPSAT set or the
+ * clear channel at full scale lowers AGAIN one step. The flag is cleared
+ * and the sample reported by getSaturation(). Gains are stepped back up,
+ * LDRIVE first, after SAT_RESTORE_SAMPLES samples in a row low enough
+ * that the next step cannot clip (PDATA below SAT_PROX_RESTORE, clear
+ * below 1/16 of full scale), never past the CONTROL value set when this
+ * was called. Set gains and LED drive before enabling.
+ *
+ * @param[in] interrupts true to also assert INT on saturation (PSIEN, CPSIEN)
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::enableSaturationControl(bool interrupts)
+{
+    uint8_t config2;
+    uint8_t throwaway;
+
+    if( !readShadow(APDS9960_CONTROL, sat_.control) ||
+        !readShadow(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+
+    /* Set saturation interrupt enables in CONFIG2 */
+    config2 &= ~(APDS9960_PSIEN | APDS9960_CPSIEN);
+    if( APDS9960_INTERRUPTS && interrupts ) {
+        config2 |= APDS9960_PSIEN | APDS9960_CPSIEN;
+    }
+    if( !wireWriteDataByte(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+
+    /* Start from clear flags */
+    if( !wireReadDataByte(APDS9960_PICLEAR, throwaway) ||
+        !wireReadDataByte(APDS9960_CICLEAR, throwaway) ) {
+        return false;
+    }
+    sat_.prox_low = 0;
+    sat_.als_low = 0;
+    sat_.flags = 0;
+    sat_.active = true;
+
+    return true;
+}
+
+/**
+ * @brief Stops saturation control and restores the configured gains
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::disableSaturationControl()
+{
+    uint8_t config2;
+
+    if( !sat_.active ) {
+        return true;
+    }
+    sat_.active = false;
+    sat_.flags = 0;
+    if( !readShadow(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+    config2 &= ~(APDS9960_PSIEN | APDS9960_CPSIEN);
+    if( !wireWriteDataByte(APDS9960_CONFIG2, config2) ) {
+        return false;
+    }
+
+    return wireWriteDataByte(APDS9960_CONTROL, sat_.control);
+}
+
+/**
+ * @brief Tells which of the last samples read were saturated
+ *
+ * @return SAT_PROXIMITY and/or SAT_AMBIENT, 0 if none or control is off.
+ */
+uint8_t APDS9960::getSaturation()
+{
+    return sat_.flags;
+}
+
+#if APDS9960_PROXIMITY
+/**
+ * @brief Saturation policy for one proximity sample
+ *
+ * @param[in] status STATUS read with the sample
+ * @param[in] pdata the sample
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::updateProximityRange(uint8_t status, uint8_t pdata)
+{
+    uint8_t control;
+    bool saturated = (status & APDS9960_PGSAT) || pdata == 255;
+
+    if( !readShadow(APDS9960_CONTROL, control) ) {
+        return false;
+    }
+    uint8_t ldrive = control >> 6;
+    uint8_t pgain = (control >> 2) & 0b00000011;
+
+    if( saturated ) {
+        sat_.flags |= SAT_PROXIMITY;
+        sat_.prox_low = 0;
+        if( pgain > PGAIN_1X ) {
+            pgain--;
+        } else if( ldrive < LED_DRIVE_12_5MA ) {
+            ldrive++;
+        }
+    } else {
+        sat_.flags &= ~SAT_PROXIMITY;
+        if( pdata >= SAT_PROX_RESTORE ) {
+            sat_.prox_low = 0;
+            return true;
+        }
+        if( ++sat_.prox_low < SAT_RESTORE_SAMPLES ) {
+            return true;
+        }
+        sat_.prox_low = 0;
+
+        /* Back up in reverse order, LDRIVE first */
+        if( ldrive > (sat_.control >> 6) ) {
+            ldrive--;
+        } else if( pgain < ((sat_.control >> 2) & 0b00000011) ) {
+            pgain++;
+        }
+    }
+
+    /* Write CONTROL only if a step was taken */
+    uint8_t val = (control & 0b00110011) | (ldrive << 6) | (pgain << 2);
+    if( val != control && !wireWriteDataByte(APDS9960_CONTROL, val) ) {
+        return false;
+    }
+    if( saturated ) {
+        uint8_t throwaway;
+        if( !wireReadDataByte(APDS9960_PICLEAR, throwaway) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+#if APDS9960_ALS
+/**
+ * @brief Saturation policy for one clear channel sample
+ *
+ * @param[in] status STATUS read with the sample
+ * @param[in] clear the clear channel count
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::updateLightRange(uint8_t status, uint16_t clear)
+{
+    uint8_t control, atime;
+
+    if( !readShadow(APDS9960_CONTROL, control) ||
+        !readShadow(APDS9960_ATIME, atime) ) {
+        return false;
+    }
+
+    /* Full scale is 1025 counts per ATIME step */
+    uint32_t full = 1025UL * (256 - atime);
+    if( full > 0xFFFF ) {
+        full = 0xFFFF;
+    }
+    bool saturated = (status & APDS9960_CPSAT) || clear >= full;
+    uint8_t again = control & 0b00000011;
+
+    if( saturated ) {
+        sat_.flags |= SAT_AMBIENT;
+        sat_.als_low = 0;
+        if( again > AGAIN_1X ) {
+            again--;
+        }
+    } else {
+        sat_.flags &= ~SAT_AMBIENT;
+        if( clear >= full / 16 ) {
+            sat_.als_low = 0;
+            return true;
+        }
+        if( ++sat_.als_low < SAT_RESTORE_SAMPLES ) {
+            return true;
+        }
+        sat_.als_low = 0;
+        if( again < (sat_.control & 0b00000011) ) {
+            again++;
+        }
+    }
+
+    /* Write CONTROL only if a step was taken */
+    uint8_t val = (control & 0b11111100) | again;
+    if( val != control && !wireWriteDataByte(APDS9960_CONTROL, val) ) {
+        return false;
+    }
+    if( saturated ) {
+        uint8_t throwaway;
+        if( !wireReadDataByte(APDS9960_CICLEAR, throwaway) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+/*******************************************************************************
+ * Power scheduling
+ ******************************************************************************/
+
+/**
+ * @brief Chooses WTIME, WLONG and SAI for a sample interval and latency
+ *
+ * The cycle is made as long as possible, so the LEDs and ADCs run as
+ * rarely as possible, while one sample still arrives at least every
+ * interval_us and an event is seen within max_latency_us (one full
+ * period plus the conversion in the worst case). WLONG is only used for
+ * waits longer than 256 WTIME steps. SAI is only planned when asked for:
+ * with proximity or ALS interrupts enabled the device then stops cycling
+ * until the host has cleared the interrupt, which saves power but misses
+ * samples if the host is slow to respond. Nothing is written.
+ *
+ * @param[in] interval_us longest time between two samples
+ * @param[in] max_latency_us longest time from an event to its sample
+ * @param[out] plan register values and the resulting timing
+ * @param[in] sleep_after_int true to set SAI
+ * @return True if a plan exists for the enabled features. False otherwise.
+ */
+bool APDS9960::planPower(uint32_t interval_us, uint32_t max_latency_us,
+                         power_plan_type &plan, bool sleep_after_int)
+{
+    uint8_t enable, ppulse, atime;
+
+    if( !readShadow(APDS9960_ENABLE, enable) ||
+        !readShadow(APDS9960_PPULSE, ppulse) ||
+        !readShadow(APDS9960_ATIME, atime) ) {
+        return false;
+    }
+
+    /* Time the state machine is busy in every cycle */
+    plan.active_us = 0;
+    if( enable & APDS9960_PEN ) {
+        plan.active_us += getProximityTime(ppulse);
+    }
+    if( enable & APDS9960_AEN ) {
+        plan.active_us += getAlsTime(atime);
+    }
+    if( !plan.active_us || max_latency_us < plan.active_us ) {
+        return false;
+    }
+
+    /* Longest period meeting both limits */
+    uint32_t target = interval_us;
+    if( max_latency_us - plan.active_us < target ) {
+        target = max_latency_us - plan.active_us;
+    }
+    uint32_t wait = target > plan.active_us ? target - plan.active_us : 0;
+    uint32_t steps = wait / WAIT_STEP_TIME;
+
+    plan.wlong = false;
+    plan.wait = (steps > 0);
+    if( steps > 256 ) {
+        plan.wlong = true;
+        steps = wait / (WAIT_STEP_TIME * WLONG_FACTOR);
+        if( steps > 256 ) {
+            steps = 256;
+        }
+    }
+    if( !plan.wait ) {
+        steps = 1;
+    }
+    plan.wtime = 256 - steps;
+    plan.period_us = plan.active_us;
+    if( plan.wait ) {
+        plan.period_us += steps * WAIT_STEP_TIME * (plan.wlong ? WLONG_FACTOR : 1);
+    }
+    plan.sai = sleep_after_int;
+    plan.led_ua = getLEDCurrent(plan.period_us);
+
+    return true;
+}
+
+/**
+ * @brief Plans with planPower() and writes the result to the device
+ *
+ * @param[in] interval_us longest time between two samples
+ * @param[in] max_latency_us longest time from an event to its sample
+ * @param[out] plan register values and the resulting timing
+ * @param[in] sleep_after_int true to set SAI
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setPowerSchedule(uint32_t interval_us, uint32_t max_latency_us,
+                                power_plan_type &plan, bool sleep_after_int)
+{
+    if( !planPower(interval_us, max_latency_us, plan, sleep_after_int) ) {
+        return false;
+    }
+    if( !wireWriteDataByte(APDS9960_WTIME, plan.wtime) ) {
+        return false;
+    }
+    if( !setWaitLong(plan.wlong) ) {
+        return false;
+    }
+    if( !setSleepAfterInt(plan.sai) ) {
+        return false;
+    }
+    if( !setMode(WAIT, plan.wait) ) {
+        return false;
+    }
+
+    return true;
+}
+
+#if APDS9960_STREAMING
+/*******************************************************************************
+ * Streaming
+ ******************************************************************************/
+
+/* STATUS..PDATA in one block */
+#define STREAM_BURST_LEN        (APDS9960_PDATA - APDS9960_STATUS + 1)
+
+/**
+ * @brief Starts capturing samples into a caller buffer
+ *
+ * Enables the engines for the requested channels and sets the cycle so
+ * that proximity and ALS results arrive at rate_hz (see
+ * setPowerSchedule()). The ALS integration time is left as configured,
+ * the rate is lower when the engines need longer than 1/rate_hz.
+ * serviceStreaming() then moves each new result into buf without
+ * blocking: PVALID/AVALID are polled four times per cycle and every
+ * gesture FIFO dataset becomes a record of its own. readGesture() must
+ * not be used while gestures are streamed.
+ *
+ * @param[in] channels STREAM_PROXIMITY, STREAM_COLOR and/or STREAM_GESTURE
+ * @param[in] rate_hz proximity/ALS results per second
+ * @param[in] buf records, kept by the driver until stopStreaming()
+ * @param[in] size number of records in buf
+ * @return True if streaming started. False otherwise.
+ */
+bool APDS9960::startStreaming(uint8_t channels, uint16_t rate_hz,
+                              stream_record_type *buf, uint16_t size)
+{
+    power_plan_type plan;
+    cycle_timing_type timing;
+    uint8_t supported = 0;
+
+#if APDS9960_PROXIMITY
+    supported |= STREAM_PROXIMITY;
+#endif
+#if APDS9960_ALS
+    supported |= STREAM_COLOR;
+#endif
+#if APDS9960_GESTURE
+    supported |= STREAM_GESTURE;
+#endif
+    if( !buf || !size || !rate_hz || !channels || (channels & ~supported) ) {
+        return false;
+    }
+    stream_channels_ = 0;
+
+    /* Gesture first, it takes over WTIME which the schedule sets */
+#if APDS9960_GESTURE
+    if( (channels & STREAM_GESTURE) && !enableGestureSensor(false) ) {
+        return false;
+    }
+#endif
+#if APDS9960_ALS
+    if( (channels & STREAM_COLOR) && !enableLightSensor(false) ) {
+        return false;
+    }
+#endif
+#if APDS9960_PROXIMITY
+    if( (channels & STREAM_PROXIMITY) && !enableProximitySensor(false) ) {
+        return false;
+    }
+#endif
+    if( channels & (STREAM_PROXIMITY | STREAM_COLOR) ) {
+        /* No latency limit, the cycle cannot be shorter than the engines */
+        if( !setPowerSchedule(1000000UL / rate_hz, 0xFFFFFFFFUL, plan) ) {
+            return false;
+        }
+    }
+    if( !getCycleTiming(timing) ) {
+        return false;
+    }
+
+    /* Poll four times per cycle, at the FIFO read pace with gestures */
+    stream_poll_us_ = FIFO_PAUSE_TIME * 1000UL;
+    if( (channels & (STREAM_PROXIMITY | STREAM_COLOR)) &&
+        (timing.period_us / 4 < stream_poll_us_ || !(channels & STREAM_GESTURE)) ) {
+        stream_poll_us_ = timing.period_us / 4;
+    }
+    stream_gesture_us_ = timing.gesture_us;
+
+    stream_buf_ = buf;
+    stream_size_ = size;
+    stream_head_ = 0;
+    stream_count_ = 0;
+    stream_dropped_ = 0;
+    stream_next_us_ = micros();
+    stream_last_us_ = stream_next_us_;
+    stream_wraps_ = 0;
+    stream_channels_ = channels;
+
+    return true;
+}
+
+/**
+ * @brief Stops capturing and turns off the engines that were streamed
+ *
+ * Records still in the buffer can be read with readStream().
+ *
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::stopStreaming()
+{
+    uint8_t channels = stream_channels_;
+    (void)channels;     // unused without the sensor features
+
+    stream_channels_ = 0;
+#if APDS9960_GESTURE
+    if( (channels & STREAM_GESTURE) && !disableGestureSensor() ) {
+        return false;
+    }
+#endif
+#if APDS9960_ALS
+    if( (channels & STREAM_COLOR) && !disableLightSensor() ) {
+        return false;
+    }
+#endif
+#if APDS9960_PROXIMITY
+    if( (channels & STREAM_PROXIMITY) && !disableProximitySensor() ) {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Extends micros() to 64 bits
+ *
+ * Needs a call at least once per micros() wrap (71 minutes on AVR),
+ * which every serviceStreaming() poll provides.
+ */
+uint64_t APDS9960::streamTime(unsigned long us)
+{
+    if( us < stream_last_us_ ) {
+        stream_wraps_++;
+    }
+    stream_last_us_ = us;
+
+    if( sizeof(unsigned long) >= sizeof(uint64_t) ) {
+        return us;
+    }
+    return ((uint64_t)stream_wraps_ << 32) | us;
+}
+
+/**
+ * @brief Appends a record, dropped if the buffer is full
+ *
+ * @return 1 if the record was stored, 0 if it was dropped.
+ */
+uint8_t APDS9960::pushStream(uint8_t channel, const uint8_t *data, uint8_t len,
+                             uint64_t time_us)
+{
+    if( stream_count_ >= stream_size_ ) {
+        stream_dropped_++;
+        return 0;
+    }
+
+    uint16_t i = stream_head_ + stream_count_;
+    if( i >= stream_size_ ) {
+        i -= stream_size_;
+    }
+    stream_record_type &record = stream_buf_[i];
+    record.time_us = time_us;
+    record.channel = channel;
+    memset(record.data, 0, sizeof(record.data));
+    memcpy(record.data, data, len);
+    stream_count_++;
+
+    return 1;
+}
+
+/**
+ * @brief Moves new results into the stream buffer, call from loop()
+ *
+ * Does nothing until the next poll is due. Proximity and color come
+ * from one STATUS..PDATA block read, recorded only when PVALID/AVALID
+ * say they are new. Gesture datasets are read in FIFO_READ_RECORDS
+ * blocks and stamped back from the read time by the dataset period.
+ *
+ * @return Number of records added.
+ */
+uint16_t APDS9960::serviceStreaming()
+{
+    unsigned long now = micros();
+    uint16_t added = 0;
+
+    if( !stream_channels_ || (long)(stream_next_us_ - now) > 0 ) {
+        return 0;
+    }
+    stream_next_us_ = now + stream_poll_us_;
+    uint64_t time = streamTime(now);
+
+    if( stream_channels_ & (STREAM_PROXIMITY | STREAM_COLOR) ) {
+        uint8_t burst[STREAM_BURST_LEN];
+        if( wireReadDataBlock(APDS9960_STATUS, burst, STREAM_BURST_LEN) !=
+            STREAM_BURST_LEN ) {
+            return added;
+        }
+        if( (stream_channels_ & STREAM_COLOR) && (burst[0] & APDS9960_AVALID) ) {
+            added += pushStream(STREAM_COLOR, &burst[1], 8, time);
+        }
+        if( (stream_channels_ & STREAM_PROXIMITY) && (burst[0] & APDS9960_PVALID) ) {
+            added += pushStream(STREAM_PROXIMITY, &burst[STREAM_BURST_LEN - 1], 1, time);
+        }
+    }
+
+#if APDS9960_GESTURE
+    if( stream_channels_ & STREAM_GESTURE ) {
+        uint8_t level;
+        if( !wireReadDataByte(APDS9960_GFLVL, level) ) {
+            return added;
+        }
+        if( level > 32 ) {
+            level = 32;
+        }
+
+        /* The last dataset in the FIFO was made just now */
+        uint8_t left = level;
+        while( left ) {
+            uint8_t n = left < FIFO_READ_RECORDS ? left : FIFO_READ_RECORDS;
+            gesture_record_t *records = fifo_buf_[0];
+            if( wireReadDataBlock(APDS9960_GFIFO_U, (uint8_t *)records, n * 4) != n * 4 ) {
+                return added;
+            }
+            for( uint8_t r = 0; r < n; r++ ) {
+                left--;
+                added += pushStream(STREAM_GESTURE, (const uint8_t *)&records[r], 4,
+                                    time - (uint64_t)left * stream_gesture_us_);
+            }
+        }
+    }
+#endif
+
+    return added;
+}
+
+/**
+ * @brief Number of records waiting in the stream buffer
+ */
+uint16_t APDS9960::streamAvailable()
+{
+    return stream_count_;
+}
+
+/**
+ * @brief Takes the oldest record from the stream buffer
+ *
+ * @param[out] record the record
+ * @return True if a record was read. False if the buffer is empty.
+ */
+bool APDS9960::readStream(stream_record_type &record)
+{
+    if( !stream_count_ ) {
+        return false;
+    }
+    record = stream_buf_[stream_head_];
+    if( ++stream_head_ >= stream_size_ ) {
+        stream_head_ = 0;
+    }
+    stream_count_--;
+
+    return true;
+}
+
+/**
+ * @brief Records dropped because the buffer was full
+ *
+ * @return Number of records lost since startStreaming().
+ */
+uint16_t APDS9960::getStreamDropped()
+{
+    return stream_dropped_;
+}
+#endif
+
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+/*******************************************************************************
+ * Gesture capture
+ ******************************************************************************/
+
+/* Payload bytes of a dataset in each class, CAPTURE_ZERO..CAPTURE_BYTE */
+static const uint8_t capture_bytes[4] = { 0, 1, 2, 4 };
+
+/**
+ * @brief Starts keeping the FIFO data of every gesture readGesture() reads
+ *
+ * Each gesture is stored as the difference of each dataset to the one
+ * before it, in the smallest class that fits (see CAPTURE_*), with the
+ * time since the previous gesture and the motion decoded. A dataset
+ * takes 1.25 to 2.25 bytes instead of 4 unless the counts jump. A
+ * gesture that does not fit in what is left is counted as dropped and
+ * later, shorter ones are still stored. init() stops capturing.
+ *
+ * @param[in] buf capture buffer, kept by the driver until startCapture()
+ *  is called again
+ * @param[in] size bytes in buf
+ * @return True if capture started. False otherwise.
+ */
+bool APDS9960::startCapture(uint8_t *buf, uint16_t size)
+{
+    if( !buf || size < 16 ) {
+        return false;
+    }
+
+    capture_open_ = false;
+    capture_buf_ = buf;
+    capture_size_ = size;
+    capture_len_ = 0;
+    capture_gestures_ = 0;
+    capture_dropped_ = 0;
+    capture_records_ = 0;
+    capture_ms_ = millis();
+    capture_on_ = true;
+
+    return true;
+}
+
+/**
+ * @brief Stops capturing, the gestures stored so far can still be exported
+ */
+void APDS9960::stopCapture()
+{
+    captureAbort();
+    capture_on_ = false;
+}
+
+/**
+ * @brief Reads the capture counters
+ *
+ * @param[out] info bytes used, gestures stored and dropped, datasets stored
+ */
+void APDS9960::getCaptureInfo(capture_info_type &info)
+{
+    info.bytes = capture_open_ ? capture_start_ : capture_len_;
+    info.gestures = capture_gestures_;
+    info.dropped = capture_dropped_;
+    info.records = capture_records_;
+}
+
+/**
+ * @brief Writes the stored gestures as hex text lines
+ *
+ * Output is one "C:<bytes> <gestures> <dropped>" header line followed by
+ * "C:" lines of 32 hex digits. Feed the captured text to the host
+ * decoder. A gesture still being read is left out.
+ *
+ * @param[in] out stream to write the capture to
+ */
+void APDS9960::exportCapture(Stream &out)
+{
+    capture_info_type info;
+    getCaptureInfo(info);
+
+    out.print("C:"); out.print(info.bytes);
+    out.write(' '); out.print(info.gestures);
+    out.write(' '); out.println(info.dropped);
+    for (uint16_t i = 0; i < info.bytes; i++)
+    {
+        if ( (i & 15)==0 ) out.print("C:");
+        if ( capture_buf_[i]<0x10 ) out.write('0');
+        out.print(capture_buf_[i], HEX);
+        if ( (i & 15)==15 || i+1==info.bytes ) out.write('\n');
+    }
+}
+
+/**
+ * @brief Appends one byte to the capture buffer
+ *
+ * @return True if it fitted. False otherwise.
+ */
+bool APDS9960::captureWrite(uint8_t val)
+{
+    if( capture_len_ >= capture_size_ ) {
+        return false;
+    }
+    capture_buf_[capture_len_++] = val;
+    return true;
+}
+
+/**
+ * @brief Opens a gesture, called with its first FIFO records
+ */
+void APDS9960::captureStart()
+{
+    if( !capture_on_ ) {
+        return;
+    }
+
+    capture_open_ = true;
+    capture_start_ = capture_len_;
+    capture_open_ms_ = millis();
+    capture_count_ = 0;
+    capture_prev_.u_data = 0;
+    capture_prev_.d_data = 0;
+    capture_prev_.l_data = 0;
+    capture_prev_.r_data = 0;
+
+    /* Time since the last gesture, 7 bits per byte, low bits first */
+    uint32_t delta = capture_open_ms_ - capture_ms_;
+    bool fits = true;
+    while( fits && delta >= 0x80 ) {
+        fits = captureWrite((delta & 0x7F) | 0x80);
+        delta >>= 7;
+    }
+    /* Count and motion are filled in by captureEnd() */
+    capture_head_ = capture_len_ + 1;
+    if( !fits || !captureWrite(delta) || !captureWrite(0) || !captureWrite(0) ) {
+        captureAbort();
+        capture_dropped_++;
+    }
+}
+
+/**
+ * @brief Appends one FIFO dataset to the open gesture
+ *
+ * @param[in] record U, D, L, R counts
+ */
+void APDS9960::captureRecord(const gesture_record_t &record)
+{
+    int8_t delta[4];
+    uint8_t cls = CAPTURE_ZERO;
+
+    if( !capture_open_ ) {
+        return;
+    }
+
+    delta[0] = (int8_t)(uint8_t)(record.u_data - capture_prev_.u_data);
+    delta[1] = (int8_t)(uint8_t)(record.d_data - capture_prev_.d_data);
+    delta[2] = (int8_t)(uint8_t)(record.l_data - capture_prev_.l_data);
+    delta[3] = (int8_t)(uint8_t)(record.r_data - capture_prev_.r_data);
+    for( uint8_t i = 0; i < 4; i++ ) {
+        uint8_t need = (delta[i] < -8 || delta[i] > 7) ? CAPTURE_BYTE :
+                       (delta[i] < -2 || delta[i] > 1) ? CAPTURE_NIBBLE :
+                       (delta[i] != 0) ? CAPTURE_CRUMB : CAPTURE_ZERO;
+        if( need > cls ) {
+            cls = need;
+        }
+    }
+
+    /* A class byte starts every group of four */
+    uint8_t slot = capture_count_ & 3;
+    if( capture_len_ + capture_bytes[cls] + (slot ? 0 : 1) > capture_size_ ) {
+        captureAbort();
+        capture_dropped_++;
+        return;
+    }
+    if( !slot ) {
+        capture_tag_ = capture_len_;
+        captureWrite(0);
+    }
+    capture_buf_[capture_tag_] |= cls << (6 - 2 * slot);
+
+    switch( cls ) {
+        case CAPTURE_CRUMB:
+            captureWrite(((delta[0] & 3) << 6) | ((delta[1] & 3) << 4) |
+                         ((delta[2] & 3) << 2) | (delta[3] & 3));
+            break;
+        case CAPTURE_NIBBLE:
+            captureWrite(((delta[0] & 0x0F) << 4) | (delta[1] & 0x0F));
+            captureWrite(((delta[2] & 0x0F) << 4) | (delta[3] & 0x0F));
+            break;
+        case CAPTURE_BYTE:
+            for( uint8_t i = 0; i < 4; i++ ) {
+                captureWrite((uint8_t)delta[i]);
+            }
+            break;
+    }
+    capture_count_++;
+    capture_prev_ = record;
+}
+
+/**
+ * @brief Closes the open gesture with the motion decoded from it
+ *
+ * @param[in] motion FLAG_* bits returned by readGesture()
+ */
+void APDS9960::captureEnd(uint8_t motion)
+{
+    if( !capture_open_ ) {
+        return;
+    }
+    capture_buf_[capture_head_] = capture_count_;
+    capture_buf_[capture_head_ + 1] = motion;
+    capture_open_ = false;
+    capture_gestures_++;
+    capture_records_ += capture_count_;
+    capture_ms_ = capture_open_ms_;
+}
+
+/**
+ * @brief Drops the open gesture, if any
+ */
+void APDS9960::captureAbort()
+{
+    if( capture_open_ ) {
+        capture_len_ = capture_start_;
+        capture_open_ = false;
+    }
+}
+#endif
+
+/*******************************************************************************
+ * High-level gesture controls
+ ******************************************************************************/
+
+#if APDS9960_GESTURE
+/**
+ * @brief Resets all the parameters in the gesture data member
+ */
+void APDS9960::resetGestureParameters()
+{
+    gesture_data_.delta_ud = 0;
+    gesture_data_.delta_lr = 0;
+    gesture_data_.sum_udlr  = 0;
+    gesture_data_.prev_udlr  = 0;
+    gesture_data_.delta_udlr = 0;
+//    gesture_data_.delta_ud_var = 0;
+//    gesture_data_.delta_lr_var = 0;
+    gesture_data_.dir_up    = 0;
+    gesture_data_.dir_down  = 0;
+    gesture_data_.dir_left  = 0;
+    gesture_data_.dir_right = 0;
+    gesture_data_.current_records = 0;
     gesture_data_.total_records = 0;
 
 //    gesture_near_count_ = 0;
@@ -666,14 +3110,22 @@ void APDS9960::resetGestureParameters()
 
 //    gesture_state_ = 0;
     gesture_motion_ = 0;
+    gesture_active_ = false;
+    fifo_fill_ = 0;
+    fifo_ready_ = 0;
+#if APDS9960_CAPTURE
+    // a gesture cut short is not kept
+    captureAbort();
+#endif
 }
 
 /**
  * @brief Processes the raw gesture data to determine swipe direction
  *
+ * @param[in] records the gesture_data_.current_records datasets read last
  * @return True if near or far state seen. False otherwise.
  */
-bool APDS9960::processGestureData()
+bool APDS9960::processGestureData(const gesture_record_t *records)
 {
     /* Check to make sure our data isn't out of bounds */
 	// the cummulated value should be limited in order to avoid overflow
@@ -681,7 +3133,7 @@ bool APDS9960::processGestureData()
 
 	for(uint8_t i = 0; i < gesture_data_.current_records; i++ )
 	{
-		int16_t delta_ud = (fifo_buf[i].u_data - fifo_buf[i].d_data);
+		int16_t delta_ud = (records[i].u_data - records[i].d_data);
 		//gesture_data_.delta_ud_var += abs(gesture_data_.delta_ud - delta_ud);
 		gesture_data_.delta_ud = delta_ud;
 		if ( delta_ud>=DELTA_MIN )
@@ -699,7 +3151,7 @@ bool APDS9960::processGestureData()
 				gesture_motion_ |= FLAG_UP;
 		}
 
-		int16_t delta_lr = (fifo_buf[i].l_data - fifo_buf[i].r_data);
+		int16_t delta_lr = (records[i].l_data - records[i].r_data);
 		//gesture_data_.delta_lr_var += abs(gesture_data_.delta_lr - delta_lr);
 		gesture_data_.delta_lr = delta_lr;
 		if ( delta_lr>=DELTA_MIN )
@@ -720,7 +3172,7 @@ bool APDS9960::processGestureData()
 		// discard very first sample
 		if ( i==0 && gesture_data_.total_records==gesture_data_.current_records ) continue;
 		// current global value
-		uint16_t crt_udlr = (fifo_buf[i].u_data + fifo_buf[i].d_data + fifo_buf[i].l_data + fifo_buf[i].r_data)/4;
+		uint16_t crt_udlr = (records[i].u_data + records[i].d_data + records[i].l_data + records[i].r_data)/4;
 		if ( gesture_data_.sum_udlr==0 ) // first value
 			gesture_data_.delta_udlr = 0;
 		else
@@ -730,101 +3182,440 @@ bool APDS9960::processGestureData()
 		gesture_data_.prev_udlr = crt_udlr;
 	}
 
-#if DEBUG
-    Serial.print("Total records: "); Serial.println(gesture_data_.total_records);
-    Serial.print("Diff counts: U: "); Serial.print(gesture_data_.dir_up);
-    Serial.print(", D: "); Serial.print(gesture_data_.dir_down);
-    Serial.print(", L: "); Serial.print(gesture_data_.dir_left);
-    Serial.print(", R: "); Serial.println(gesture_data_.dir_right);
-	Serial.print("Cumulative count: "); Serial.print(gesture_data_.sum_udlr);
-	Serial.print(", delta: "); Serial.println(gesture_data_.delta_udlr);
-//	Serial.print("Deltas: UD: "); Serial.print(gesture_data_.delta_ud);
-//	Serial.print(", LR: "); Serial.println(gesture_data_.delta_lr);
-//  Serial.print("Deltas vars: UD: "); Serial.print(gesture_data_.delta_ud_var);
-//  Serial.print(", LR: "); Serial.println(gesture_data_.delta_lr_var);
-//	Serial.print("Sign changes UD: "); Serial.print(gesture_data_.sign_change_ud);
-//	Serial.print(", LR: "); Serial.println(gesture_data_.sign_change_lr);
+    TRACE(TRACE_DIR_UD, 0, gesture_data_.dir_up | ((uint32_t)gesture_data_.dir_down<<16));
+    TRACE(TRACE_DIR_LR, 0, gesture_data_.dir_left | ((uint32_t)gesture_data_.dir_right<<16));
+    TRACE(TRACE_SUM, gesture_data_.total_records, gesture_data_.sum_udlr);
+
+    return false;
+}
+
+/**
+ * @brief Determines swipe direction or near/far state
+ *
+ * @return True if any event detected. False otherwise.
+ */
+void APDS9960::decodeGesture()
+{
+    // Determine NEAR/FAR position
+	if ( !gesture_motion_&(FLAG_UP|FLAG_DOWN|FLAG_RIGHT|FLAG_LEFT) &&
+		gesture_data_.total_records>(MAX_RECORDS/2) ) // no horizontal motion detected
+	{
+		uint32_t global_count = gesture_data_.sum_udlr/(gesture_data_.total_records-1);///(4*MAX_RECORDS);
+		if ( global_count < 180 )
+			gesture_motion_ |= FLAG_FAR;
+		else
+			gesture_motion_ |= FLAG_NEAR;
+
+		if ( gesture_data_.delta_udlr < -80 )
+			gesture_motion_ |= FLAG_APPROACH;
+		else if ( gesture_data_.delta_udlr > 80 )
+			gesture_motion_ |= FLAG_DEPART;
+	}
+
+    TRACE(TRACE_MOTION, gesture_motion_, (uint16_t)gesture_data_.delta_udlr);
+}
+#endif
+
+/*******************************************************************************
+ * I2C transport
+ ******************************************************************************/
+
+/**
+ * @brief Sets the pins used to clock a stuck bus free
+ *
+ * These are the SDA and SCL pins of the Wire controller. Until they are
+ * set, a failed transaction is only counted and recoverBus() does nothing.
+ * A timed-out transaction or SDA read low after a failure runs recoverBus().
+ *
+ * @param[in] sda SDA pin number
+ * @param[in] scl SCL pin number
+ */
+void APDS9960::setBusRecoveryPins(uint8_t sda, uint8_t scl)
+{
+    recovery_sda_ = sda;
+    recovery_scl_ = scl;
+}
+
+/**
+ * @brief Sets the I2C clock and keeps it across Wire restarts
+ *
+ * Wire.begin() returns many cores to 100 kHz. init() and recoverBus()
+ * restart Wire and apply this clock again, which Wire.setClock() called
+ * directly would not survive.
+ *
+ * @param[in] hz bus clock, e.g. 400000 for enableProximityHighRate()
+ */
+void APDS9960::setBusClock(uint32_t hz)
+{
+    bus_clock_ = hz;
+    Wire.setClock(hz);
+}
+
+/**
+ * @brief Releases a slave holding SDA low and restarts the Wire controller
+ *
+ * A slave interrupted mid-byte keeps driving SDA until it has clocked out
+ * the rest of the byte. Up to I2C_RECOVERY_CLOCKS pulses are sent on SCL
+ * until SDA is released, followed by a STOP. Pins are driven open-drain
+ * by switching between OUTPUT LOW and INPUT_PULLUP. Takes about 100 us.
+ *
+ * @return True if SDA is high after the sequence. False otherwise.
+ */
+bool APDS9960::recoverBus()
+{
+    if( recovery_sda_ == I2C_NO_PIN || recovery_scl_ == I2C_NO_PIN ) {
+        return false;
+    }
+
+#ifdef WIRE_HAS_END
+    Wire.end();
+#endif
+    pinMode(recovery_sda_, INPUT_PULLUP);
+    pinMode(recovery_scl_, INPUT_PULLUP);
+    delayMicroseconds(5);
+
+    /* Clock out the remainder of the byte the slave is sending */
+    for( uint8_t i = 0; i < I2C_RECOVERY_CLOCKS; i++ ) {
+        if( digitalRead(recovery_sda_) == HIGH ) {
+            break;
+        }
+        digitalWrite(recovery_scl_, LOW);
+        pinMode(recovery_scl_, OUTPUT);
+        delayMicroseconds(5);
+        pinMode(recovery_scl_, INPUT_PULLUP);
+        delayMicroseconds(5);
+    }
+
+    /* STOP: SDA rises while SCL is high */
+    digitalWrite(recovery_sda_, LOW);
+    pinMode(recovery_sda_, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(recovery_sda_, INPUT_PULLUP);
+    delayMicroseconds(5);
+
+    bool released = (digitalRead(recovery_sda_) == HIGH);
+    I2C_STAT(recoveries);
+    wireBegin(bus_clock_);
+
+    return released;
+}
+
+#if APDS9960_DIAGNOSTICS
+/**
+ * @brief Copies the I2C failure counters
+ *
+ * @param[out] stats counters since init or the last clearI2CStats()
+ */
+void APDS9960::getI2CStats(i2c_stats_type &stats)
+{
+    stats = i2c_stats_;
+}
+
+/**
+ * @brief Resets the I2C failure counters
+ */
+void APDS9960::clearI2CStats()
+{
+    memset(&i2c_stats_, 0, sizeof(i2c_stats_));
+}
 #endif
 
+/*******************************************************************************
+ * Asynchronous transport
+ ******************************************************************************/
+
+/**
+ * @brief Runs reads in the background through an application transport
+ *
+ * Arduino's Wire has no background reads. Where the board has interrupt
+ * or DMA driven I2C on the same bus, its driver can be plugged in here:
+ * transport->read() starts a register read and returns at once,
+ * transport->busy() tells when the bus is free again. Without a
+ * transport, the default, every transfer runs synchronously through Wire.
+ * A read holding the bus longer than I2C_TIMEOUT is given up and the bus
+ * goes through wireFailed(); the transport must drop it by then.
+ *
+ * @param[in] transport background reads, NULL for synchronous Wire only.
+ *  Must stay valid while set.
+ */
+void APDS9960::setAsyncTransport(const i2c_async_type *transport)
+{
+    while( xfer_head_ ) {
+        pollTransfers();
+    }
+    async_ = transport;
+}
+
+/**
+ * @brief Queues an I2C transfer, starting it if the bus is free
+ *
+ * Transfers run in submission order. A read goes to the transport set
+ * with setAsyncTransport(), if any, and this returns while it is on the
+ * bus; otherwise the transfer is done before returning. When it ends,
+ * xfer.result holds the byte count, -1 on error, and xfer.done (if set)
+ * is called from submitTransfer(), isTransferDone() or waitTransfer(),
+ * never from an interrupt. A failed background read is repeated synchronously with the
+ * usual retries; one given up after I2C_TIMEOUT ends with -1. xfer and its
+ * buffer must stay valid until then.
+ *
+ * @param[in,out] xfer register, buffer, length and direction
+ * @return True if the transfer was queued. False if len is 0.
+ */
+bool APDS9960::submitTransfer(i2c_transfer_type &xfer)
+{
+    if( !xfer.len ) {
+        return false;
+    }
+
+    xfer.result = I2C_PENDING;
+    xfer.next = NULL;
+    if( xfer_tail_ ) {
+        xfer_tail_->next = &xfer;
+    } else {
+        xfer_head_ = &xfer;
+    }
+    xfer_tail_ = &xfer;
+    pollTransfers();
+
+    return true;
+}
+
+/**
+ * @brief Advances the transfer queue and tells if a transfer has ended
+ *
+ * @param[in] xfer a submitted transfer
+ * @return True once xfer.result is valid. False while it is pending.
+ */
+bool APDS9960::isTransferDone(i2c_transfer_type &xfer)
+{
+    pollTransfers();
+    return xfer.result != I2C_PENDING;
+}
+
+/**
+ * @brief Waits for a submitted transfer and the ones queued before it
+ *
+ * Each background read ends within I2C_TIMEOUT: one still on the bus by
+ * then ends with -1, and so does xfer if it was that read. yield() runs
+ * while waiting, so cores with background tasks keep serving them.
+ *
+ * @param[in] xfer a submitted transfer
+ * @return Number of bytes transferred, -1 on error.
+ */
+int APDS9960::waitTransfer(i2c_transfer_type &xfer)
+{
+    while( !isTransferDone(xfer) ) {
+        yield();
+    }
+    return xfer.result;
+}
+
+/**
+ * @brief Completes the transfer on the bus and runs the queued ones
+ *
+ * Returns when the queue is empty or a read is on the bus.
+ */
+void APDS9960::pollTransfers()
+{
+    while( xfer_head_ ) {
+        i2c_transfer_type *xfer = xfer_head_;
+
+        if( xfer_async_ ) {
+            if( asyncBusy() ) {
+                return;
+            }
+            xfer_async_ = false;
+            /* transferDone() has run before busy() turned false and nothing
+               writes xfer_count_ until the next read starts, so reading an
+               int that is not atomic (2 bytes on AVR) cannot tear */
+            int count = xfer_expired_ ? -1 : xfer_count_;
+            if( !xfer_expired_ && count < 0 ) {
+                I2C_STAT(retries);
+                count = wireReadDataBlock(xfer->reg, xfer->buf, xfer->len);
+            }
+            finishTransfer(count);
+            continue;
+        }
+        if( xfer->read && async_ ) {
+            xfer_count_ = I2C_PENDING;
+            xfer_expired_ = false;
+            if( async_->read(async_->context, APDS9960_I2C_ADDR, xfer->reg,
+                             xfer->buf, xfer->len, transferDone, this) ) {
+                xfer_async_ = true;
+                xfer_start_ = micros();
+                return;
+            }
+        }
+        if( xfer->read ) {
+            finishTransfer(wireReadDataBlock(xfer->reg, xfer->buf, xfer->len));
+        } else if( wireWriteDataBlock(xfer->reg, xfer->buf, xfer->len) ) {
+            finishTransfer(xfer->len);
+        } else {
+            finishTransfer(-1);
+        }
+    }
+}
+
+/**
+ * @brief Takes the head transfer off the queue and reports its result
+ *
+ * @param[in] result bytes transferred, -1 on error
+ */
+void APDS9960::finishTransfer(int result)
+{
+    i2c_transfer_type *xfer = xfer_head_;
+
+    xfer_head_ = xfer->next;
+    if( !xfer_head_ ) {
+        xfer_tail_ = NULL;
+    }
+    xfer->result = result;
+    if( xfer->done ) {
+        xfer->done(xfer->context, result);
+    }
+}
+
+/**
+ * @brief Tells if the background read still holds the bus
+ *
+ * A read not done I2C_TIMEOUT after it started is given up: it counts as
+ * a timeout, the bus goes through wireFailed() and the transfer ends with
+ * -1 when the queue is next polled.
+ *
+ * @return True while the read holds the bus within its time.
+ */
+bool APDS9960::asyncBusy()
+{
+    if( !xfer_async_ || xfer_expired_ || !async_->busy(async_->context) ) {
+        return false;
+    }
+    if( micros() - xfer_start_ <= I2C_TIMEOUT ) {
+        return true;
+    }
+
+    xfer_expired_ = true;
+    I2C_STAT(timeouts);
+    wire_timed_out_ = true;
+    wireFailed();
     return false;
 }
 
 /**
- * @brief Determines swipe direction or near/far state
+ * @brief Completion of a background read, may run in an interrupt
+ *
+ * @param[in] context the driver instance
+ * @param[in] count bytes read, -1 on failure
+ */
+void APDS9960::transferDone(void *context, int count)
+{
+    ((APDS9960 *)context)->xfer_count_ = count;
+}
+
+#if DEBUG
+/*******************************************************************************
+ * Debug trace
+ ******************************************************************************/
+
+/**
+ * @brief Dumps the trace buffer, oldest event first, as hex text lines
+ *
+ * Output is one "T:<count>" header line, count being all events written
+ * since clearTrace(), followed by one "T:" line of 16 hex digits per
+ * event kept. Feed the captured text to the host decoder.
+ *
+ * @param[in] out stream to write the trace to
+ */
+void APDS9960::dumpTrace(Stream &out)
+{
+    uint16_t first = (trace_next_ - trace_fill_) & (TRACE_SIZE-1);
+
+    out.print("T:"); out.println(trace_total_);
+    for (uint16_t n = 0; n < trace_fill_; n++)
+    {
+        const uint8_t *ev = (const uint8_t*)&trace_buf_[(first + n) & (TRACE_SIZE-1)];
+        out.print("T:");
+        for (uint8_t i = 0; i < sizeof(trace_event_t); i++)
+        {
+            if ( ev[i]<0x10 ) out.write('0');
+            out.print(ev[i], HEX);
+        }
+        out.write('\n');
+    }
+}
+
+/**
+ * @brief Discards all events in the trace buffer
+ */
+void APDS9960::clearTrace()
+{
+    trace_next_ = 0;
+    trace_fill_ = 0;
+    trace_total_ = 0;
+}
+#endif
+
+/*******************************************************************************
+ * Register fields
+ ******************************************************************************/
+
+/**
+ * @brief Reads a register bit field, from the shadow when it is valid
+ *
+ * Called through getField<F>() with a field descriptor (apds9960_field).
+ *
+ * @param[in] reg register address
+ * @param[in] mask field bits in the register
+ * @param[in] shift position of the lowest field bit
+ * @return Field value. 0xFF on error.
+ */
+uint8_t APDS9960::readField(uint8_t reg, uint8_t mask, uint8_t shift)
+{
+    uint8_t val;
+
+    /* Read value from the field's register */
+    if( !readShadow(reg, val) ) {
+        return ERROR;
+    }
+
+    /* Shift and mask out the field bits */
+    return (val & mask) >> shift;
+}
+
+/**
+ * @brief Writes a register bit field, keeping the other bits
  *
- * @return True if any event detected. False otherwise.
+ * Called through setField<F>(). The register is taken from the shadow
+ * when it is valid. Fields covering the whole register are written
+ * without reading it.
+ *
+ * @param[in] reg register address
+ * @param[in] mask field bits in the register
+ * @param[in] shift position of the lowest field bit
+ * @param[in] val field value, bits above the field width are ignored
+ * @return True if operation successful. False otherwise.
  */
-void APDS9960::decodeGesture()
+bool APDS9960::writeField(uint8_t reg, uint8_t mask, uint8_t shift, uint8_t val)
 {
-    // Determine NEAR/FAR position
-	if ( !gesture_motion_&(FLAG_UP|FLAG_DOWN|FLAG_RIGHT|FLAG_LEFT) &&
-		gesture_data_.total_records>(MAX_RECORDS/2) ) // no horizontal motion detected
-	{
-		uint32_t global_count = gesture_data_.sum_udlr/(gesture_data_.total_records-1);///(4*MAX_RECORDS);
-		if ( global_count < 180 )
-			gesture_motion_ |= FLAG_FAR;
-		else
-			gesture_motion_ |= FLAG_NEAR;
+    uint8_t old = 0;
 
-		if ( gesture_data_.delta_udlr < -80 )
-			gesture_motion_ |= FLAG_APPROACH;
-		else if ( gesture_data_.delta_udlr > 80 )
-			gesture_motion_ |= FLAG_DEPART;
-	}
+    /* Read value from the field's register */
+    if( mask != 0xFF && !readShadow(reg, old) ) {
+        return false;
+    }
 
-#if DEBUG
-    Serial.println("-----------------------------------------------------------------");
-	Serial.print("Motion: 0x"); Serial.print(gesture_motion_, HEX);
-	Serial.print(" >>>>>");
-	if ( (gesture_motion_&FLAG_UP) ) Serial.print(" UP");
-	else if ( (gesture_motion_&FLAG_DOWN) ) Serial.print(" DOWN");
-	else Serial.print(" ---");
-
-	if ( gesture_motion_&FLAG_LEFT ) Serial.print(" LEFT");
-	else if ( gesture_motion_&FLAG_RIGHT ) Serial.print(" RIGHT");
-	else Serial.print(" ---");
-
-	if ( gesture_motion_&FLAG_DEPART ) Serial.print(" DEPARTING");
-	else if ( gesture_motion_&FLAG_APPROACH ) Serial.print(" APPROACHING");
-	else Serial.print(" ---");
-
-	if ( gesture_motion_&FLAG_FAR ) Serial.print(" FAR");
-	else if ( gesture_motion_&FLAG_NEAR ) Serial.print(" NEAR");
-	else Serial.print(" ---");
-	Serial.write('\n'); // NL
-	// print the records
-	for (int16_t i=250; i>=0; i-=10)
-	{
-		if (i<100) Serial.write(' ');
-		if (i<10) Serial.write(' ');
-		Serial.print(i);
-		Serial.write(':');
-		for (uint8_t j = 0; j<gesture_data_.total_records; j++)
-		{
-			uint8_t marker = 0;
-			if ( i<=rec_data[j].u_data && (i+10)>rec_data[j].u_data) marker |= FLAG_UP;
-			if ( i<=rec_data[j].d_data && (i+10)>rec_data[j].d_data) marker |= FLAG_DOWN;
-			if ( i<=rec_data[j].l_data && (i+10)>rec_data[j].l_data) marker |= FLAG_LEFT;
-			if ( i<=rec_data[j].r_data && (i+10)>rec_data[j].r_data) marker |= FLAG_RIGHT;
-			if (marker&FLAG_UP) Serial.write('u');
-			else Serial.write(' ');
-			if (marker&FLAG_DOWN) Serial.write('d');
-			else Serial.write(' ');
-			if (marker&FLAG_LEFT) Serial.write('l');
-			else Serial.write(' ');
-			if (marker&FLAG_RIGHT) Serial.write('r');
-			else Serial.write(' ');
-		}
-		Serial.write('\n');
-	}
-    Serial.println("-----------------------------------------------------------------");
-#endif
+    /* Set bits in register to given value */
+    old &= ~mask;
+    old |= (val << shift) & mask;
+
+    /* Write register value back */
+    return wireWriteDataByte(reg, old);
 }
 
 /*******************************************************************************
  * Getters and setters for register values
  ******************************************************************************/
 
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
 /**
  * @brief Returns the lower threshold for proximity detection
  *
@@ -835,7 +3626,7 @@ uint8_t APDS9960::getProxIntLowThresh()
     uint8_t val;
 
     /* Read value from PILT register */
-    if( !wireReadDataByte(APDS9960_PILT, val) ) {
+    if( !readShadow(APDS9960_PILT, val) ) {
         val = 0;
     }
 
@@ -850,11 +3641,7 @@ uint8_t APDS9960::getProxIntLowThresh()
  */
 bool APDS9960::setProxIntLowThresh(uint8_t threshold)
 {
-    if( !wireWriteDataByte(APDS9960_PILT, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pilt_field>(threshold);
 }
 
 /**
@@ -867,7 +3654,7 @@ uint8_t APDS9960::getProxIntHighThresh()
     uint8_t val;
 
     /* Read value from PIHT register */
-    if( !wireReadDataByte(APDS9960_PIHT, val) ) {
+    if( !readShadow(APDS9960_PIHT, val) ) {
         val = 0;
     }
 
@@ -882,13 +3669,11 @@ uint8_t APDS9960::getProxIntHighThresh()
  */
 bool APDS9960::setProxIntHighThresh(uint8_t threshold)
 {
-    if( !wireWriteDataByte(APDS9960_PIHT, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<piht_field>(threshold);
 }
+#endif
 
+#if APDS9960_PROXIMITY
 /**
  * @brief Returns LED drive strength for proximity and ALS
  *
@@ -902,17 +3687,7 @@ bool APDS9960::setProxIntHighThresh(uint8_t threshold)
  */
 uint8_t APDS9960::getLEDDrive()
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out LED drive bits */
-    val = (val >> 6) & 0b00000011;
-
-    return val;
+    return getField<ldrive_field>();
 }
 
 /**
@@ -929,25 +3704,7 @@ uint8_t APDS9960::getLEDDrive()
  */
 bool APDS9960::setLEDDrive(uint8_t drive)
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    drive &= 0b00000011;
-    drive = drive << 6;
-    val &= 0b00111111;
-    val |= drive;
-
-    /* Write register value back into CONTROL register */
-    if( !wireWriteDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<ldrive_field>(drive);
 }
 
 /**
@@ -963,17 +3720,7 @@ bool APDS9960::setLEDDrive(uint8_t drive)
  */
 uint8_t APDS9960::getProximityGain()
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out PDRIVE bits */
-    val = (val >> 2) & 0b00000011;
-
-    return val;
+    return getField<pgain_field>();
 }
 
 /**
@@ -990,27 +3737,11 @@ uint8_t APDS9960::getProximityGain()
  */
 bool APDS9960::setProximityGain(uint8_t drive)
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    drive &= 0b00000011;
-    drive = drive << 2;
-    val &= 0b11110011;
-    val |= drive;
-
-    /* Write register value back into CONTROL register */
-    if( !wireWriteDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pgain_field>(drive);
 }
+#endif
 
+#if APDS9960_ALS
 /**
  * @brief Returns receiver gain for the ambient light sensor (ALS)
  *
@@ -1024,17 +3755,7 @@ bool APDS9960::setProximityGain(uint8_t drive)
  */
 uint8_t APDS9960::getAmbientLightGain()
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out ADRIVE bits */
-    val &= 0b00000011;
-
-    return val;
+    return getField<again_field>();
 }
 
 /**
@@ -1051,26 +3772,11 @@ uint8_t APDS9960::getAmbientLightGain()
  */
 bool APDS9960::setAmbientLightGain(uint8_t drive)
 {
-    uint8_t val;
-
-    /* Read value from CONTROL register */
-    if( !wireReadDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    drive &= 0b00000011;
-    val &= 0b11111100;
-    val |= drive;
-
-    /* Write register value back into CONTROL register */
-    if( !wireWriteDataByte(APDS9960_CONTROL, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<again_field>(drive);
 }
+#endif
 
+#if APDS9960_GESTURE
 /**
  * @brief Get the current LED boost value
  * 
@@ -1084,17 +3790,7 @@ bool APDS9960::setAmbientLightGain(uint8_t drive)
  */
 uint8_t APDS9960::getLEDBoost()
 {
-    uint8_t val;
-
-    /* Read value from CONFIG2 register */
-    if( !wireReadDataByte(APDS9960_CONFIG2, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out LED_BOOST bits */
-    val = (val >> 4) & 0b00000011;
-
-    return val;
+    return getField<led_boost_field>();
 }
 
 /**
@@ -1111,27 +3807,11 @@ uint8_t APDS9960::getLEDBoost()
  */
 bool APDS9960::setLEDBoost(uint8_t boost)
 {
-    uint8_t val;
-
-    /* Read value from CONFIG2 register */
-    if( !wireReadDataByte(APDS9960_CONFIG2, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    boost &= 0b00000011;
-    boost = boost << 4;
-    val &= 0b11001111;
-    val |= boost;
-
-    /* Write register value back into CONFIG2 register */
-    if( !wireWriteDataByte(APDS9960_CONFIG2, val) ) {
-        return false;
-    }
+    return setField<led_boost_field>(boost);
+}
+#endif
 
-    return true;
-}    
-   
+#if APDS9960_PROXIMITY
 /**
  * @brief Gets proximity gain compensation enable
  *
@@ -1139,17 +3819,7 @@ bool APDS9960::setLEDBoost(uint8_t boost)
  */
 uint8_t APDS9960::getProxGainCompEnable()
 {
-    uint8_t val;
-
-    /* Read value from CONFIG3 register */
-    if( !wireReadDataByte(APDS9960_CONFIG3, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out PCMP bits */
-    val = (val >> 5) & 0b00000001;
-
-    return val;
+    return getField<pcmp_field>();
 }
 
 /**
@@ -1158,27 +3828,9 @@ uint8_t APDS9960::getProxGainCompEnable()
  * @param[in] enable 1 to enable compensation. 0 to disable compensation.
  * @return True if operation successful. False otherwise.
  */
- bool APDS9960::setProxGainCompEnable(uint8_t enable)
+bool APDS9960::setProxGainCompEnable(uint8_t enable)
 {
-    uint8_t val;
-
-    /* Read value from CONFIG3 register */
-    if( !wireReadDataByte(APDS9960_CONFIG3, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    enable &= 0b00000001;
-    enable = enable << 5;
-    val &= 0b11011111;
-    val |= enable;
-
-    /* Write register value back into CONFIG3 register */
-    if( !wireWriteDataByte(APDS9960_CONFIG3, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pcmp_field>(enable);
 }
 
 /**
@@ -1195,17 +3847,7 @@ uint8_t APDS9960::getProxGainCompEnable()
  */
 uint8_t APDS9960::getProxPhotoMask()
 {
-    uint8_t val;
-
-    /* Read value from CONFIG3 register */
-    if( !wireReadDataByte(APDS9960_CONFIG3, val) ) {
-        return ERROR;
-    }
-
-    /* Mask out photodiode enable mask bits */
-    val &= 0b00001111;
-
-    return val;
+    return getField<pmask_field>();
 }
 
 /**
@@ -1223,26 +3865,11 @@ uint8_t APDS9960::getProxPhotoMask()
  */
 bool APDS9960::setProxPhotoMask(uint8_t mask)
 {
-    uint8_t val;
-
-    /* Read value from CONFIG3 register */
-    if( !wireReadDataByte(APDS9960_CONFIG3, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    mask &= 0b00001111;
-    val &= 0b11110000;
-    val |= mask;
-
-    /* Write register value back into CONFIG3 register */
-    if( !wireWriteDataByte(APDS9960_CONFIG3, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pmask_field>(mask);
 }
+#endif
 
+#if APDS9960_GESTURE
 /**
  * @brief Gets the entry proximity threshold for gesture sensing
  *
@@ -1253,7 +3880,7 @@ uint8_t APDS9960::getGestureEnterThresh()
     uint8_t val;
 
     /* Read value from GPENTH register */
-    if( !wireReadDataByte(APDS9960_GPENTH, val) ) {
+    if( !readShadow(APDS9960_GPENTH, val) ) {
         val = 0;
     }
 
@@ -1268,11 +3895,7 @@ uint8_t APDS9960::getGestureEnterThresh()
  */
 bool APDS9960::setGestureEnterThresh(uint8_t threshold)
 {
-    if( !wireWriteDataByte(APDS9960_GPENTH, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<gpenth_field>(threshold);
 }
 
 /**
@@ -1285,7 +3908,7 @@ uint8_t APDS9960::getGestureExitThresh()
     uint8_t val;
 
     /* Read value from GEXTH register */
-    if( !wireReadDataByte(APDS9960_GEXTH, val) ) {
+    if( !readShadow(APDS9960_GEXTH, val) ) {
         val = 0;
     }
 
@@ -1300,11 +3923,7 @@ uint8_t APDS9960::getGestureExitThresh()
  */
 bool APDS9960::setGestureExitThresh(uint8_t threshold)
 {
-    if( !wireWriteDataByte(APDS9960_GEXTH, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<gexth_field>(threshold);
 }
 
 /**
@@ -1320,17 +3939,7 @@ bool APDS9960::setGestureExitThresh(uint8_t threshold)
  */
 uint8_t APDS9960::getGestureGain()
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out GGAIN bits */
-    val = (val >> 5) & 0b00000011;
-
-    return val;
+    return getField<ggain_field>();
 }
 
 /**
@@ -1347,25 +3956,7 @@ uint8_t APDS9960::getGestureGain()
  */
 bool APDS9960::setGestureGain(uint8_t gain)
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    gain &= 0b00000011;
-    gain = gain << 5;
-    val &= 0b10011111;
-    val |= gain;
-
-    /* Write register value back into GCONF2 register */
-    if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<ggain_field>(gain);
 }
 
 /**
@@ -1381,17 +3972,7 @@ bool APDS9960::setGestureGain(uint8_t gain)
  */
 uint8_t APDS9960::getGestureLEDDrive()
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out GLDRIVE bits */
-    val = (val >> 3) & 0b00000011;
-
-    return val;
+    return getField<gldrive_field>();
 }
 
 /**
@@ -1408,25 +3989,7 @@ uint8_t APDS9960::getGestureLEDDrive()
  */
 bool APDS9960::setGestureLEDDrive(uint8_t drive)
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    drive &= 0b00000011;
-    drive = drive << 3;
-    val &= 0b11100111;
-    val |= drive;
-
-    /* Write register value back into GCONF2 register */
-    if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<gldrive_field>(drive);
 }
 
 /**
@@ -1446,17 +4009,7 @@ bool APDS9960::setGestureLEDDrive(uint8_t drive)
  */
 uint8_t APDS9960::getGestureWaitTime()
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return ERROR;
-    }
-
-    /* Mask out GWTIME bits */
-    val &= 0b00000111;
-
-    return val;
+    return getField<gwtime_field>();
 }
 
 /**
@@ -1477,26 +4030,11 @@ uint8_t APDS9960::getGestureWaitTime()
  */
 bool APDS9960::setGestureWaitTime(uint8_t time)
 {
-    uint8_t val;
-
-    /* Read value from GCONF2 register */
-    if( !wireReadDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    time &= 0b00000111;
-    val &= 0b11111000;
-    val |= time;
-
-    /* Write register value back into GCONF2 register */
-    if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<gwtime_field>(time);
 }
+#endif
 
+#if APDS9960_ALS && APDS9960_INTERRUPTS
 /**
  * @brief Gets the low threshold for ambient light interrupts
  *
@@ -1575,28 +4113,106 @@ bool APDS9960::getLightIntHighThreshold(uint16_t &threshold)
 }
 
 /**
- * @brief Sets the high threshold for ambient light interrupts
+ * @brief Sets the high threshold for ambient light interrupts
+ *
+ * @param[in] threshold high threshold value for interrupt to trigger
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setLightIntHighThreshold(uint16_t threshold)
+{
+    /* Break 16-bit threshold into 2 8-bit values */
+    uint8_t val_low = threshold & 0x00FF;
+    uint8_t val_high = (threshold & 0xFF00) >> 8;
+
+    /* Write low byte */
+    if( !wireWriteDataByte(APDS9960_AIHTL, val_low) ) {
+        return false;
+    }
+
+    /* Write high byte */
+    if( !wireWriteDataByte(APDS9960_AIHTH, val_high) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sets both ambient light interrupt thresholds in one transaction
+ *
+ * @param[in] low low threshold value for interrupt to trigger
+ * @param[in] high high threshold value for interrupt to trigger
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setLightIntWindow(uint16_t low, uint16_t high)
+{
+    /* AILTL, AILTH, AIHTL, AIHTH are consecutive */
+    uint8_t val[4];
+    val[0] = low & 0x00FF;
+    val[1] = (low & 0xFF00) >> 8;
+    val[2] = high & 0x00FF;
+    val[3] = (high & 0xFF00) >> 8;
+
+    if( !wireWriteDataBlock(APDS9960_AILTL, val, 4) ) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gets the number of out-of-range ALS cycles before an interrupt
+ *
+ * Value    Consecutive cycles
+ *   0      every cycle
+ *   1-3    1-3
+ *   4-15   5, 10, 15 ... 60
+ *
+ * @return APERS value. 0xFF on error.
+ */
+uint8_t APDS9960::getLightIntPersistence()
+{
+    return getField<apers_field>();
+}
+
+/**
+ * @brief Sets the number of out-of-range ALS cycles before an interrupt
  *
- * @param[in] threshold high threshold value for interrupt to trigger
+ * Value    Consecutive cycles
+ *   0      every cycle
+ *   1-3    1-3
+ *   4-15   5, 10, 15 ... 60
+ *
+ * @param[in] persistence APERS value, 0-15
  * @return True if operation successful. False otherwise.
  */
-bool APDS9960::setLightIntHighThreshold(uint16_t threshold)
+bool APDS9960::setLightIntPersistence(uint8_t persistence)
 {
-    /* Break 16-bit threshold into 2 8-bit values */
-    uint8_t val_low = threshold & 0x00FF;
-    uint8_t val_high = (threshold & 0xFF00) >> 8;
-
-    /* Write low byte */
-    if( !wireWriteDataByte(APDS9960_AIHTL, val_low) ) {
-        return false;
-    }
+    return setField<apers_field>(persistence);
+}
+#endif
 
-    /* Write high byte */
-    if( !wireWriteDataByte(APDS9960_AIHTH, val_high) ) {
-        return false;
-    }
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
+/**
+ * @brief Gets the number of out-of-range proximity cycles before an interrupt
+ *
+ * @return PPERS value, 0 (every cycle) to 15 consecutive cycles. 0xFF on
+ *  error.
+ */
+uint8_t APDS9960::getProximityIntPersistence()
+{
+    return getField<ppers_field>();
+}
 
-    return true;
+/**
+ * @brief Sets the number of out-of-range proximity cycles before an interrupt
+ *
+ * @param[in] persistence PPERS value, 0 (every cycle) to 15 consecutive cycles
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setProximityIntPersistence(uint8_t persistence)
+{
+    return setField<ppers_field>(persistence);
 }
 
 /**
@@ -1610,7 +4226,7 @@ bool APDS9960::getProximityIntLowThreshold(uint8_t &threshold)
     threshold = 0;
 
     /* Read value from proximity low threshold register */
-    if( !wireReadDataByte(APDS9960_PILT, threshold) ) {
+    if( !readShadow(APDS9960_PILT, threshold) ) {
         return false;
     }
 
@@ -1625,12 +4241,7 @@ bool APDS9960::getProximityIntLowThreshold(uint8_t &threshold)
  */
 bool APDS9960::setProximityIntLowThreshold(uint8_t threshold)
 {
-    /* Write threshold value to register */
-    if( !wireWriteDataByte(APDS9960_PILT, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pilt_field>(threshold);
 }
     
 /**
@@ -1644,7 +4255,7 @@ bool APDS9960::getProximityIntHighThreshold(uint8_t &threshold)
     threshold = 0;
 
     /* Read value from proximity low threshold register */
-    if( !wireReadDataByte(APDS9960_PIHT, threshold) ) {
+    if( !readShadow(APDS9960_PIHT, threshold) ) {
         return false;
     }
 
@@ -1659,14 +4270,11 @@ bool APDS9960::getProximityIntHighThreshold(uint8_t &threshold)
  */
 bool APDS9960::setProximityIntHighThreshold(uint8_t threshold)
 {
-    /* Write threshold value to register */
-    if( !wireWriteDataByte(APDS9960_PIHT, threshold) ) {
-        return false;
-    }
-
-    return true;
+    return setField<piht_field>(threshold);
 }
+#endif
 
+#if APDS9960_ALS
 /**
  * @brief Gets if ambient light interrupts are enabled or not
  *
@@ -1674,17 +4282,7 @@ bool APDS9960::setProximityIntHighThreshold(uint8_t threshold)
  */
 uint8_t APDS9960::getAmbientLightIntEnable()
 {
-    uint8_t val;
-
-    /* Read value from ENABLE register */
-    if( !wireReadDataByte(APDS9960_ENABLE, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out AIEN bit */
-    val = (val >> 4) & 0b00000001;
-
-    return val;
+    return getField<aien_field>();
 }
 
 /**
@@ -1695,27 +4293,11 @@ uint8_t APDS9960::getAmbientLightIntEnable()
  */
 bool APDS9960::setAmbientLightIntEnable(uint8_t enable)
 {
-    uint8_t val;
-
-    /* Read value from ENABLE register */
-    if( !wireReadDataByte(APDS9960_ENABLE, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    enable &= 0b00000001;
-    enable = enable << 4;
-    val &= 0b11101111;
-    val |= enable;
-
-    /* Write register value back into ENABLE register */
-    if( !wireWriteDataByte(APDS9960_ENABLE, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<aien_field>(enable);
 }
+#endif
 
+#if APDS9960_PROXIMITY
 /**
  * @brief Gets if proximity interrupts are enabled or not
  *
@@ -1723,17 +4305,7 @@ bool APDS9960::setAmbientLightIntEnable(uint8_t enable)
  */
 uint8_t APDS9960::getProximityIntEnable()
 {
-    uint8_t val;
-
-    /* Read value from ENABLE register */
-    if( !wireReadDataByte(APDS9960_ENABLE, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out PIEN bit */
-    val = (val >> 5) & 0b00000001;
-
-    return val;
+    return getField<pien_field>();
 }
 
 /**
@@ -1744,27 +4316,11 @@ uint8_t APDS9960::getProximityIntEnable()
  */
 bool APDS9960::setProximityIntEnable(uint8_t enable)
 {
-    uint8_t val;
-
-    /* Read value from ENABLE register */
-    if( !wireReadDataByte(APDS9960_ENABLE, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    enable &= 0b00000001;
-    enable = enable << 5;
-    val &= 0b11011111;
-    val |= enable;
-
-    /* Write register value back into ENABLE register */
-    if( !wireWriteDataByte(APDS9960_ENABLE, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<pien_field>(enable);
 }
+#endif
 
+#if APDS9960_GESTURE
 /**
  * @brief Gets if gesture interrupts are enabled or not
  *
@@ -1772,17 +4328,7 @@ bool APDS9960::setProximityIntEnable(uint8_t enable)
  */
 uint8_t APDS9960::getGestureIntEnable()
 {
-    uint8_t val;
-
-    /* Read value from GCONF4 register */
-    if( !wireReadDataByte(APDS9960_GCONF4, val) ) {
-        return ERROR;
-    }
-
-    /* Shift and mask out GIEN bit */
-    val = (val >> 1) & 0b00000001;
-
-    return val;
+    return getField<gien_field>();
 }
 
 /**
@@ -1793,27 +4339,11 @@ uint8_t APDS9960::getGestureIntEnable()
  */
 bool APDS9960::setGestureIntEnable(uint8_t enable)
 {
-    uint8_t val;
-
-    /* Read value from GCONF4 register */
-    if( !wireReadDataByte(APDS9960_GCONF4, val) ) {
-        return false;
-    }
-
-    /* Set bits in register to given value */
-    enable &= 0b00000001;
-    enable = enable << 1;
-    val &= 0b11111101;
-    val |= enable;
-
-    /* Write register value back into GCONF4 register */
-    if( !wireWriteDataByte(APDS9960_GCONF4, val) ) {
-        return false;
-    }
-
-    return true;
+    return setField<gien_field>(enable);
 }
+#endif
 
+#if APDS9960_ALS && APDS9960_INTERRUPTS
 /**
  * @brief Clears the ambient light interrupt
  *
@@ -1828,7 +4358,9 @@ bool APDS9960::clearAmbientLightInt()
 
     return true;
 }
+#endif
 
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
 /**
  * @brief Clears the proximity interrupt
  *
@@ -1843,7 +4375,9 @@ bool APDS9960::clearProximityInt()
 
     return true;
 }
+#endif
 
+#if APDS9960_GESTURE
 /**
  * @brief Tells if the gesture state machine is currently running
  *
@@ -1851,17 +4385,7 @@ bool APDS9960::clearProximityInt()
  */
 uint8_t APDS9960::getGestureMode()
 {
-    uint8_t val;
-
-    /* Read value from GCONF4 register */
-    if( !wireReadDataByte(APDS9960_GCONF4, val) ) {
-        return ERROR;
-    }
-
-    /* Mask out GMODE bit */
-    val &= 0b00000001;
-
-    return val;
+    return getField<gmode_field>();
 }
 
 /**
@@ -1872,30 +4396,126 @@ uint8_t APDS9960::getGestureMode()
  */
 bool APDS9960::setGestureMode(uint8_t mode)
 {
-    uint8_t val;
-    
-    /* Read value from GCONF4 register */
-    if( !wireReadDataByte(APDS9960_GCONF4, val) ) {
+    return setField<gmode_field>(mode);
+}
+#endif
+
+/**
+ * @brief Computes the timing of the current configuration
+ *
+ * Outside gesture mode the state machine runs proximity, wait and ALS in
+ * turn, each at most once per period. In gesture mode (GMODE set) that
+ * cycle is suspended and gesture datasets are taken back to back. Values
+ * come from the register shadow, so this normally costs no bus traffic.
+ *
+ * @param[out] timing phase times, data-ready rates and FIFO fill times
+ * @return True if successful. False otherwise.
+ */
+bool APDS9960::getCycleTiming(cycle_timing_type &timing)
+{
+    uint8_t enable, ppulse, atime, wtime, config1, gpulse, gconf1, gconf2;
+
+    if( !readShadow(APDS9960_ENABLE, enable) ||
+        !readShadow(APDS9960_PPULSE, ppulse) ||
+        !readShadow(APDS9960_ATIME, atime) ||
+        !readShadow(APDS9960_WTIME, wtime) ||
+        !readShadow(APDS9960_CONFIG1, config1) ||
+        !readShadow(APDS9960_GPULSE, gpulse) ||
+        !readShadow(APDS9960_GCONF1, gconf1) ||
+        !readShadow(APDS9960_GCONF2, gconf2) ) {
         return false;
     }
-    
-    /* Set bits in register to given value */
-    mode &= 0b00000001;
-    val &= 0b11111110;
-    val |= mode;
-    
-    /* Write register value back into GCONF4 register */
-    if( !wireWriteDataByte(APDS9960_GCONF4, val) ) {
-        return false;
+    memset(&timing, 0, sizeof(timing));
+    if( !(enable & APDS9960_PON) ) {
+        return true;
+    }
+
+    /* Proximity, wait and ALS cycle */
+    if( enable & APDS9960_PEN ) {
+        timing.prox_us = getProximityTime(ppulse);
+    }
+    if( enable & APDS9960_WEN ) {
+        timing.wait_us = getWaitTime(wtime, config1);
+    }
+    if( enable & APDS9960_AEN ) {
+        timing.als_us = getAlsTime(atime);
+    }
+    timing.period_us = timing.prox_us + timing.wait_us + timing.als_us;
+    if( timing.period_us ) {
+        uint32_t rate = 1000000000UL / timing.period_us;
+        timing.prox_rate_mhz = timing.prox_us ? rate : 0;
+        timing.als_rate_mhz = timing.als_us ? rate : 0;
+    }
+    timing.led_ua = getLEDCurrent(timing.period_us);
+
+    /* Gesture datasets; GFIFOTH is 1, 4, 8 or 16 datasets */
+    if( enable & APDS9960_GEN ) {
+        static const uint8_t fifo_th[4] = {1, 4, 8, 16};
+        timing.gesture_us = getGestureTime(gpulse, gconf2);
+        timing.fifo_rate_mhz = 1000000000UL / timing.gesture_us;
+        timing.fifo_valid_us = fifo_th[gconf1 >> 6] * timing.gesture_us;
+        timing.fifo_full_us = GFIFO_SIZE * timing.gesture_us;
     }
 
     return true;
 }
 
+/**
+ * @brief Gets the 12x wait time factor
+ *
+ * @return 1 if WLONG is set, 0 if not. 0xFF on error.
+ */
+uint8_t APDS9960::getWaitLong()
+{
+    return getField<wlong_field>();
+}
+
+/**
+ * @brief Sets the 12x wait time factor
+ *
+ * @param[in] enable 1 to multiply the WTIME wait by 12, 0 for 1x
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setWaitLong(uint8_t enable)
+{
+    return setField<wlong_field>(enable);
+}
+
+/**
+ * @brief Gets sleep after interrupt
+ *
+ * @return 1 if SAI is set, 0 if not. 0xFF on error.
+ */
+uint8_t APDS9960::getSleepAfterInt()
+{
+    return getField<sai_field>();
+}
+
+/**
+ * @brief Sets sleep after interrupt
+ *
+ * With SAI set, the device stops cycling at the end of a cycle that
+ * asserted INT, until the interrupt is cleared.
+ *
+ * @param[in] enable 1 to sleep after an interrupt, 0 to keep cycling
+ * @return True if operation successful. False otherwise.
+ */
+bool APDS9960::setSleepAfterInt(uint8_t enable)
+{
+    return setField<sai_field>(enable);
+}
+
 /*******************************************************************************
  * Raw I2C Reads and Writes
  ******************************************************************************/
 
+/*
+ * Every helper makes at most 1 + I2C_RETRIES attempts. Where the core
+ * supports it, each START..STOP is aborted after I2C_TIMEOUT us, so no
+ * helper blocks for more than about 2 * (1 + I2C_RETRIES) * I2C_TIMEOUT
+ * plus one bus recovery.
+ */
+
 /**
  * @brief Writes a single byte to the I2C device (no register)
  *
@@ -1904,13 +4524,19 @@ bool APDS9960::setGestureMode(uint8_t mode)
  */
 bool APDS9960::wireWriteByte(uint8_t val)
 {
-    Wire.beginTransmission(APDS9960_I2C_ADDR);
-    Wire.write(val);
-    if( Wire.endTransmission() != 0 ) {
-        return false;
+    for( uint8_t attempt = 0; attempt <= I2C_RETRIES; attempt++ ) {
+        if( attempt ) {
+            I2C_STAT(retries);
+        }
+        Wire.beginTransmission(APDS9960_I2C_ADDR);
+        Wire.write(val);
+        if( wireEndTransmission() ) {
+            return true;
+        }
     }
 
-    return true;
+    wireFailed();
+    return false;
 }
 
 /**
@@ -1922,14 +4548,21 @@ bool APDS9960::wireWriteByte(uint8_t val)
  */
 bool APDS9960::wireWriteDataByte(uint8_t reg, uint8_t val)
 {
-    Wire.beginTransmission(APDS9960_I2C_ADDR);
-    Wire.write(reg);
-    Wire.write(val);
-    if( Wire.endTransmission() != 0 ) {
-        return false;
+    for( uint8_t attempt = 0; attempt <= I2C_RETRIES; attempt++ ) {
+        if( attempt ) {
+            I2C_STAT(retries);
+        }
+        Wire.beginTransmission(APDS9960_I2C_ADDR);
+        Wire.write(reg);
+        Wire.write(val);
+        if( wireEndTransmission() ) {
+            shadowStore(reg, val);
+            return true;
+        }
     }
 
-    return true;
+    wireFailed();
+    return false;
 }
 
 /**
@@ -1944,16 +4577,25 @@ bool APDS9960::wireWriteDataBlock(uint8_t reg,
                                         uint8_t *val, 
                                         unsigned int len)
 {
-    Wire.beginTransmission(APDS9960_I2C_ADDR);
-    Wire.write(reg);
-    for(uint8_t i = 0; i < len; i++) {
-        Wire.beginTransmission(val[i]);
-    }
-    if( Wire.endTransmission() != 0 ) {
-        return false;
+    for( uint8_t attempt = 0; attempt <= I2C_RETRIES; attempt++ ) {
+        if( attempt ) {
+            I2C_STAT(retries);
+        }
+        Wire.beginTransmission(APDS9960_I2C_ADDR);
+        Wire.write(reg);
+        for( unsigned int i = 0; i < len; i++ ) {
+            Wire.write(val[i]);
+        }
+        if( wireEndTransmission() ) {
+            for( unsigned int i = 0; i < len; i++ ) {
+                shadowStore(reg + i, val[i]);
+            }
+            return true;
+        }
     }
 
-    return true;
+    wireFailed();
+    return false;
 }
 
 /**
@@ -1965,23 +4607,35 @@ bool APDS9960::wireWriteDataBlock(uint8_t reg,
  */
 bool APDS9960::wireReadDataByte(uint8_t reg, uint8_t &val)
 {
-    /* Indicate which register we want to read from */
-    if (!wireWriteByte(reg)) {
-        return false;
-    }
+    for( uint8_t attempt = 0; attempt <= I2C_RETRIES; attempt++ ) {
+        if( attempt ) {
+            I2C_STAT(retries);
+        }
 
-    /* Read from register */
-    Wire.requestFrom(APDS9960_I2C_ADDR, 1);
-    while (Wire.available()) {
-        val = Wire.read();
+        /* Indicate which register we want to read from */
+        Wire.beginTransmission(APDS9960_I2C_ADDR);
+        Wire.write(reg);
+        if( !wireEndTransmission() ) {
+            continue;
+        }
+
+        /* Read from register */
+        if( wireRequest(&val, 1) == 1 ) {
+            shadowStore(reg, val);
+            return true;
+        }
     }
 
-    return true;
+    wireFailed();
+    return false;
 }
 
 /**
  * @brief Reads a block (array) of bytes from the I2C device and register
  *
+ * A read that returns nothing is retried. A partial read is returned as
+ * is: the FIFO pops the bytes it sent, so repeating it would skip data.
+ *
  * @param[in] reg the register to read from
  * @param[out] val pointer to the beginning of the data
  * @param[in] len number of bytes to read
@@ -1991,21 +4645,175 @@ int APDS9960::wireReadDataBlock(uint8_t reg,
                                         uint8_t *val, 
                                         unsigned int len)
 {
-    /* Indicate which register we want to read from */
-    if (!wireWriteByte(reg)) {
-        return -1;
+    for( uint8_t attempt = 0; attempt <= I2C_RETRIES; attempt++ ) {
+        if( attempt ) {
+            I2C_STAT(retries);
+        }
+
+        /* Indicate which register we want to read from */
+        Wire.beginTransmission(APDS9960_I2C_ADDR);
+        Wire.write(reg);
+        if( !wireEndTransmission() ) {
+            continue;
+        }
+
+        /* Read block data */
+        int n = wireRequest(val, len);
+        if( n > 0 ) {
+            return n;
+        }
+    }
+
+    wireFailed();
+    return -1;
+}
+
+/**
+ * @brief Ends a write transaction and records why it failed, if it did
+ *
+ * @return True if the device acknowledged every byte. False otherwise.
+ */
+bool APDS9960::wireEndTransmission()
+{
+    /* A background read still owns the bus, for at most I2C_TIMEOUT. If
+       it is given up, Wire has been restarted under this transaction. */
+    if( xfer_async_ && !xfer_expired_ ) {
+        while( asyncBusy() ) {
+            yield();
+        }
+        if( xfer_expired_ ) {
+            return false;
+        }
+    }
+    uint8_t err = Wire.endTransmission();
+
+    wire_timed_out_ = false;
+#ifdef WIRE_HAS_TIMEOUT
+    if( Wire.getWireTimeoutFlag() ) {
+        Wire.clearWireTimeoutFlag();
+        I2C_STAT(timeouts);
+        wire_timed_out_ = true;
+        return false;
+    }
+#endif
+    if( err != 0 ) {
+        I2C_STAT(nacks);
+        return false;
     }
 
-    /* Read block data */
-    Wire.requestFrom(APDS9960_I2C_ADDR, len);
-    uint8_t i = 0;
-    while (Wire.available()) {
-        if (i >= len) {
-            return -1;
+    return true;
+}
+
+/**
+ * @brief Reads up to len bytes from the current register pointer
+ *
+ * @param[out] val pointer to the beginning of the data
+ * @param[in] len number of bytes to read
+ * @return Number of bytes received
+ */
+int APDS9960::wireRequest(uint8_t *val, unsigned int len)
+{
+    unsigned int n = Wire.requestFrom(APDS9960_I2C_ADDR, len);
+    unsigned int i = 0;
+
+    while( Wire.available() ) {
+        uint8_t c = Wire.read();
+        if( i < len ) {
+            val[i++] = c;
         }
-        val[i] = Wire.read();
-        i++;
+    }
+    wire_timed_out_ = false;
+#ifdef WIRE_HAS_TIMEOUT
+    if( Wire.getWireTimeoutFlag() ) {
+        Wire.clearWireTimeoutFlag();
+        I2C_STAT(timeouts);
+        wire_timed_out_ = true;
+        return 0;
+    }
+#endif
+    if( n == 0 ) {
+        I2C_STAT(nacks);
+    } else if( i < len ) {
+        I2C_STAT(short_reads);
     }
 
     return i;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Counts a transaction that failed every attempt, frees a hung bus
+ *
+ * A NACK, e.g. from a missing device, leaves the bus idle and is only
+ * reported. Recovery runs when the last attempt hit the Wire timeout or
+ * a slave holds SDA low.
+ */
+void APDS9960::wireFailed()
+{
+    I2C_STAT(failures);
+    if( wire_timed_out_ ||
+        (recovery_sda_ != I2C_NO_PIN && digitalRead(recovery_sda_) == LOW) ) {
+        recoverBus();
+    }
+}
+
+/*******************************************************************************
+ * Register shadow
+ ******************************************************************************/
+
+/*
+ * Configuration registers only change when the host writes them, so the
+ * last value written or read is kept and the timing model can work without
+ * bus traffic. Status, data, GCONF4 (GMODE is cleared by the device),
+ * GFLVL and GSTATUS are never shadowed.
+ */
+static bool isVolatile(uint8_t reg)
+{
+    return reg == APDS9960_STATUS ||
+           (reg >= APDS9960_CDATAL && reg <= APDS9960_PDATA) ||
+           reg >= APDS9960_GCONF4;
+}
+
+/**
+ * @brief Forgets all shadowed register values
+ */
+void APDS9960::clearShadow()
+{
+    memset(shadow_valid_, 0, sizeof(shadow_valid_));
+}
+
+/**
+ * @brief Records a value known to be in a device register
+ *
+ * @param[in] reg register address
+ * @param[in] val register value
+ */
+void APDS9960::shadowStore(uint8_t reg, uint8_t val)
+{
+    uint8_t i = reg - APDS9960_ENABLE;
+
+    if( reg < APDS9960_ENABLE || i >= SHADOW_SIZE || isVolatile(reg) ) {
+        return;
+    }
+    shadow_[i] = val;
+    shadow_valid_[i >> 3] |= 1 << (i & 7);
+}
+
+/**
+ * @brief Reads a register from the shadow, or from the device if not known
+ *
+ * @param[in] reg register address
+ * @param[out] val register value
+ * @return True if successful. False otherwise.
+ */
+bool APDS9960::readShadow(uint8_t reg, uint8_t &val)
+{
+    uint8_t i = reg - APDS9960_ENABLE;
+
+    if( reg >= APDS9960_ENABLE && i < SHADOW_SIZE && !isVolatile(reg) &&
+        (shadow_valid_[i >> 3] & (1 << (i & 7))) ) {
+        val = shadow_[i];
+        return true;
+    }
+
+    return wireReadDataByte(reg, val);
+}
@@ -12,8 +12,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 
-// Debug
-#define DEBUG                   0
+#include "APDS9960_config.h"
 
 // APDS-9960 I2C address
 #define APDS9960_I2C_ADDR       0x39
@@ -43,6 +42,20 @@ typedef struct gesture_data_type
     uint8_t total_records;
 } gesture_data_type;
 
+// Proximity filter: median of the last N samples, then an EMA
+#define PROX_FILTER_MAX 9
+
+typedef struct prox_filter_type
+{
+    uint8_t window[PROX_FILTER_MAX];    // samples in arrival order
+    uint8_t sorted[PROX_FILTER_MAX];    // the same samples, ascending
+    uint8_t size;                       // median window length, 0 when off
+    uint8_t count;
+    uint8_t head;
+    uint8_t ema_shift;                  // EMA weight is 1/2^ema_shift
+    uint16_t ema;                       // 8.8 fixed point
+} prox_filter_type;
+
 #define MAX_RECORDS 80
 #define DELTA_MIN 7
 #define THRESHOLD_MIN 70
@@ -56,6 +69,187 @@ typedef struct gesture_data_type
 #define FLAG_APPROACH 0x40
 #define FLAG_DEPART   0x80
 
+// Returned by readGesture(budget_us) while a gesture is still being read
+#define GESTURE_PENDING 0x100
+
+// Proximity threshold tracking, see enableProximityTracking()
+typedef struct prox_track_type
+{
+    uint8_t baseline;   // idle level learnt with nothing in front
+    uint8_t noise;      // mean absolute deviation of the idle level
+    uint8_t enter;      // PIHT while far
+    uint8_t leave;      // PILT while near
+    bool near;
+    bool active;
+} prox_track_type;
+
+// Registers saved by enableProximityHighRate()
+typedef struct prox_highrate_type
+{
+    uint8_t enable;     // ENABLE
+    uint8_t ppulse;     // PPULSE
+    uint8_t wtime;      // WTIME
+    uint8_t control;    // CONTROL: LDRIVE, PGAIN, AGAIN
+    bool active;
+} prox_highrate_type;
+
+/* Proximity tracking events */
+#define PROX_EVENT_NONE     0
+#define PROX_EVENT_ENTER    1
+#define PROX_EVENT_LEAVE    2
+
+// Automatic gain ranging state, see enableSaturationControl()
+typedef struct sat_control_type
+{
+    bool active;
+    uint8_t control;        // CONTROL as configured, ceiling for stepping back up
+    uint8_t prox_low;       // consecutive proximity samples below SAT_PROX_RESTORE
+    uint8_t als_low;        // consecutive clear samples below 1/16 of full scale
+    uint8_t flags;          // SAT_* of the last samples read
+} sat_control_type;
+
+/* Saturation flags, see getSaturation() */
+#define SAT_PROXIMITY       0x01
+#define SAT_AMBIENT         0x02
+
+// Output of the power scheduler, see planPower()
+typedef struct power_plan_type
+{
+    uint8_t wtime;          // WTIME register value
+    bool wlong;             // 12x wait factor (CONFIG1 WLONG)
+    bool wait;              // WEN, false when cycles run back to back
+    bool sai;               // sleep after interrupt (CONFIG3 SAI), if asked for
+    uint32_t active_us;     // proximity + ALS time in one cycle
+    uint32_t period_us;     // one full cycle including the wait
+    uint32_t led_ua;        // average LED current (uA)
+} power_plan_type;
+
+// Cycle timing of the current configuration, see getCycleTiming()
+typedef struct cycle_timing_type
+{
+    uint32_t prox_us;           // proximity pulses and conversion, 0 if off
+    uint32_t wait_us;           // wait, 0 if off
+    uint32_t als_us;            // ALS integration, 0 if off
+    uint32_t period_us;         // one prox/wait/ALS cycle
+    uint32_t prox_rate_mhz;     // PVALID rate (mHz), 0 if off
+    uint32_t als_rate_mhz;      // AVALID rate (mHz), 0 if off
+    uint32_t gesture_us;        // one gesture dataset, 0 if GEN is off
+    uint32_t fifo_rate_mhz;     // FIFO fill rate in gesture mode (datasets/1000 s)
+    uint32_t fifo_valid_us;     // gesture entry to GVALID (GFIFOTH datasets)
+    uint32_t fifo_full_us;      // gesture entry to a full FIFO
+    uint32_t led_ua;            // average LED current outside gesture mode (uA)
+} cycle_timing_type;
+
+// Gesture configuration found by tuneGestureRate()
+typedef struct gesture_tuning_type
+{
+    uint8_t gpulse;         // GPULSE register value
+    uint8_t gconf2;         // GCONF2 register value (GGAIN, GLDRIVE, GWTIME)
+    uint8_t led_boost;      // CONFIG2 LED_BOOST value
+    uint8_t signal;         // mean of the strongest photodiode per dataset
+    bool saturated;         // a count of 255 was seen
+    uint16_t rate_hz;       // measured datasets per second
+} gesture_tuning_type;
+
+// Streamed sample, see startStreaming()
+typedef struct stream_record_type
+{
+    uint64_t time_us;       // micros() extended to 64 bits, never wraps
+    uint8_t channel;        // STREAM_PROXIMITY, STREAM_COLOR or STREAM_GESTURE
+    uint8_t data[8];        // PDATA, CDATAL..BDATAH, or U, D, L, R
+} stream_record_type;
+
+/* Streaming channels */
+#define STREAM_PROXIMITY    0x01
+#define STREAM_COLOR        0x02
+#define STREAM_GESTURE      0x04
+
+// Gesture capture counters, see getCaptureInfo()
+typedef struct capture_info_type
+{
+    uint16_t bytes;         // used in the capture buffer
+    uint16_t gestures;      // stored
+    uint16_t dropped;       // not stored, too long for the space left
+    uint32_t records;       // FIFO datasets stored, 4 bytes each uncompressed
+} capture_info_type;
+
+/* Capture stream, decoded on the host by extras/host/capture_decode.cpp.
+   Each gesture is the time since the previous one in ms (varint, 7 bits
+   per byte, low bits first), the number of datasets, the motion flags,
+   then the datasets in groups of four: a class byte, two bits per dataset
+   from bit 7 down, followed by their payloads. A dataset is stored as the
+   difference to the one before it (U, D, L, R, the first one to 0), all
+   four in the smallest class that fits. */
+#define CAPTURE_ZERO        0       // no change, no payload
+#define CAPTURE_CRUMB       1       // -2..1, 1 byte: U D L R in 2 bits each
+#define CAPTURE_NIBBLE      2       // -8..7, 2 bytes: U D, L R in 4 bits each
+#define CAPTURE_BYTE        3       // any, 4 bytes: U D L R modulo 256
+
+// Debug trace event, decoded on the host by extras/host/trace_decode.cpp
+typedef struct trace_event_t
+{
+    uint16_t time;      // micros()/16, wraps after ~1 s
+    uint8_t id;
+    uint8_t arg;
+    uint8_t data[4];
+} trace_event_t;
+
+#define TRACE_SIZE          APDS9960_TRACE_SIZE    // Events kept, see APDS9960_config.h
+static_assert(TRACE_SIZE && !(TRACE_SIZE & (TRACE_SIZE - 1)),
+              "APDS9960_TRACE_SIZE must be a power of two");
+
+/* Trace event identifiers */
+#define TRACE_FIFO_LEVEL    0x01    // arg: FIFO level
+#define TRACE_FIFO_READ     0x02    // arg: bytes read
+#define TRACE_RECORD        0x03    // arg: record index, data: U, D, L, R
+#define TRACE_MAX_RECORDS   0x04
+#define TRACE_DIR_UD        0x05    // data: dir_up, dir_down (LE16)
+#define TRACE_DIR_LR        0x06    // data: dir_left, dir_right (LE16)
+#define TRACE_SUM           0x07    // arg: total records, data: sum_udlr (LE32)
+#define TRACE_MOTION        0x08    // arg: motion flags, data: delta_udlr (LE16)
+
+// I2C transport statistics, see getI2CStats()
+typedef struct i2c_stats_type
+{
+    uint16_t nacks;         // address or data byte not acknowledged
+    uint16_t short_reads;   // fewer bytes received than requested
+    uint16_t timeouts;      // transactions aborted by the Wire timeout
+    uint16_t retries;       // transactions repeated after a failure
+    uint16_t failures;      // transactions that failed every attempt
+    uint16_t recoveries;    // bus recovery sequences sent
+} i2c_stats_type;
+
+// Asynchronous I2C transfer, see submitTransfer()
+#define I2C_PENDING             (-2)    // result while queued or on the bus
+
+typedef void (*i2c_callback_type)(void *context, int result);
+
+typedef struct i2c_transfer_type
+{
+    uint8_t reg;                    // first register, auto-incremented
+    uint8_t *buf;                   // bytes read or written
+    uint8_t len;                    // at most the Wire buffer (32 on AVR)
+    bool read;                      // true to read len bytes, false to write
+    i2c_callback_type done;         // called with result when done, or NULL
+    void *context;
+    int result;                     // bytes transferred, -1 on error
+    struct i2c_transfer_type *next;
+} i2c_transfer_type;
+
+// Background register reads supplied by the application, see setAsyncTransport()
+typedef struct i2c_async_type
+{
+    // Start reading len bytes from reg and return at once, false if the
+    // read cannot start. done(done_context, count) runs when it ends,
+    // possibly from an interrupt, count being -1 on failure.
+    bool (*read)(void *context, uint8_t addr, uint8_t reg, uint8_t *buf,
+                 uint8_t len, i2c_callback_type done, void *done_context);
+    // True while the read started by read() holds the bus. Must only turn
+    // false once done() has returned.
+    bool (*busy)(void *context);
+    void *context;
+} i2c_async_type;
+
 /* Error code for returned values */
 #define ERROR                   0xFF
 
@@ -65,6 +259,29 @@ typedef struct gesture_data_type
  */
 /* Misc parameters */
 #define FIFO_PAUSE_TIME         20      // Wait period (ms) between FIFO reads
+#define FIFO_READ_RECORDS       8       // Datasets per FIFO read (32 bytes)
+#define POWER_ON_TIME           6       // Delay (ms) from PON to the first cycle
+#define PROX_CONVERSION_TIME    700     // Proximity ADC conversion (us)
+#define HIGHRATE_SAMPLES        16      // Samples per PPULSE candidate
+
+/* I2C transport parameters */
+#define I2C_RETRIES             2       // Repeats of a failed transaction
+#define I2C_TIMEOUT             5000    // Wire timeout per transaction (us)
+#define I2C_RECOVERY_CLOCKS     9       // SCL pulses to release a stuck SDA
+#define I2C_NO_PIN              0xFF    // Bus recovery pins not configured
+#define PROX_LEARN_SAMPLES      16      // Samples averaged for the idle baseline
+#define PROX_LEARN_DIVIDER      16      // Poll PVALID every 1/16 of a cycle while learning
+#define WAIT_STEP_TIME          2780    // One WTIME or ATIME step (us)
+#define WLONG_FACTOR            12      // Wait multiplier with CONFIG1 WLONG
+#define GESTURE_CONVERSION_TIME 700     // Gesture ADC conversions (us)
+#define GFIFO_SIZE              32      // Datasets held by the gesture FIFO
+#define SHADOW_SIZE             0x30    // Shadowed registers, ENABLE..GSTATUS
+#define ALS_RETRY_DIVIDER       16      // Re-poll AVALID after 1/16 of a cycle
+#define ALS_MIN_BAND            4       // Narrowest ALS tracking half-band (counts)
+#define TUNE_DATASETS           8       // Gesture datasets per tuning candidate
+#define TUNE_DRAIN_MARGIN       25      // % readGesture() must drain faster than the FIFO fills
+#define SAT_RESTORE_SAMPLES     8       // Unsaturated samples before stepping back up
+#define SAT_PROX_RESTORE        64      // PDATA below which a 2x step cannot clip
 
 /* APDS-9960 register addresses */
 #define APDS9960_ENABLE         0x80
@@ -126,6 +343,50 @@ typedef struct gesture_data_type
 #define APDS9960_PIEN           0b00100000
 #define APDS9960_GEN            0b01000000
 #define APDS9960_GVALID         0b00000001
+#define APDS9960_AVALID         0b00000001
+#define APDS9960_PVALID         0b00000010
+#define APDS9960_WLONG          0b00000010
+#define APDS9960_SAI            0b00010000
+#define APDS9960_AINT           0b00010000
+#define APDS9960_PINT           0b00100000
+#define APDS9960_PGSAT          0b01000000
+#define APDS9960_CPSAT          0b10000000
+#define APDS9960_PSIEN          0b10000000
+#define APDS9960_CPSIEN         0b01000000
+#define APDS9960_GMODE          0b00000001
+#define APDS9960_GFIFO_CLR      0b00000100
+
+/* Register bit fields: register address, lowest bit and width */
+template <uint8_t REG, uint8_t SHIFT, uint8_t WIDTH>
+struct apds9960_field
+{
+    static constexpr uint8_t reg = REG;
+    static constexpr uint8_t shift = SHIFT;
+    static constexpr uint8_t mask = ((1 << WIDTH) - 1) << SHIFT;
+};
+
+typedef apds9960_field<APDS9960_ENABLE, 4, 1>   aien_field;
+typedef apds9960_field<APDS9960_ENABLE, 5, 1>   pien_field;
+typedef apds9960_field<APDS9960_PILT, 0, 8>     pilt_field;
+typedef apds9960_field<APDS9960_PIHT, 0, 8>     piht_field;
+typedef apds9960_field<APDS9960_PERS, 0, 4>     apers_field;
+typedef apds9960_field<APDS9960_PERS, 4, 4>     ppers_field;
+typedef apds9960_field<APDS9960_CONFIG1, 1, 1>  wlong_field;
+typedef apds9960_field<APDS9960_CONTROL, 0, 2>  again_field;
+typedef apds9960_field<APDS9960_CONTROL, 2, 2>  pgain_field;
+typedef apds9960_field<APDS9960_CONTROL, 6, 2>  ldrive_field;
+typedef apds9960_field<APDS9960_CONFIG2, 4, 2>  led_boost_field;
+typedef apds9960_field<APDS9960_CONFIG3, 0, 4>  pmask_field;
+typedef apds9960_field<APDS9960_CONFIG3, 4, 1>  sai_field;
+typedef apds9960_field<APDS9960_CONFIG3, 5, 1>  pcmp_field;
+typedef apds9960_field<APDS9960_GPENTH, 0, 8>   gpenth_field;
+typedef apds9960_field<APDS9960_GEXTH, 0, 8>    gexth_field;
+typedef apds9960_field<APDS9960_GCONF2, 0, 3>   gwtime_field;
+typedef apds9960_field<APDS9960_GCONF2, 3, 2>   gldrive_field;
+typedef apds9960_field<APDS9960_GCONF2, 5, 2>   ggain_field;
+typedef apds9960_field<APDS9960_GCONF4, 0, 1>   gmode_field;
+typedef apds9960_field<APDS9960_GCONF4, 1, 1>   gien_field;
+typedef apds9960_field<APDS9960_GCONF4, 2, 1>   gfifo_clr_field;
 
 /* On/Off definitions */
 #define OFF                     0
@@ -210,11 +471,19 @@ typedef struct gesture_data_type
 #define DEFAULT_GCONF3          0       // All photodiodes active during gesture
 #define DEFAULT_GIEN            0       // Disable gesture interrupts
 #define DEFAULT_GLED_BOOST		LED_BOOST_150	// LED_BOOST_300 not working
+#define DEFAULT_HIGHRATE_SNR    10      // Mean/noise for high-rate proximity
+#define DEFAULT_PROX_MARGIN     20      // Enter threshold above the idle level
+#define DEFAULT_PROX_PPERS      2       // 2 consecutive prox out of range for int.
+#define DEFAULT_IDLE_WTIME      245     // 31ms between proximity cycles while unarmed
+#define DEFAULT_ARM_PPERS       1       // 1 prox cycle above threshold arms gesture
+#define DEFAULT_ALS_BAND        10      // ALS tracking band, +/- % of clear
+#define DEFAULT_ALS_APERS       3       // 3 consecutive ALS out of band for int.
 /* APDS9960 Class */
 class APDS9960
 {
 public:
 
+    APDS9960();
     bool init();
     uint8_t getMode();
     uint8_t getID();
@@ -225,85 +494,271 @@ public:
     bool disablePower();
     
     // Enable or disable specific sensors
+#if APDS9960_ALS
     bool enableLightSensor(bool interrupts = false);
     bool disableLightSensor();
+#endif
+#if APDS9960_PROXIMITY
     bool enableProximitySensor(bool interrupts = false);
     bool disableProximitySensor();
+#endif
+#if APDS9960_GESTURE
     bool enableGestureSensor(bool interrupts = true);
     bool disableGestureSensor();
+#endif
     
     // LED drive strength control
+#if APDS9960_PROXIMITY
     uint8_t getLEDDrive();
     bool setLEDDrive(uint8_t drive);
+#endif
+#if APDS9960_GESTURE
     uint8_t getGestureLEDDrive();
     bool setGestureLEDDrive(uint8_t drive);
+#endif
     
     // Gain control
+#if APDS9960_ALS
     uint8_t getAmbientLightGain();
     bool setAmbientLightGain(uint8_t gain);
+#endif
+#if APDS9960_PROXIMITY
     uint8_t getProximityGain();
     bool setProximityGain(uint8_t gain);
+#endif
+#if APDS9960_GESTURE
     uint8_t getGestureGain();
     bool setGestureGain(uint8_t gain);
+#endif
     
+#if APDS9960_ALS && APDS9960_INTERRUPTS
     // Get and set light interrupt thresholds
     bool getLightIntLowThreshold(uint16_t &threshold);
     bool setLightIntLowThreshold(uint16_t threshold);
     bool getLightIntHighThreshold(uint16_t &threshold);
     bool setLightIntHighThreshold(uint16_t threshold);
+    bool setLightIntWindow(uint16_t low, uint16_t high);
+    uint8_t getLightIntPersistence();
+    bool setLightIntPersistence(uint8_t persistence);
+#endif
     
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
     // Get and set proximity interrupt thresholds
     bool getProximityIntLowThreshold(uint8_t &threshold);
     bool setProximityIntLowThreshold(uint8_t threshold);
     bool getProximityIntHighThreshold(uint8_t &threshold);
     bool setProximityIntHighThreshold(uint8_t threshold);
+    uint8_t getProximityIntPersistence();
+    bool setProximityIntPersistence(uint8_t persistence);
+#endif
     
     // Get and set interrupt enables
+#if APDS9960_ALS
     uint8_t getAmbientLightIntEnable();
     bool setAmbientLightIntEnable(uint8_t enable);
+#endif
+#if APDS9960_PROXIMITY
     uint8_t getProximityIntEnable();
     bool setProximityIntEnable(uint8_t enable);
+#endif
+#if APDS9960_GESTURE
     uint8_t getGestureIntEnable();
     bool setGestureIntEnable(uint8_t enable);
+#endif
     
     // Clear interrupts
+#if APDS9960_ALS && APDS9960_INTERRUPTS
     bool clearAmbientLightInt();
+#endif
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
     bool clearProximityInt();
+#endif
     
+#if APDS9960_ALS
     // Ambient light methods
     bool readAmbientLight(uint16_t &val);
     bool readRedLight(uint16_t &val);
     bool readGreenLight(uint16_t &val);
     bool readBlueLight(uint16_t &val);
+    unsigned long nextAlsReadyAt();
+    uint8_t readColorIfNew(uint16_t &clear, uint16_t &red, uint16_t &green,
+                           uint16_t &blue);
+#if APDS9960_INTERRUPTS
+    bool enableLightTracking(uint8_t band = DEFAULT_ALS_BAND,
+                             uint8_t persistence = DEFAULT_ALS_APERS);
+    bool disableLightTracking();
+    uint8_t updateLightTracking(uint16_t &clear);
+#endif
+#endif
     
+#if APDS9960_PROXIMITY
     // Proximity methods
     bool readProximity(uint8_t &val);
+    bool setProximityFilter(uint8_t size, uint8_t ema_shift);
+    bool readProximityFiltered(uint8_t &val);
+#if APDS9960_INTERRUPTS
+    bool enableProximityTracking(uint8_t margin = DEFAULT_PROX_MARGIN,
+                                 uint8_t persistence = DEFAULT_PROX_PPERS);
+    bool disableProximityTracking();
+    uint8_t updateProximityTracking();
+    bool isProximityNear();
+#endif
+#endif
+
+    // Saturation control
+    bool enableSaturationControl(bool interrupts = false);
+    bool disableSaturationControl();
+    uint8_t getSaturation();
+
+#if APDS9960_PROXIMITY
+    // High-rate proximity capture
+    bool enableProximityHighRate(uint8_t min_snr = DEFAULT_HIGHRATE_SNR);
+    bool disableProximityHighRate();
+    uint16_t captureProximity(uint8_t *buf, uint16_t count, uint32_t budget_us = 0);
+    uint16_t getProximityRate();
+#endif
     
+#if APDS9960_GESTURE
     // Gesture methods
     bool isGestureAvailable();
-    int readGesture();
-    
+    int readGesture(uint32_t budget_us = 0);
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
+    bool enableGestureArming(uint8_t margin = DEFAULT_PROX_MARGIN);
+    bool disableGestureArming();
+    int pollArmedGesture(uint32_t budget_us = 0);
+    bool isGestureArmed();
+#endif
+    bool tuneGestureRate(uint16_t target_hz, uint8_t min_signal,
+                         gesture_tuning_type &result);
+#endif
+
+#if APDS9960_STREAMING
+    // Continuous streaming
+    bool startStreaming(uint8_t channels, uint16_t rate_hz,
+                        stream_record_type *buf, uint16_t size);
+    bool stopStreaming();
+    uint16_t serviceStreaming();
+    uint16_t streamAvailable();
+    bool readStream(stream_record_type &record);
+    uint16_t getStreamDropped();
+#endif
+
+    // Power scheduling
+    bool planPower(uint32_t interval_us, uint32_t max_latency_us,
+                   power_plan_type &plan, bool sleep_after_int = false);
+    bool setPowerSchedule(uint32_t interval_us, uint32_t max_latency_us,
+                          power_plan_type &plan, bool sleep_after_int = false);
+    bool getCycleTiming(cycle_timing_type &timing);
+    uint8_t getWaitLong();
+    bool setWaitLong(uint8_t enable);
+    uint8_t getSleepAfterInt();
+    bool setSleepAfterInt(uint8_t enable);
+
+    // I2C transport
+    void setBusClock(uint32_t hz);
+    void setBusRecoveryPins(uint8_t sda, uint8_t scl);
+    bool recoverBus();
+#if APDS9960_DIAGNOSTICS
+    void getI2CStats(i2c_stats_type &stats);
+    void clearI2CStats();
+#endif
+
+    // Asynchronous transport
+    void setAsyncTransport(const i2c_async_type *transport);
+    bool submitTransfer(i2c_transfer_type &xfer);
+    bool isTransferDone(i2c_transfer_type &xfer);
+    int waitTransfer(i2c_transfer_type &xfer);
+
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+    // Gesture capture
+    bool startCapture(uint8_t *buf, uint16_t size);
+    void stopCapture();
+    void getCaptureInfo(capture_info_type &info);
+    void exportCapture(Stream &out);
+#endif
+
+#if DEBUG
+    // Debug trace
+    void dumpTrace(Stream &out);
+    void clearTrace();
+#endif
+
 private:
+#if APDS9960_GESTURE
     // Gesture processing
     void resetGestureParameters();
-    bool processGestureData();
+    int readGestureStep();
+    void processFifoBuffer();
+    void startFifoRead(uint8_t len);
+#if APDS9960_PROXIMITY && APDS9960_INTERRUPTS
+    bool armGestureEngine();
+    bool disarmGestureEngine();
+#endif
+    bool searchGestureRate(uint32_t min_period_us, uint32_t period_us,
+                           uint8_t min_signal, gesture_tuning_type &result);
+    bool measureGesture(gesture_tuning_type &result);
+    bool processGestureData(const gesture_record_t *records);
     void decodeGesture();
+#endif
+
+#if APDS9960_PROXIMITY
+    // Proximity filtering
+    void resetProximityFilter();
+    uint8_t filterProximity(uint8_t sample);
+#endif
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+    // Gesture capture
+    void captureStart();
+    void captureRecord(const gesture_record_t &record);
+    void captureEnd(uint8_t motion);
+    void captureAbort();
+    bool captureWrite(uint8_t val);
+#endif
+#if APDS9960_STREAMING
+    // Streaming
+    uint64_t streamTime(unsigned long us);
+    uint8_t pushStream(uint8_t channel, const uint8_t *data, uint8_t len,
+                       uint64_t time_us);
+#endif
+#if DEBUG
+    // Debug trace
+    void trace(uint8_t id, uint8_t arg, uint32_t data);
+#endif
+    uint32_t getProximityTime(uint8_t ppulse);
+    uint32_t getAlsTime(uint8_t atime);
+    uint32_t getWaitTime(uint8_t wtime, uint8_t config1);
+    uint32_t getGestureTime(uint8_t gpulse, uint8_t gconf2);
+    uint32_t getLEDCurrent(uint32_t period_us);
+#if APDS9960_PROXIMITY
+#if APDS9960_INTERRUPTS
+    bool armProximityThresholds();
+#endif
+    bool updateProximityRange(uint8_t status, uint8_t pdata);
+#endif
+#if APDS9960_ALS
+    bool updateLightRange(uint8_t status, uint16_t clear);
+#endif
 
+#if APDS9960_PROXIMITY
+#if APDS9960_INTERRUPTS
     // Proximity Interrupt Threshold
     uint8_t getProxIntLowThresh();
     bool setProxIntLowThresh(uint8_t threshold);
     uint8_t getProxIntHighThresh();
     bool setProxIntHighThresh(uint8_t threshold);
-    
-    // LED Boost Control
-    uint8_t getLEDBoost();
-    bool setLEDBoost(uint8_t boost);
+#endif
     
     // Proximity photodiode select
     uint8_t getProxGainCompEnable();
     bool setProxGainCompEnable(uint8_t enable);
     uint8_t getProxPhotoMask();
     bool setProxPhotoMask(uint8_t mask);
+#endif
+    
+#if APDS9960_GESTURE
+    // LED Boost Control
+    uint8_t getLEDBoost();
+    bool setLEDBoost(uint8_t boost);
     
     // Gesture threshold control
     uint8_t getGestureEnterThresh();
@@ -318,6 +773,21 @@ private:
     // Gesture mode
     uint8_t getGestureMode();
     bool setGestureMode(uint8_t mode);
+#endif
+
+    // Register fields
+    template <typename F> uint8_t getField()
+        { return readField(F::reg, F::mask, F::shift); }
+    template <typename F> bool setField(uint8_t val)
+        { return writeField(F::reg, F::mask, F::shift, val); }
+    uint8_t readField(uint8_t reg, uint8_t mask, uint8_t shift);
+    bool writeField(uint8_t reg, uint8_t mask, uint8_t shift, uint8_t val);
+
+    // Transfer queue
+    void pollTransfers();
+    void finishTransfer(int result);
+    bool asyncBusy();
+    static void transferDone(void *context, int count);
 
     // Raw I2C Commands
     bool wireWriteByte(uint8_t val);
@@ -325,10 +795,100 @@ private:
     bool wireWriteDataBlock(uint8_t reg, uint8_t *val, unsigned int len);
     bool wireReadDataByte(uint8_t reg, uint8_t &val);
     int wireReadDataBlock(uint8_t reg, uint8_t *val, unsigned int len);
+    bool wireEndTransmission();
+    int wireRequest(uint8_t *val, unsigned int len);
+    void wireFailed();
+
+    // Register shadow
+    void clearShadow();
+    void shadowStore(uint8_t reg, uint8_t val);
+    bool readShadow(uint8_t reg, uint8_t &val);
 
     // Variables
+#if APDS9960_GESTURE
     gesture_data_type gesture_data_;
     int gesture_motion_;
+    bool gesture_active_;
+    unsigned long gesture_next_read_;
+    bool gesture_arming_;
+    bool gesture_armed_;
+    uint8_t arm_led_boost_;         // LED boost before enableGestureArming()
+    uint8_t arm_enable_;            // ENABLE before enableGestureArming()
+    uint8_t gesture_boost_;
+    gesture_record_t fifo_buf_[2][FIFO_READ_RECORDS];
+    uint8_t fifo_fill_;             // buffer the FIFO is read into
+    uint8_t fifo_ready_;            // records waiting in the other buffer
+    i2c_transfer_type fifo_xfer_;
+#endif
+#if APDS9960_PROXIMITY
+    prox_filter_type prox_filter_;
+    uint8_t prox_ppulse_;
+    uint16_t prox_rate_;
+    prox_track_type prox_track_;
+    prox_highrate_type prox_highrate_;
+#endif
+    sat_control_type sat_;
+#if APDS9960_ALS
+    uint8_t als_band_;
+    unsigned long als_next_us_;
+    bool als_synced_;
+    bool als_missed_;
+#endif
+#if APDS9960_STREAMING
+    stream_record_type *stream_buf_;
+    uint16_t stream_size_;
+    uint16_t stream_head_;          // oldest record
+    uint16_t stream_count_;
+    uint16_t stream_dropped_;       // records lost to a full buffer
+    uint8_t stream_channels_;       // STREAM_* captured, 0 when stopped
+    uint32_t stream_poll_us_;       // STATUS/GFLVL poll period
+    uint32_t stream_gesture_us_;    // one gesture dataset
+    unsigned long stream_next_us_;
+    unsigned long stream_last_us_;  // micros() of the last timestamp
+    uint32_t stream_wraps_;         // micros() wraps since startStreaming()
+#endif
+#if APDS9960_GESTURE && APDS9960_CAPTURE
+    uint8_t *capture_buf_;
+    uint16_t capture_size_;
+    uint16_t capture_len_;
+    uint16_t capture_start_;        // length before the open gesture
+    uint16_t capture_head_;         // index of the open gesture's count and motion bytes
+    uint16_t capture_tag_;          // class byte of the open group
+    uint8_t capture_count_;         // datasets in the open gesture
+    gesture_record_t capture_prev_;
+    bool capture_on_;               // startCapture() until stopCapture()
+    bool capture_open_;             // a gesture is being captured
+    uint16_t capture_gestures_;
+    uint16_t capture_dropped_;
+    uint32_t capture_records_;
+    unsigned long capture_ms_;      // millis() of the last stored gesture
+    unsigned long capture_open_ms_; // millis() of the open gesture
+#endif
+    uint8_t shadow_[SHADOW_SIZE];
+    uint8_t shadow_valid_[SHADOW_SIZE / 8];
+#if APDS9960_DIAGNOSTICS
+    i2c_stats_type i2c_stats_;
+#endif
+#if DEBUG
+    trace_event_t trace_buf_[TRACE_SIZE];
+    uint16_t trace_next_;           // slot of the next event
+    uint16_t trace_fill_;           // events kept, at most TRACE_SIZE
+    uint32_t trace_total_;          // events written since clearTrace()
+#endif
+    uint32_t bus_clock_;            // setBusClock(), 0 for the core default
+    uint8_t recovery_sda_;
+    uint8_t recovery_scl_;
+    bool wire_timed_out_;           // last attempt hit the Wire timeout
+    i2c_transfer_type *xfer_head_;  // transfer on the bus, then the queue
+    i2c_transfer_type *xfer_tail_;
+    const i2c_async_type *async_;   // setAsyncTransport(), NULL for Wire only
+    bool xfer_async_;               // head is on the bus in the background
+    bool xfer_expired_;             // and was given up after I2C_TIMEOUT
+    unsigned long xfer_start_;      // micros() when it started
+    volatile int xfer_count_;       // its byte count, set by transferDone()
+
+    // Host benchmark harness (extras/host/bench.cpp)
+    friend class APDS9960Bench;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,67 @@
+/**
+ * APDS9960_config.h
+ *
+ * Build switches of the APDS-9960 driver. Each feature defaults to on; set
+ * it to 0 with a compiler flag (e.g. -DAPDS9960_GESTURE=0 in PlatformIO
+ * build_flags) to leave its code, data and member variables out of the
+ * build. The switches only remove driver code, the sensor engines
+ * themselves are still driven as the remaining features need.
+ */
+
+#ifndef _APDS9960_CONFIG_H_
+#define _APDS9960_CONFIG_H_
+
+// Gesture engine: enableGestureSensor(), readGesture(), FIFO buffer, tuner
+#ifndef APDS9960_GESTURE
+#define APDS9960_GESTURE        1
+#endif
+
+// Ambient light and color: enableLightSensor(), read*Light(), readColorIfNew()
+#ifndef APDS9960_ALS
+#define APDS9960_ALS            1
+#endif
+
+// Proximity: enableProximitySensor(), readProximity(), filter, high-rate capture
+#ifndef APDS9960_PROXIMITY
+#define APDS9960_PROXIMITY      1
+#endif
+
+// Interrupt thresholds and persistence, light and proximity tracking and
+// proximity-armed gestures. Without it the interrupts arguments are ignored
+// and the driver never enables AIEN or PIEN.
+#ifndef APDS9960_INTERRUPTS
+#define APDS9960_INTERRUPTS     1
+#endif
+
+// Continuous capture into a caller buffer: startStreaming(), serviceStreaming()
+#ifndef APDS9960_STREAMING
+#define APDS9960_STREAMING      1
+#endif
+
+// Delta-compressed capture of the gesture FIFO data readGesture() decodes:
+// startCapture(), exportCapture(). Needs APDS9960_GESTURE.
+#ifndef APDS9960_CAPTURE
+#define APDS9960_CAPTURE        1
+#endif
+
+// I2C transaction counters read with getI2CStats()
+#ifndef APDS9960_DIAGNOSTICS
+#define APDS9960_DIAGNOSTICS    1
+#endif
+
+// Debug trace of the gesture engine, see dumpTrace()
+#ifndef DEBUG
+#define DEBUG                   0
+#endif
+
+// Events kept by the debug trace, a power of two. An 80-record gesture
+// takes about 170 events; each instance holds 8 bytes per event.
+#ifndef APDS9960_TRACE_SIZE
+#define APDS9960_TRACE_SIZE     256
+#endif
+
+#if DEBUG && !(APDS9960_GESTURE && APDS9960_DIAGNOSTICS)
+#error "DEBUG needs APDS9960_GESTURE and APDS9960_DIAGNOSTICS"
+#endif
+
+#endif
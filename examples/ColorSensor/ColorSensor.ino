@@ -4,7 +4,8 @@ ColorSensor.ino
 Tests the color and ambient light sensing abilities of the 
 APDS-9960. Configures APDS-9960 over I2C and polls the sensor for
 ambient light and color levels, which are displayed over the 
-serial console.
+serial console. The sensor is set to one result per second and
+each integration is read exactly once.
 
 Distributed as-is; no warranty is given.
 ****************************************************************/
@@ -18,6 +19,7 @@ uint16_t ambient_light = 0;
 uint16_t red_light = 0;
 uint16_t green_light = 0;
 uint16_t blue_light = 0;
+power_plan_type plan;
 
 //-----------------------------------------------------------------------------
 void setup()
@@ -45,19 +47,20 @@ void setup()
     Serial.println(F("Something went wrong during light sensor init!"));
   }
   
-  // Wait for initialization and calibration to finish
-  delay(500);
+  // One ALS result per second
+  if ( !apds.setPowerSchedule(1000000UL, 1000000UL, plan) ) {
+    Serial.println(F("Something went wrong during power schedule setup!"));
+  }
 }
 //-----------------------------------------------------------------------------
 void loop()
 {
-  // Read the light levels (ambient, red, green, blue)
-  if (  !apds.readAmbientLight(ambient_light) ||
-        !apds.readRedLight(red_light) ||
-        !apds.readGreenLight(green_light) ||
-        !apds.readBlueLight(blue_light) ) {
+  // Read the light levels (ambient, red, green, blue) once per integration
+  uint8_t result = apds.readColorIfNew(ambient_light, red_light,
+                                       green_light, blue_light);
+  if ( result == ERROR ) {
     Serial.println("Error reading light values");
-  } else {
+  } else if ( result ) {
     Serial.print("Ambient: ");
     Serial.print(ambient_light);
     Serial.print(" Red: ");
@@ -68,6 +71,6 @@ void loop()
     Serial.println(blue_light);
   }
   
-  // Wait 1 second before next reading
-  delay(1000);
+  // Other work can run here until the next integration is due
+  delay(10);
 }
\ No newline at end of file
@@ -75,6 +75,8 @@ void loop()
 
 			Serial.println();
 #if DEBUG
+			apds.dumpTrace(Serial);
+			apds.clearTrace();
 			Serial.println("********************************");
 #endif
 		}
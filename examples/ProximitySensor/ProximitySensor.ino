@@ -39,6 +39,11 @@ void setup()
     Serial.println(F("Something went wrong trying to set PGAIN"));
   }
 
+  // Smooth readings: median of the last 5 samples, then a 1/4 weight EMA
+  if ( !apds.setProximityFilter(5, 2) ) {
+    Serial.println(F("Something went wrong trying to set the filter"));
+  }
+
   // Start running the APDS-9960 proximity sensor (no interrupts)
   if ( apds.enableProximitySensor(false) ) {
     Serial.println(F("Proximity sensor is now running...\n"));
@@ -49,8 +54,8 @@ void setup()
 //-----------------------------------------------------------------------------
 void loop()
 {
-  // Read the proximity value
-  if ( !apds.readProximity(proximity_data) ) {
+  // Read the filtered proximity value
+  if ( !apds.readProximityFiltered(proximity_data) ) {
     Serial.println("Error reading proximity value");
   } else {
     Serial.print("Proximity: ");
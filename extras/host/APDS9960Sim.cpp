@@ -0,0 +1,711 @@
+/**
+ * APDS9960Sim.cpp
+ *
+ * Host model of the APDS-9960, see APDS9960Sim.h.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "APDS9960Sim.h"
+#include "../../APDS9960.h"
+
+/* Register bits not named by the driver */
+#define SIM_WLONG               0x02    // CONFIG1
+#define SIM_PSIEN               0x80    // CONFIG2
+#define SIM_CPSIEN              0x40    // CONFIG2
+#define SIM_SAI                 0x10    // CONFIG3
+#define SIM_GFIFO_CLR           0x04    // GCONF4
+#define SIM_GIEN                0x02    // GCONF4
+#define SIM_GMODE               0x01    // GCONF4
+#define SIM_CPSAT               0x80    // STATUS
+#define SIM_PGSAT               0x40    // STATUS
+#define SIM_PINT                0x20    // STATUS
+#define SIM_AINT                0x10    // STATUS
+#define SIM_GINT                0x04    // STATUS
+#define SIM_PVALID              0x02    // STATUS
+#define SIM_AVALID              0x01    // STATUS
+#define SIM_GFOV                0x02    // GSTATUS
+
+/* Timing model (us) */
+#define SIM_INIT_US             5700    // PON to first cycle
+#define SIM_PROX_OVERHEAD_US    700     // proximity ADC conversion
+#define SIM_GESTURE_OVERHEAD_US 700     // two gesture ADC conversions
+#define SIM_STEP_US             2780    // ATIME/WTIME step
+
+static const uint32_t gwtime_us[8] = {
+    0, 2800, 5600, 8400, 14000, 22400, 30800, 39200
+};
+
+static const uint64_t NEVER = ~(uint64_t)0;
+
+/*******************************************************************************
+ * Trajectory
+ ******************************************************************************/
+
+Trajectory::Trajectory()
+{
+}
+
+Trajectory &Trajectory::at(uint64_t t_us, const sim_target_t &target)
+{
+    keyframe_t frame = { t_us, target };
+    frames_.push_back(frame);
+    return *this;
+}
+
+Trajectory &Trajectory::append(const Trajectory &other)
+{
+    frames_.insert(frames_.end(), other.frames_.begin(), other.frames_.end());
+    return *this;
+}
+
+sim_target_t Trajectory::sample(uint64_t t_us) const
+{
+    if( frames_.empty() ) {
+        sim_target_t none = sim_target_t();
+        return none;
+    }
+    if( t_us <= frames_.front().t_us ) {
+        return frames_.front().target;
+    }
+    for (size_t i = 1; i < frames_.size(); i++) {
+        const keyframe_t &a = frames_[i - 1];
+        const keyframe_t &b = frames_[i];
+        if( t_us < b.t_us ) {
+            float k = (float)(t_us - a.t_us) / (float)(b.t_us - a.t_us);
+            const float *pa = &a.target.prox;
+            const float *pb = &b.target.prox;
+            sim_target_t out;
+            float *po = &out.prox;
+            for (size_t j = 0; j < sizeof(sim_target_t) / sizeof(float); j++) {
+                po[j] = pa[j] + (pb[j] - pa[j]) * k;
+            }
+            return out;
+        }
+    }
+
+    return frames_.back().target;
+}
+
+uint64_t Trajectory::end() const
+{
+    return frames_.empty() ? 0 : frames_.back().t_us;
+}
+
+Trajectory Trajectory::swipe(uint64_t start_us, uint64_t duration_us,
+                             sim_swipe_t direction, float peak,
+                             const sim_target_t &ambient)
+{
+    Trajectory tr;
+    uint64_t step = duration_us / 4;
+    sim_target_t t = ambient;
+
+    /* Four keyframes: leading edge, centered, trailing edge, gone */
+    tr.at(start_us, t);
+    float first[4] = { 0 };
+    float second[4] = { 0 };
+    int a = 0;
+    int b = 1;
+    switch( direction ) {
+    case SWIPE_U_TO_D: a = 0; b = 1; break;
+    case SWIPE_D_TO_U: a = 1; b = 0; break;
+    case SWIPE_L_TO_R: a = 2; b = 3; break;
+    case SWIPE_R_TO_L: a = 3; b = 2; break;
+    }
+    first[a] = peak;
+    first[b] = peak / 4;
+    second[a] = peak / 4;
+    second[b] = peak;
+
+    float *ch = &t.u;
+    for (int i = 0; i < 4; i++) {
+        ch[i] = ambient.u + (i == a || i == b ? first[i] : peak / 2);
+    }
+    t.prox = ambient.prox + peak * 0.8f;
+    tr.at(start_us + step, t);
+
+    for (int i = 0; i < 4; i++) {
+        ch[i] = ambient.u + peak;
+    }
+    t.prox = ambient.prox + peak;
+    tr.at(start_us + 2 * step, t);
+
+    for (int i = 0; i < 4; i++) {
+        ch[i] = ambient.u + (i == a || i == b ? second[i] : peak / 2);
+    }
+    t.prox = ambient.prox + peak * 0.8f;
+    tr.at(start_us + 3 * step, t);
+
+    tr.at(start_us + duration_us, ambient);
+
+    return tr;
+}
+
+Trajectory Trajectory::hover(uint64_t start_us, uint64_t duration_us,
+                             float peak, const sim_target_t &ambient)
+{
+    Trajectory tr;
+    sim_target_t t = ambient;
+    uint64_t ramp = duration_us / 8;
+
+    tr.at(start_us, t);
+    t.prox += peak;
+    t.u += peak;
+    t.d += peak;
+    t.l += peak;
+    t.r += peak;
+    tr.at(start_us + ramp, t);
+    tr.at(start_us + duration_us - ramp, t);
+    tr.at(start_us + duration_us, ambient);
+
+    return tr;
+}
+
+/*******************************************************************************
+ * Device model
+ ******************************************************************************/
+
+APDS9960Sim::APDS9960Sim()
+    : ptr_(0), latch_(0), latch_addr_(0), fifo_head_(0), fifo_len_(0),
+      gesture_exit_count_(0), prox_pers_count_(0), als_pers_count_(0),
+      pint_(false), aint_(false), sai_sleep_(false),
+      phase_(PHASE_SLEEP), phase_start_us_(0), phase_end_us_(NEVER),
+      now_us_(0), noise_(0), rng_(1), stats_()
+{
+    memset(regs_, 0, sizeof(regs_));
+    memset(fifo_, 0, sizeof(fifo_));
+    regs_[APDS9960_ID] = 0xAB;
+    regs_[APDS9960_CONFIG1] = 0x40;
+    regs_[APDS9960_CONFIG2] = 0x01;
+    regs_[APDS9960_ATIME] = 0xFF;
+    regs_[APDS9960_WTIME] = 0xFF;
+    regs_[APDS9960_PPULSE] = 0x40;
+    regs_[APDS9960_GPULSE] = 0x40;
+    now_us_ = host::nowMicros();
+}
+
+void APDS9960Sim::attach()
+{
+    host::attachDevice(APDS9960_I2C_ADDR, this);
+}
+
+void APDS9960Sim::setTrajectory(const Trajectory &trajectory)
+{
+    trajectory_ = trajectory;
+}
+
+void APDS9960Sim::setNoise(float counts, uint32_t seed)
+{
+    noise_ = counts;
+    rng_ = seed ? seed : 1;
+}
+
+/*******************************************************************************
+ * Timing
+ ******************************************************************************/
+
+uint32_t APDS9960Sim::initTime() const
+{
+    return SIM_INIT_US;
+}
+
+uint32_t APDS9960Sim::proxTime() const
+{
+    uint8_t ppulse = regs_[APDS9960_PPULSE];
+    uint32_t pulses = (ppulse & 0x3F) + 1;
+    uint32_t len = 4 << (ppulse >> 6);
+
+    return SIM_PROX_OVERHEAD_US + 2 * pulses * len;
+}
+
+uint32_t APDS9960Sim::gestureTime() const
+{
+    uint8_t gpulse = regs_[APDS9960_GPULSE];
+    uint32_t pulses = (gpulse & 0x3F) + 1;
+    uint32_t len = 4 << (gpulse >> 6);
+
+    /* U/D and L/R pairs are pulsed in turn, then GWTIME */
+    return SIM_GESTURE_OVERHEAD_US + 2 * (2 * pulses * len) +
+           gwtime_us[regs_[APDS9960_GCONF2] & 0x07];
+}
+
+uint32_t APDS9960Sim::waitTime() const
+{
+    uint32_t t = (256 - regs_[APDS9960_WTIME]) * SIM_STEP_US;
+
+    return (regs_[APDS9960_CONFIG1] & SIM_WLONG) ? t * 12 : t;
+}
+
+uint32_t APDS9960Sim::alsTime() const
+{
+    return (256 - regs_[APDS9960_ATIME]) * SIM_STEP_US;
+}
+
+/*******************************************************************************
+ * State machine
+ ******************************************************************************/
+
+void APDS9960Sim::update()
+{
+    uint64_t now = host::nowMicros();
+
+    while( phase_end_us_ <= now ) {
+        endPhase();
+    }
+    now_us_ = now;
+}
+
+void APDS9960Sim::startPhase(phase_t phase, uint64_t t)
+{
+    phase_ = phase;
+    phase_start_us_ = t;
+
+    switch( phase ) {
+    case PHASE_INIT:    phase_end_us_ = t + initTime(); break;
+    case PHASE_PROX:    phase_end_us_ = t + proxTime(); break;
+    case PHASE_GESTURE: phase_end_us_ = t + gestureTime(); break;
+    case PHASE_WAIT:    phase_end_us_ = t + waitTime(); break;
+    case PHASE_ALS:     phase_end_us_ = t + alsTime(); break;
+    default:            phase_end_us_ = NEVER; break;
+    }
+}
+
+/* Enter the first enabled phase at or after 'from' in cycle order */
+void APDS9960Sim::startCycle(phase_t from, uint64_t t)
+{
+    uint8_t enable = regs_[APDS9960_ENABLE];
+    static const phase_t order[4] = {
+        PHASE_PROX, PHASE_GESTURE, PHASE_WAIT, PHASE_ALS
+    };
+    int first = 0;
+
+    while( order[first] != from ) {
+        first++;
+    }
+    for (int n = 0; n < 4; n++) {
+        int i = (first + n) % 4;
+        if( i == 0 && n > 0 && sleepAfterInterrupt(t) ) {
+            return;
+        }
+        bool on = false;
+        switch( order[i] ) {
+        case PHASE_PROX:
+            on = enable & APDS9960_PEN;
+            break;
+        case PHASE_GESTURE:
+            on = (enable & APDS9960_GEN) && (regs_[APDS9960_GCONF4] & SIM_GMODE);
+            break;
+        case PHASE_WAIT:
+            on = enable & APDS9960_WEN;
+            break;
+        case PHASE_ALS:
+            on = enable & APDS9960_AEN;
+            break;
+        default:
+            break;
+        }
+        if( on ) {
+            startPhase(order[i], t);
+            return;
+        }
+    }
+
+    /* Nothing enabled */
+    startPhase(PHASE_IDLE, t);
+}
+
+/* End of cycle: sleep after interrupt decision block */
+bool APDS9960Sim::sleepAfterInterrupt(uint64_t t)
+{
+    if( (regs_[APDS9960_CONFIG3] & SIM_SAI) && intAsserted() ) {
+        sai_sleep_ = true;
+        startPhase(PHASE_IDLE, t);
+        return true;
+    }
+
+    return false;
+}
+
+void APDS9960Sim::endPhase()
+{
+    uint64_t t = phase_end_us_;
+
+    switch( phase_ ) {
+    case PHASE_INIT:
+        startCycle(PHASE_PROX, t);
+        break;
+    case PHASE_PROX:
+        endProx();
+        startCycle(PHASE_GESTURE, t);
+        break;
+    case PHASE_GESTURE:
+        endGestureDataset();
+        if( regs_[APDS9960_GCONF4] & SIM_GMODE ) {
+            startPhase(PHASE_GESTURE, t);
+        } else {
+            startCycle(PHASE_WAIT, t);
+        }
+        break;
+    case PHASE_WAIT:
+        startCycle(PHASE_ALS, t);
+        break;
+    case PHASE_ALS:
+        endAls();
+        if( !sleepAfterInterrupt(t) ) {
+            startCycle(PHASE_PROX, t);
+        }
+        break;
+    default:
+        phase_end_us_ = NEVER;
+        break;
+    }
+}
+
+float APDS9960Sim::ledScale(uint8_t drive, uint8_t pulse_reg) const
+{
+    static const float boost[4] = { 1.0f, 1.5f, 2.0f, 3.0f };
+    float current = 1.0f / (1 << (drive & 0x03));
+    float pulses = (pulse_reg & 0x3F) + 1;
+    float len = 4 << (pulse_reg >> 6);
+
+    return current * boost[(regs_[APDS9960_CONFIG2] >> 4) & 0x03] * pulses * len;
+}
+
+uint8_t APDS9960Sim::noisy(float counts)
+{
+    if( noise_ > 0 ) {
+        rng_ = rng_ * 1103515245UL + 12345UL;
+        float u = (float)((rng_ >> 8) & 0xFFFF) / 65535.0f - 0.5f;
+        counts += u * noise_;
+    }
+    if( counts < 0 ) {
+        return 0;
+    }
+    if( counts > 255 ) {
+        return 255;
+    }
+
+    return (uint8_t)(counts + 0.5f);
+}
+
+void APDS9960Sim::endProx()
+{
+    sim_target_t t = trajectory_.sample(phase_end_us_);
+    uint8_t control = regs_[APDS9960_CONTROL];
+    float gain = 1 << ((control >> 2) & 0x03);
+    float raw = t.prox * gain * ledScale(control >> 6, regs_[APDS9960_PPULSE]);
+    uint8_t pdata = noisy(raw);
+
+    regs_[APDS9960_PDATA] = pdata;
+    regs_[APDS9960_STATUS] |= SIM_PVALID;
+    if( raw >= 255 ) {
+        regs_[APDS9960_STATUS] |= SIM_PGSAT;
+    }
+    stats_.prox_cycles++;
+
+    /* Proximity interrupt with PPERS persistence */
+    if( pdata < regs_[APDS9960_PILT] || pdata > regs_[APDS9960_PIHT] ) {
+        uint8_t pers = regs_[APDS9960_PERS] >> 4;
+        if( ++prox_pers_count_ >= (pers ? pers : 1) ) {
+            prox_pers_count_ = 0;
+            if( regs_[APDS9960_ENABLE] & APDS9960_PIEN ) {
+                pint_ = true;
+            }
+        }
+    } else {
+        prox_pers_count_ = 0;
+    }
+
+    /* Gesture entry */
+    if( (regs_[APDS9960_ENABLE] & APDS9960_GEN) &&
+        !(regs_[APDS9960_GCONF4] & SIM_GMODE) &&
+        pdata >= regs_[APDS9960_GPENTH] ) {
+        regs_[APDS9960_GCONF4] |= SIM_GMODE;
+        gesture_exit_count_ = 0;
+        stats_.gesture_entries++;
+    }
+    updateInterrupts();
+}
+
+void APDS9960Sim::endGestureDataset()
+{
+    static const uint8_t fifo_thresholds[4] = { 1, 4, 8, 16 };
+    static const uint8_t exit_persistence[4] = { 1, 2, 4, 7 };
+    sim_target_t t = trajectory_.sample(phase_end_us_);
+    uint8_t gconf2 = regs_[APDS9960_GCONF2];
+    uint8_t gconf1 = regs_[APDS9960_GCONF1];
+    float scale = (1 << ((gconf2 >> 5) & 0x03)) *
+                  ledScale(gconf2 >> 3, regs_[APDS9960_GPULSE]);
+    const float *ch = &t.u;
+    uint8_t dataset[4];
+
+    for (int i = 0; i < 4; i++) {
+        dataset[i] = noisy(ch[i] * scale);
+    }
+    stats_.gesture_datasets++;
+
+    if( fifo_len_ >= 32 ) {
+        regs_[APDS9960_GSTATUS] |= SIM_GFOV;
+        stats_.fifo_overflows++;
+    } else {
+        memcpy(fifo_[(fifo_head_ + fifo_len_) & 31], dataset, 4);
+        fifo_len_++;
+    }
+    if( fifo_len_ >= fifo_thresholds[gconf1 >> 6] ) {
+        regs_[APDS9960_GSTATUS] |= APDS9960_GVALID;
+    }
+
+    /* Exit when every unmasked channel stays below GEXTH */
+    uint8_t mask = (gconf1 >> 2) & 0x0F;
+    bool below = true;
+    for (int i = 0; i < 4; i++) {
+        if( !(mask & (0x08 >> i)) && dataset[i] >= regs_[APDS9960_GEXTH] ) {
+            below = false;
+        }
+    }
+    if( below ) {
+        if( ++gesture_exit_count_ >= exit_persistence[gconf1 & 0x03] ) {
+            regs_[APDS9960_GCONF4] &= ~SIM_GMODE;
+            gesture_exit_count_ = 0;
+        }
+    } else {
+        gesture_exit_count_ = 0;
+    }
+    updateInterrupts();
+}
+
+void APDS9960Sim::endAls()
+{
+    static const float again[4] = { 1, 4, 16, 64 };
+    sim_target_t t = trajectory_.sample(phase_end_us_);
+    float ms = alsTime() / 1000.0f;
+    float gain = again[regs_[APDS9960_CONTROL] & 0x03];
+    uint32_t cycles = 256 - regs_[APDS9960_ATIME];
+    uint32_t max = cycles * 1025 > 65535 ? 65535 : cycles * 1025;
+    const float *ch = &t.clear;
+    uint16_t counts[4];
+
+    for (int i = 0; i < 4; i++) {
+        float c = ch[i] * gain * ms;
+        if( noise_ > 0 ) {
+            c += ((float)noisy(128) - 128.0f);
+        }
+        counts[i] = c <= 0 ? 0 : (c >= max ? max : (uint16_t)c);
+        regs_[APDS9960_CDATAL + 2 * i] = counts[i] & 0xFF;
+        regs_[APDS9960_CDATAH + 2 * i] = counts[i] >> 8;
+    }
+    regs_[APDS9960_STATUS] |= SIM_AVALID;
+    if( counts[0] >= max ) {
+        regs_[APDS9960_STATUS] |= SIM_CPSAT;
+    }
+    stats_.als_cycles++;
+
+    /* ALS interrupt with APERS persistence: 0, 1, 2, 3, 5, 10, ... 60 */
+    uint16_t ailt = regs_[APDS9960_AILTL] | (regs_[APDS9960_AILTH] << 8);
+    uint16_t aiht = regs_[APDS9960_AIHTL] | (regs_[APDS9960_AIHTH] << 8);
+    if( counts[0] < ailt || counts[0] > aiht ) {
+        uint8_t apers = regs_[APDS9960_PERS] & 0x0F;
+        uint8_t needed = apers <= 3 ? (apers ? apers : 1) : 5 * (apers - 3);
+        if( ++als_pers_count_ >= needed ) {
+            als_pers_count_ = 0;
+            if( regs_[APDS9960_ENABLE] & APSD9960_AIEN ) {
+                aint_ = true;
+            }
+        }
+    } else {
+        als_pers_count_ = 0;
+    }
+    updateInterrupts();
+}
+
+void APDS9960Sim::updateInterrupts()
+{
+    uint8_t status = regs_[APDS9960_STATUS] & ~(SIM_PINT | SIM_AINT | SIM_GINT);
+
+    if( pint_ ) status |= SIM_PINT;
+    if( aint_ ) status |= SIM_AINT;
+    if( (regs_[APDS9960_GCONF4] & SIM_GIEN) &&
+        (regs_[APDS9960_GSTATUS] & APDS9960_GVALID) ) {
+        status |= SIM_GINT;
+    }
+    regs_[APDS9960_STATUS] = status;
+
+    /* Sleep after interrupt ends when the interrupt is cleared */
+    if( sai_sleep_ && !intAsserted() ) {
+        sai_sleep_ = false;
+        startCycle(PHASE_PROX, now_us_ > phase_start_us_ ? now_us_ : phase_start_us_);
+    }
+}
+
+int APDS9960Sim::intPin()
+{
+    update();
+
+    return intAsserted() ? LOW : HIGH;
+}
+
+bool APDS9960Sim::intAsserted() const
+{
+    uint8_t status = regs_[APDS9960_STATUS];
+    uint8_t config2 = regs_[APDS9960_CONFIG2];
+
+    return (status & (SIM_PINT | SIM_AINT | SIM_GINT)) ||
+           ((config2 & SIM_PSIEN) && (status & SIM_PGSAT)) ||
+           ((config2 & SIM_CPSIEN) && (status & SIM_CPSAT));
+}
+
+void APDS9960Sim::onEnableChanged(uint8_t old_val)
+{
+    uint8_t val = regs_[APDS9960_ENABLE];
+
+    if( !(val & APDS9960_PON) ) {
+        startPhase(PHASE_SLEEP, now_us_);
+        return;
+    }
+    if( !(old_val & APDS9960_PON) ) {
+        startPhase(PHASE_INIT, now_us_);
+        return;
+    }
+    if( !(val & APDS9960_GEN) ) {
+        regs_[APDS9960_GCONF4] &= ~SIM_GMODE;
+    }
+    if( phase_ == PHASE_IDLE && !sai_sleep_ ) {
+        startCycle(PHASE_PROX, now_us_);
+    }
+}
+
+/*******************************************************************************
+ * Register access
+ ******************************************************************************/
+
+void APDS9960Sim::writeReg(uint8_t addr, uint8_t val)
+{
+    uint8_t old_val = regs_[addr];
+
+    switch( addr ) {
+    case APDS9960_ID:
+    case APDS9960_STATUS:
+    case APDS9960_GFLVL:
+    case APDS9960_GSTATUS:
+        return;
+    case APDS9960_ENABLE:
+        regs_[addr] = val & 0x7F;
+        onEnableChanged(old_val);
+        return;
+    case APDS9960_GCONF4:
+        if( val & SIM_GFIFO_CLR ) {
+            fifo_len_ = 0;
+            regs_[APDS9960_GSTATUS] = 0;
+        }
+        regs_[addr] = val & (SIM_GIEN | SIM_GMODE);
+        if( (regs_[addr] & SIM_GMODE) && !(old_val & SIM_GMODE) ) {
+            gesture_exit_count_ = 0;
+        }
+        updateInterrupts();
+        if( phase_ == PHASE_IDLE && !sai_sleep_ && (regs_[APDS9960_ENABLE] & APDS9960_PON) ) {
+            startCycle(PHASE_PROX, now_us_);
+        }
+        return;
+    default:
+        break;
+    }
+    if( addr >= APDS9960_CDATAL && addr <= APDS9960_PDATA ) {
+        return;
+    }
+    if( addr >= APDS9960_GFIFO_U ) {
+        return;
+    }
+    regs_[addr] = val;
+}
+
+uint8_t APDS9960Sim::readReg(uint8_t addr)
+{
+    uint8_t val = regs_[addr];
+
+    if( addr >= APDS9960_CDATAL && addr <= APDS9960_BDATAH ) {
+        /* Reading the low byte latches the high byte */
+        if( (addr & 1) == 0 ) {
+            latch_ = regs_[addr + 1];
+            latch_addr_ = addr + 1;
+        } else if( latch_addr_ == addr ) {
+            val = latch_;
+            latch_addr_ = 0;
+        }
+        regs_[APDS9960_STATUS] &= ~SIM_AVALID;
+    } else if( addr == APDS9960_PDATA ) {
+        regs_[APDS9960_STATUS] &= ~SIM_PVALID;
+    } else if( addr == APDS9960_GFLVL ) {
+        val = fifo_len_;
+    } else if( addr >= APDS9960_GFIFO_U ) {
+        val = fifo_len_ ? fifo_[fifo_head_][addr - APDS9960_GFIFO_U] : 0;
+        if( addr == APDS9960_GFIFO_R && fifo_len_ ) {
+            fifo_head_ = (fifo_head_ + 1) & 31;
+            fifo_len_--;
+            stats_.fifo_reads++;
+            if( fifo_len_ == 0 ) {
+                regs_[APDS9960_GSTATUS] &= ~APDS9960_GVALID;
+                updateInterrupts();
+            }
+        }
+    }
+
+    return val;
+}
+
+bool APDS9960Sim::write(const uint8_t *data, size_t len)
+{
+    update();
+    if( len == 0 ) {
+        return true;
+    }
+    ptr_ = data[0];
+
+    /* Address-only accesses to the special registers act on interrupts */
+    switch( ptr_ ) {
+    case APDS9960_IFORCE:
+        if( regs_[APDS9960_ENABLE] & APDS9960_PIEN ) pint_ = true;
+        if( regs_[APDS9960_ENABLE] & APSD9960_AIEN ) aint_ = true;
+        updateInterrupts();
+        return true;
+    case APDS9960_PICLEAR:
+        pint_ = false;
+        regs_[APDS9960_STATUS] &= ~SIM_PGSAT;
+        updateInterrupts();
+        return true;
+    case APDS9960_CICLEAR:
+        pint_ = false;
+        aint_ = false;
+        regs_[APDS9960_STATUS] &= ~(SIM_PGSAT | SIM_CPSAT);
+        updateInterrupts();
+        return true;
+    case APDS9960_AICLEAR:
+        aint_ = false;
+        updateInterrupts();
+        return true;
+    default:
+        break;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        writeReg(ptr_++, data[i]);
+    }
+
+    return true;
+}
+
+size_t APDS9960Sim::read(uint8_t *data, size_t len)
+{
+    update();
+    for (size_t i = 0; i < len; i++) {
+        uint8_t addr = ptr_;
+        data[i] = readReg(addr);
+        if( addr == APDS9960_GFIFO_R ) {
+            ptr_ = APDS9960_GFIFO_U;
+        } else {
+            ptr_++;
+        }
+    }
+
+    return len;
+}
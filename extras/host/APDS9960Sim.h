@@ -0,0 +1,175 @@
+/**
+ * APDS9960Sim.h
+ *
+ * Host model of the APDS-9960 for running the driver on Linux in
+ * deterministic virtual time. It plugs in under the Wire shim, so the
+ * driver's wire* helpers, readGesture() and friends run unmodified.
+ *
+ * Modelled:
+ *  - register file with auto-increment, read-only registers, interrupt
+ *    clear addresses and the gesture FIFO window at 0xFC-0xFF
+ *  - ENABLE state machine: init, proximity, gesture loop, wait, ALS
+ *  - cycle times derived from PPULSE, GPULSE, GWTIME, WTIME/WLONG, ATIME
+ *  - PVALID/AVALID/GVALID, FIFO level, threshold and overflow (GFOV)
+ *  - gesture entry on GPENTH or GMODE, exit on GEXTH/GEXMSK/GEXPERS
+ *  - PINT/AINT with persistence, GINT, saturation flags, SAI
+ *
+ * The scene in front of the sensor is described by a Trajectory of
+ * keyframes that are linearly interpolated in time.
+ */
+
+#ifndef _APDS9960_SIM_H_
+#define _APDS9960_SIM_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "host.h"
+
+/* Scene seen by the sensor at one instant */
+typedef struct sim_target_t
+{
+    float prox;         // proximity reflectance, counts per pulse-us at 1x/100 mA
+    float u, d, l, r;   // same for the gesture photodiodes
+    float clear;        // ambient light, counts per ms of integration at 1x
+    float red;
+    float green;
+    float blue;
+} sim_target_t;
+
+/* Swipe directions, by which photodiode sees the object first */
+enum sim_swipe_t
+{
+    SWIPE_U_TO_D,
+    SWIPE_D_TO_U,
+    SWIPE_L_TO_R,
+    SWIPE_R_TO_L
+};
+
+class Trajectory
+{
+public:
+    Trajectory();
+
+    // Add a keyframe, times must be increasing
+    Trajectory &at(uint64_t t_us, const sim_target_t &target);
+    // Append the keyframes of a later trajectory
+    Trajectory &append(const Trajectory &other);
+    // Target at time t, held constant outside the keyframes
+    sim_target_t sample(uint64_t t_us) const;
+    uint64_t end() const;
+
+    // Object entering, crossing and leaving the field of view
+    static Trajectory swipe(uint64_t start_us, uint64_t duration_us,
+                            sim_swipe_t direction, float peak,
+                            const sim_target_t &ambient);
+    // Object approaching, hovering and leaving straight on
+    static Trajectory hover(uint64_t start_us, uint64_t duration_us,
+                            float peak, const sim_target_t &ambient);
+
+private:
+    struct keyframe_t
+    {
+        uint64_t t_us;
+        sim_target_t target;
+    };
+    std::vector<keyframe_t> frames_;
+};
+
+/* Counters for checking the driver against the model */
+typedef struct sim_stats_t
+{
+    uint32_t prox_cycles;
+    uint32_t als_cycles;
+    uint32_t gesture_datasets;
+    uint32_t gesture_entries;
+    uint32_t fifo_overflows;    // datasets dropped on a full FIFO
+    uint32_t fifo_reads;        // datasets read by the host
+} sim_stats_t;
+
+class APDS9960Sim : public host::I2CDevice
+{
+public:
+    APDS9960Sim();
+
+    // Attach to the host bus at the APDS-9960 address
+    void attach();
+
+    void setTrajectory(const Trajectory &trajectory);
+    // Peak-to-peak amplitude of the deterministic noise added to counts
+    void setNoise(float counts, uint32_t seed = 1);
+
+    // I2C device
+    bool write(const uint8_t *data, size_t len);
+    size_t read(uint8_t *data, size_t len);
+
+    // Bring the model up to the current host time
+    void update();
+
+    // INT pin level, LOW when an interrupt is asserted
+    int intPin();
+    uint8_t reg(uint8_t addr) const { return regs_[addr]; }
+    uint8_t fifoLevel() const { return fifo_len_; }
+    bool inGestureLoop() const { return (regs_[0xAB] & 0x01) != 0; }
+    const sim_stats_t &stats() const { return stats_; }
+
+    // Cycle timing of the current configuration (us)
+    uint32_t initTime() const;
+    uint32_t proxTime() const;
+    uint32_t gestureTime() const;
+    uint32_t waitTime() const;
+    uint32_t alsTime() const;
+
+private:
+    enum phase_t
+    {
+        PHASE_SLEEP,
+        PHASE_INIT,
+        PHASE_IDLE,
+        PHASE_PROX,
+        PHASE_GESTURE,
+        PHASE_WAIT,
+        PHASE_ALS
+    };
+
+    void writeReg(uint8_t addr, uint8_t val);
+    uint8_t readReg(uint8_t addr);
+    void onEnableChanged(uint8_t old_val);
+    void startPhase(phase_t phase, uint64_t t);
+    void startCycle(phase_t from, uint64_t t);
+    void endPhase();
+    bool sleepAfterInterrupt(uint64_t t);
+    bool intAsserted() const;
+    void endProx();
+    void endGestureDataset();
+    void endAls();
+    void updateInterrupts();
+    uint8_t noisy(float counts);
+    float ledScale(uint8_t drive, uint8_t pulse_reg) const;
+
+    uint8_t regs_[256];
+    uint8_t ptr_;
+    uint8_t latch_;                 // high byte latched on low byte read
+    uint8_t latch_addr_;
+    uint8_t fifo_[32][4];
+    uint8_t fifo_head_;
+    uint8_t fifo_len_;
+    uint8_t gesture_exit_count_;
+    uint8_t prox_pers_count_;
+    uint8_t als_pers_count_;
+    bool pint_;
+    bool aint_;
+    bool sai_sleep_;
+
+    phase_t phase_;
+    uint64_t phase_start_us_;
+    uint64_t phase_end_us_;
+    uint64_t now_us_;
+
+    Trajectory trajectory_;
+    float noise_;
+    uint32_t rng_;
+    sim_stats_t stats_;
+};
+
+#endif
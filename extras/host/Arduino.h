@@ -0,0 +1,82 @@
+/**
+ * Arduino.h
+ *
+ * Minimal Arduino core for building the driver and its examples on a
+ * Linux host. Only what the library uses is provided.
+ */
+
+#ifndef _APDS9960_HOST_ARDUINO_H_
+#define _APDS9960_HOST_ARDUINO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define LED_BUILTIN     13
+
+#define DEC             10
+#define HEX             16
+
+#define F(s)            (s)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t len);
+
+    size_t write(const char *str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned long val, int base = DEC);
+    size_t print(long val, int base = DEC);
+    size_t print(unsigned int val, int base = DEC) { return print((unsigned long)val, base); }
+    size_t print(int val, int base = DEC) { return print((long)val, base); }
+    size_t print(unsigned char val, int base = DEC) { return print((unsigned long)val, base); }
+    size_t print(double val, int digits = 2);
+
+    size_t println() { return write('\n'); }
+    template<typename T> size_t println(T val) { return print(val) + println(); }
+    template<typename T> size_t println(T val, int fmt) { return print(val, fmt) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    operator bool() const { return true; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
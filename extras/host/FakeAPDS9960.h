@@ -0,0 +1,96 @@
+/**
+ * FakeAPDS9960.h
+ *
+ * Register-file stand-in for the APDS-9960: auto-incrementing register
+ * pointer, ID register and a gesture FIFO preloaded by the caller.
+ * There is no timing; see APDS9960Sim.h for a device model.
+ */
+
+#ifndef _APDS9960_FAKE_H_
+#define _APDS9960_FAKE_H_
+
+#include <string.h>
+
+#include "host.h"
+#include "../../APDS9960.h"
+
+class FakeAPDS9960 : public host::I2CDevice
+{
+public:
+    FakeAPDS9960() : ptr_(0), fifo_head_(0), fifo_len_(0)
+    {
+        memset(regs_, 0, sizeof(regs_));
+        regs_[APDS9960_ID] = 0xAB;
+    }
+
+    bool write(const uint8_t *data, size_t len)
+    {
+        if( len == 0 ) {
+            return true;
+        }
+        ptr_ = data[0];
+        for (size_t i = 1; i < len; i++) {
+            regs_[ptr_++] = data[i];
+        }
+        return true;
+    }
+
+    size_t read(uint8_t *data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++) {
+            data[i] = readReg();
+        }
+        return len;
+    }
+
+    // Queue gesture datasets (U, D, L, R), GVALID stays set until drained
+    void loadFifo(const gesture_record_t *records, size_t count)
+    {
+        fifo_head_ = 0;
+        fifo_len_ = count < MAX_FIFO ? count : MAX_FIFO;
+        memcpy(fifo_, records, fifo_len_ * sizeof(gesture_record_t));
+    }
+
+    uint8_t reg(uint8_t addr) const { return regs_[addr]; }
+    void setReg(uint8_t addr, uint8_t val) { regs_[addr] = val; }
+
+private:
+    static const size_t MAX_FIFO = 256;
+
+    uint8_t readReg()
+    {
+        uint8_t addr = ptr_;
+        uint8_t val;
+
+        if( addr == APDS9960_GFLVL ) {
+            val = fifo_len_ > 32 ? 32 : (uint8_t)fifo_len_;
+        } else if( addr == APDS9960_GSTATUS ) {
+            val = fifo_len_ ? APDS9960_GVALID : 0;
+        } else if( addr >= APDS9960_GFIFO_U ) {
+            const uint8_t *rec = (const uint8_t*)&fifo_[fifo_head_];
+            val = fifo_len_ ? rec[addr - APDS9960_GFIFO_U] : 0;
+            if( addr == APDS9960_GFIFO_R ) {
+                /* Dataset consumed, pointer wraps back to GFIFO_U */
+                if( fifo_len_ ) {
+                    fifo_head_++;
+                    fifo_len_--;
+                }
+                ptr_ = APDS9960_GFIFO_U;
+                return val;
+            }
+        } else {
+            val = regs_[addr];
+        }
+        ptr_++;
+
+        return val;
+    }
+
+    uint8_t regs_[256];
+    uint8_t ptr_;
+    gesture_record_t fifo_[MAX_FIFO];
+    size_t fifo_head_;
+    size_t fifo_len_;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * Wire.h
+ *
+ * Host TwoWire routing transactions to the devices attached with
+ * host::attachDevice(). Transactions are counted and, in virtual clock
+ * mode, advance the clock by their duration on the bus. Faults set with
+ * host::injectFault() surface the way the AVR core reports them.
+ */
+
+#ifndef _APDS9960_HOST_WIRE_H_
+#define _APDS9960_HOST_WIRE_H_
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH   32
+
+/* Same feature macros as the AVR core */
+#define WIRE_HAS_END        1
+#define WIRE_HAS_TIMEOUT    1
+
+typedef void (*wire_callback_t)(void *context, int count);
+
+class TwoWire : public Stream
+{
+public:
+    TwoWire();
+
+    void begin();
+    void end();
+    void setClock(uint32_t hz);
+    uint32_t getClock() const { return clock_; }
+    void setWireTimeout(uint32_t timeout_us = 25000, bool reset = false);
+    bool getWireTimeoutFlag() const;
+    void clearWireTimeoutFlag();
+
+    void beginTransmission(uint8_t addr);
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(int addr, int len);
+
+    // Host extension standing in for interrupt or DMA driven I2C, see
+    // host::wireReadAsync(). Write reg, then read len bytes into buf
+    // without waiting for the bus. done(context, count) runs from busy()
+    // once the bus time has passed, count is -1 on failure. False if a
+    // read is in flight.
+    bool readAsync(uint8_t addr, uint8_t reg, uint8_t *buf, size_t len,
+                   wire_callback_t done, void *context);
+    // True while a readAsync() transfer is on the bus
+    bool busy();
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    using Print::write;
+    int available();
+    int read();
+    int peek();
+
+private:
+    uint32_t clock_;
+    uint32_t timeout_us_;
+    bool timeout_flag_;
+    uint8_t addr_;
+    uint8_t tx_buf_[BUFFER_LENGTH];
+    uint8_t tx_len_;
+    bool tx_overflow_;
+    uint8_t rx_buf_[BUFFER_LENGTH];
+    uint8_t rx_len_;
+    uint8_t rx_pos_;
+    wire_callback_t async_done_;
+    void *async_context_;
+    int async_count_;
+    uint64_t async_end_us_;
+};
+
+// One controller per thread, see host::attachDevice()
+extern thread_local TwoWire Wire;
+
+#endif
@@ -0,0 +1,453 @@
+/**
+ * bench.cpp
+ *
+ * Host benchmark suite for the APDS-9960 driver. Every case runs the
+ * unmodified driver against FakeAPDS9960 in virtual time and reports
+ * CPU time (ns/op), I2C transactions per op and bus time per op at the
+ * configured I2C clock.
+ *
+ * Usage: bench [--filter text] [--min-time ms] [--out file.csv]
+ *              [--baseline file.csv] [--tolerance percent]
+ *
+ * With --baseline the results are compared against a previous --out
+ * file; the exit status is 1 if a case got slower than the tolerance or
+ * needs more I2C transactions than before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "host.h"
+#include "FakeAPDS9960.h"
+
+/* Access to the private driver internals */
+class APDS9960Bench
+{
+public:
+    static void resetGestureParameters(APDS9960 &a) { a.resetGestureParameters(); }
+    static bool processGestureData(APDS9960 &a, const gesture_record_t *r) { return a.processGestureData(r); }
+    static void decodeGesture(APDS9960 &a) { a.decodeGesture(); }
+    static gesture_data_type &gestureData(APDS9960 &a) { return a.gesture_data_; }
+    static unsigned long &alsNext(APDS9960 &a) { return a.als_next_us_; }
+
+    static bool setProxIntLowThresh(APDS9960 &a, uint8_t v) { return a.setProxIntLowThresh(v); }
+    static bool setProxIntHighThresh(APDS9960 &a, uint8_t v) { return a.setProxIntHighThresh(v); }
+    static bool setLEDBoost(APDS9960 &a, uint8_t v) { return a.setLEDBoost(v); }
+    static bool setProxGainCompEnable(APDS9960 &a, uint8_t v) { return a.setProxGainCompEnable(v); }
+    static bool setProxPhotoMask(APDS9960 &a, uint8_t v) { return a.setProxPhotoMask(v); }
+    static bool setGestureEnterThresh(APDS9960 &a, uint8_t v) { return a.setGestureEnterThresh(v); }
+    static bool setGestureExitThresh(APDS9960 &a, uint8_t v) { return a.setGestureExitThresh(v); }
+    static bool setGestureWaitTime(APDS9960 &a, uint8_t v) { return a.setGestureWaitTime(v); }
+    static bool setGestureMode(APDS9960 &a, uint8_t v) { return a.setGestureMode(v); }
+};
+
+typedef struct bench_result_t
+{
+    std::string name;
+    double ns_per_op;
+    double i2c_per_op;
+    double bus_us_per_op;
+} bench_result_t;
+
+static FakeAPDS9960 device;
+static APDS9960 apds;
+static const i2c_async_type wire_async = { host::wireReadAsync, host::wireBusy, NULL };
+static std::vector<bench_result_t> results;
+static const char *filter = NULL;
+static double min_time_ms = 50.0;
+
+/* Vertical swipe: U peaks first, then D, while L/R stay balanced */
+static std::vector<gesture_record_t> makeSwipe(size_t count)
+{
+    std::vector<gesture_record_t> recs(count);
+
+    for (size_t i = 0; i < count; i++) {
+        int phase = (int)(i * 256 / count);
+        int u = 200 - abs(phase - 96) * 2;
+        int d = 200 - abs(phase - 160) * 2;
+        int lr = (u + d) / 2;
+        recs[i].u_data = u < 10 ? 10 : u;
+        recs[i].d_data = d < 10 ? 10 : d;
+        recs[i].l_data = lr < 10 ? 10 : lr;
+        recs[i].r_data = lr < 10 ? 10 : lr;
+    }
+
+    return recs;
+}
+
+static void bench(const char *name, const std::function<void()> &op)
+{
+    typedef std::chrono::steady_clock clock;
+
+    if( filter && !strstr(name, filter) ) {
+        return;
+    }
+
+    /* Warm up, then grow the batch until it runs long enough */
+    op();
+    uint64_t iters = 1;
+    double elapsed_ns = 0;
+    host::i2c_stats_t stats;
+    for (;;) {
+        host::resetBusStats();
+        clock::time_point start = clock::now();
+        for (uint64_t i = 0; i < iters; i++) {
+            op();
+        }
+        elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        stats = host::getBusStats();
+        if( elapsed_ns >= min_time_ms * 1e6 || iters >= (1ULL << 30) ) {
+            break;
+        }
+        iters *= 2;
+    }
+
+    bench_result_t r;
+    r.name = name;
+    r.ns_per_op = elapsed_ns / iters;
+    r.i2c_per_op = (double)stats.transactions / iters;
+    r.bus_us_per_op = (double)stats.bus_us / iters;
+    results.push_back(r);
+    printf("%-36s %12.1f ns/op %8.2f i2c/op %10.1f bus-us/op\n",
+           name, r.ns_per_op, r.i2c_per_op, r.bus_us_per_op);
+}
+
+static void runGestureBenchmarks()
+{
+    static std::vector<gesture_record_t> swipe = makeSwipe(MAX_RECORDS);
+
+    bench("processGestureData (8 records)", [] {
+        APDS9960Bench::resetGestureParameters(apds);
+        gesture_data_type &gd = APDS9960Bench::gestureData(apds);
+        gd.current_records = 8;
+        gd.total_records = 8;
+        APDS9960Bench::processGestureData(apds, swipe.data());
+    });
+
+    bench("decodeGesture", [] {
+        gesture_data_type &gd = APDS9960Bench::gestureData(apds);
+        APDS9960Bench::resetGestureParameters(apds);
+        gd.total_records = MAX_RECORDS;
+        gd.sum_udlr = 120UL * MAX_RECORDS;
+        gd.delta_udlr = -100;
+        APDS9960Bench::decodeGesture(apds);
+    });
+
+    bench("readGesture (80 record swipe)", [] {
+        device.loadFifo(swipe.data(), swipe.size());
+        apds.readGesture();
+    });
+
+    bench("readGesture (swipe, 2 ms budget)", [] {
+        device.loadFifo(swipe.data(), swipe.size());
+        while( apds.readGesture(2000) == GESTURE_PENDING ) {
+            delay(1);
+        }
+    });
+
+    /* FIFO reads in the background, processing overlaps the transfer */
+    apds.setAsyncTransport(&wire_async);
+    bench("readGesture (swipe, async FIFO)", [] {
+        device.loadFifo(swipe.data(), swipe.size());
+        apds.readGesture();
+    });
+    apds.setAsyncTransport(NULL);
+
+    bench("isGestureAvailable", [] { apds.isGestureAvailable(); });
+
+    device.setReg(APDS9960_STATUS, APDS9960_PVALID);
+    apds.enableGestureArming();
+    device.setReg(APDS9960_STATUS, 0);
+    bench("pollArmedGesture (idle)", [] { apds.pollArmedGesture(); });
+    apds.disableGestureArming();
+}
+
+static void runSetupBenchmarks()
+{
+    bench("init", [] { apds.init(); });
+    bench("getID", [] { apds.getID(); });
+    bench("setMode", [] { apds.setMode(PROXIMITY, 1); });
+    bench("enablePower", [] { apds.enablePower(); });
+    bench("disablePower", [] { apds.disablePower(); });
+    bench("enableLightSensor", [] { apds.enableLightSensor(false); });
+    bench("disableLightSensor", [] { apds.disableLightSensor(); });
+    bench("enableProximitySensor", [] { apds.enableProximitySensor(false); });
+    bench("disableProximitySensor", [] { apds.disableProximitySensor(); });
+    bench("enableGestureSensor", [] { apds.enableGestureSensor(true); });
+    bench("disableGestureSensor", [] { apds.disableGestureSensor(); });
+}
+
+static void runSetterBenchmarks()
+{
+    bench("setLEDDrive", [] { apds.setLEDDrive(LED_DRIVE_50MA); });
+    bench("setGestureLEDDrive", [] { apds.setGestureLEDDrive(LED_DRIVE_50MA); });
+    bench("setAmbientLightGain", [] { apds.setAmbientLightGain(AGAIN_16X); });
+    bench("setProximityGain", [] { apds.setProximityGain(PGAIN_2X); });
+    bench("setGestureGain", [] { apds.setGestureGain(GGAIN_2X); });
+    bench("setLightIntLowThreshold", [] { apds.setLightIntLowThreshold(100); });
+    bench("setLightIntHighThreshold", [] { apds.setLightIntHighThreshold(1000); });
+    bench("setLightIntWindow", [] { apds.setLightIntWindow(900, 1100); });
+    bench("setProximityIntPersistence", [] { apds.setProximityIntPersistence(DEFAULT_PROX_PPERS); });
+    bench("setLightIntPersistence", [] { apds.setLightIntPersistence(DEFAULT_ALS_APERS); });
+    bench("setProximityIntLowThreshold", [] { apds.setProximityIntLowThreshold(10); });
+    bench("setProximityIntHighThreshold", [] { apds.setProximityIntHighThreshold(200); });
+    bench("setAmbientLightIntEnable", [] { apds.setAmbientLightIntEnable(1); });
+    bench("setProximityIntEnable", [] { apds.setProximityIntEnable(1); });
+    bench("setGestureIntEnable", [] { apds.setGestureIntEnable(1); });
+    bench("setProximityFilter", [] { apds.setProximityFilter(5, 2); });
+    bench("clearAmbientLightInt", [] { apds.clearAmbientLightInt(); });
+    bench("clearProximityInt", [] { apds.clearProximityInt(); });
+    bench("setProxIntLowThresh", [] { APDS9960Bench::setProxIntLowThresh(apds, 10); });
+    bench("setProxIntHighThresh", [] { APDS9960Bench::setProxIntHighThresh(apds, 200); });
+    bench("setLEDBoost", [] { APDS9960Bench::setLEDBoost(apds, LED_BOOST_150); });
+    bench("setProxGainCompEnable", [] { APDS9960Bench::setProxGainCompEnable(apds, 1); });
+    bench("setProxPhotoMask", [] { APDS9960Bench::setProxPhotoMask(apds, 0x3); });
+    bench("setGestureEnterThresh", [] { APDS9960Bench::setGestureEnterThresh(apds, 40); });
+    bench("setGestureExitThresh", [] { APDS9960Bench::setGestureExitThresh(apds, 30); });
+    bench("setGestureWaitTime", [] { APDS9960Bench::setGestureWaitTime(apds, GWTIME_5_6MS); });
+    bench("setGestureMode", [] { APDS9960Bench::setGestureMode(apds, 0); });
+    bench("setWaitLong", [] { apds.setWaitLong(0); });
+    bench("setSleepAfterInt", [] { apds.setSleepAfterInt(0); });
+
+    static power_plan_type plan;
+    static cycle_timing_type timing;
+    bench("getCycleTiming", [] { apds.getCycleTiming(timing); });
+    bench("planPower", [] { apds.planPower(100000, 200000, plan); });
+    bench("setPowerSchedule", [] { apds.setPowerSchedule(100000, 200000, plan); });
+}
+
+static void runReadBenchmarks()
+{
+    static uint16_t val16;
+    static uint8_t val8;
+
+    bench("readAmbientLight", [] { apds.readAmbientLight(val16); });
+    bench("readRedLight", [] { apds.readRedLight(val16); });
+    bench("readGreenLight", [] { apds.readGreenLight(val16); });
+    bench("readBlueLight", [] { apds.readBlueLight(val16); });
+    bench("readAmbientLight+RGB", [] {
+        apds.readAmbientLight(val16);
+        apds.readRedLight(val16);
+        apds.readGreenLight(val16);
+        apds.readBlueLight(val16);
+    });
+    static uint16_t r, g, b;
+    apds.enableLightSensor(false);
+    device.setReg(APDS9960_STATUS, APDS9960_AVALID);
+    bench("readColorIfNew (due)", [] {
+        APDS9960Bench::alsNext(apds) = micros();
+        apds.readColorIfNew(val16, r, g, b);
+    });
+    device.setReg(APDS9960_STATUS, 0);
+    bench("readColorIfNew (not due)", [] { apds.readColorIfNew(val16, r, g, b); });
+    bench("readProximity", [] { apds.readProximity(val8); });
+    apds.enableSaturationControl();
+    bench("readProximity (saturation control)", [] { apds.readProximity(val8); });
+    bench("readAmbientLight (saturation control)", [] { apds.readAmbientLight(val16); });
+    device.setReg(APDS9960_STATUS, APDS9960_PGSAT);
+    bench("readProximity (saturated)", [] { apds.readProximity(val8); });
+    device.setReg(APDS9960_STATUS, 0);
+    apds.disableSaturationControl();
+    apds.setProximityFilter(PROX_FILTER_MAX, 2);
+    bench("readProximityFiltered (median 9)", [] { apds.readProximityFiltered(val8); });
+    apds.setProximityFilter(0, 0);
+
+    apds.enableLightTracking();
+    bench("updateLightTracking (in band)", [] { apds.updateLightTracking(val16); });
+    device.setReg(APDS9960_STATUS, APDS9960_AINT);
+    bench("updateLightTracking (new level)", [] { apds.updateLightTracking(val16); });
+    device.setReg(APDS9960_STATUS, 0);
+    apds.disableLightTracking();
+
+    device.setReg(APDS9960_STATUS, APDS9960_PVALID);
+    bench("enableProximityTracking", [] { apds.enableProximityTracking(); });
+    device.setReg(APDS9960_STATUS, 0);
+    bench("updateProximityTracking (no event)", [] { apds.updateProximityTracking(); });
+    apds.disableProximityTracking();
+
+    static uint8_t samples[32];
+    device.setReg(APDS9960_STATUS, APDS9960_PVALID);
+    bench("captureProximity (32 samples)", [] { apds.captureProximity(samples, 32); });
+    device.setReg(APDS9960_STATUS, 0);
+}
+
+static void runTransportBenchmarks()
+{
+    static uint8_t rgbc[8];
+    static uint8_t wtime = DEFAULT_WTIME;
+    static i2c_transfer_type read_xfer;
+    static i2c_transfer_type write_xfer;
+
+    read_xfer.reg = APDS9960_CDATAL;
+    read_xfer.buf = rgbc;
+    read_xfer.len = sizeof(rgbc);
+    read_xfer.read = true;
+    write_xfer.reg = APDS9960_WTIME;
+    write_xfer.buf = &wtime;
+    write_xfer.len = 1;
+    write_xfer.read = false;
+
+    bench("submitTransfer (RGBC burst)", [] {
+        apds.submitTransfer(read_xfer);
+        apds.waitTransfer(read_xfer);
+    });
+
+    apds.setAsyncTransport(&wire_async);
+    bench("submitTransfer (RGBC burst, async)", [] {
+        apds.submitTransfer(read_xfer);
+        apds.waitTransfer(read_xfer);
+    });
+    bench("submitTransfer (read+write, async)", [] {
+        apds.submitTransfer(read_xfer);
+        apds.submitTransfer(write_xfer);
+        apds.waitTransfer(write_xfer);
+    });
+    apds.setAsyncTransport(NULL);
+}
+
+static void runFaultBenchmarks()
+{
+    static uint8_t val8;
+
+    bench("readProximity (NACK, retried)", [] {
+        host::injectFault(host::FAULT_NACK);
+        apds.readProximity(val8);
+    });
+    bench("readProximity (timeout, retried)", [] {
+        host::injectFault(host::FAULT_TIMEOUT);
+        apds.readProximity(val8);
+    });
+    apds.setBusRecoveryPins(18, 19);
+    bench("readProximity (stuck bus, recovered)", [] {
+        host::injectFault(host::FAULT_STUCK_BUS);
+        apds.readProximity(val8);
+    });
+    apds.setBusRecoveryPins(I2C_NO_PIN, I2C_NO_PIN);
+    host::injectFault(host::FAULT_NONE, 0);
+}
+
+static bool loadCsv(const char *path, std::map<std::string, bench_result_t> &out)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+
+    if( !f ) {
+        return false;
+    }
+    while( fgets(line, sizeof(line), f) ) {
+        char name[128];
+        bench_result_t r;
+        if( sscanf(line, "%127[^,],%lf,%lf,%lf", name,
+                   &r.ns_per_op, &r.i2c_per_op, &r.bus_us_per_op) == 4 ) {
+            r.name = name;
+            out[r.name] = r;
+        }
+    }
+    fclose(f);
+
+    return true;
+}
+
+static bool saveCsv(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if( !f ) {
+        return false;
+    }
+    fprintf(f, "# name,ns_per_op,i2c_per_op,bus_us_per_op\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result_t &r = results[i];
+        fprintf(f, "%s,%.1f,%.2f,%.1f\n", r.name.c_str(),
+                r.ns_per_op, r.i2c_per_op, r.bus_us_per_op);
+    }
+    fclose(f);
+
+    return true;
+}
+
+static int compare(const char *path, double tolerance)
+{
+    std::map<std::string, bench_result_t> base;
+    int regressions = 0;
+
+    if( !loadCsv(path, base) ) {
+        fprintf(stderr, "cannot read baseline %s\n", path);
+        return 2;
+    }
+
+    printf("\n%-36s %10s %10s\n", "compared to baseline", "time", "i2c/op");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result_t &r = results[i];
+        std::map<std::string, bench_result_t>::const_iterator it = base.find(r.name);
+        if( it == base.end() ) {
+            printf("%-36s %10s\n", r.name.c_str(), "new");
+            continue;
+        }
+        double dt = (r.ns_per_op / it->second.ns_per_op - 1.0) * 100.0;
+        double di = r.i2c_per_op - it->second.i2c_per_op;
+        bool bad = dt > tolerance || di > 0.005;
+        printf("%-36s %+9.1f%% %+10.2f%s\n", r.name.c_str(), dt, di,
+               bad ? "  REGRESSION" : "");
+        regressions += bad;
+    }
+
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = NULL;
+    const char *baseline = NULL;
+    double tolerance = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        if( !strcmp(argv[i], "--filter") && i + 1 < argc ) {
+            filter = argv[++i];
+        } else if( !strcmp(argv[i], "--min-time") && i + 1 < argc ) {
+            min_time_ms = atof(argv[++i]);
+        } else if( !strcmp(argv[i], "--out") && i + 1 < argc ) {
+            out = argv[++i];
+        } else if( !strcmp(argv[i], "--baseline") && i + 1 < argc ) {
+            baseline = argv[++i];
+        } else if( !strcmp(argv[i], "--tolerance") && i + 1 < argc ) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--filter text] [--min-time ms] "
+                    "[--out file.csv] [--baseline file.csv] [--tolerance percent]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    host::setClockMode(host::CLOCK_VIRTUAL);
+    host::attachDevice(APDS9960_I2C_ADDR, &device);
+    apds.setBusClock(400000);
+    apds.init();
+    device.setReg(APDS9960_ENABLE, 0x4D);   // PON, PEN, WEN, GEN
+
+    runGestureBenchmarks();
+    runSetupBenchmarks();
+    runSetterBenchmarks();
+    runReadBenchmarks();
+    runTransportBenchmarks();
+    runFaultBenchmarks();
+
+    if( out && !saveCsv(out) ) {
+        fprintf(stderr, "cannot write %s\n", out);
+        return 2;
+    }
+    if( baseline ) {
+        return compare(baseline, tolerance);
+    }
+
+    return 0;
+}
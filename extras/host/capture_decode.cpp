@@ -0,0 +1,238 @@
+/**
+ * capture_decode.cpp
+ *
+ * Host decoder for the gesture capture (APDS9960_CAPTURE). Reads a
+ * captured serial log on stdin, picks the "C:" lines written by
+ * exportCapture(), rebuilds the FIFO datasets of every gesture and
+ * prints them with the motion the driver decoded.
+ *
+ * Build: g++ -O2 -o capture_decode capture_decode.cpp
+ * Usage: capture_decode [--records] [--csv] < serial.log
+ *
+ *   --records  print the U, D, L, R counts of every dataset
+ *   --csv      print "gesture,time_ms,index,u,d,l,r,motion" lines only
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* Must match APDS9960.h */
+#define FLAG_UP             0x01
+#define FLAG_DOWN           0x02
+#define FLAG_LEFT           0x04
+#define FLAG_RIGHT          0x08
+#define FLAG_FAR            0x10
+#define FLAG_NEAR           0x20
+#define FLAG_APPROACH       0x40
+#define FLAG_DEPART         0x80
+
+#define CAPTURE_ZERO        0
+#define CAPTURE_CRUMB       1
+#define CAPTURE_NIBBLE      2
+#define CAPTURE_BYTE        3
+
+struct record_t
+{
+    uint8_t u, d, l, r;
+};
+
+static bool print_records;
+static bool csv;
+
+static void printMotion(uint8_t motion)
+{
+    if( motion & FLAG_UP ) printf(" UP");
+    else if( motion & FLAG_DOWN ) printf(" DOWN");
+    if( motion & FLAG_LEFT ) printf(" LEFT");
+    else if( motion & FLAG_RIGHT ) printf(" RIGHT");
+    if( motion & FLAG_NEAR ) printf(" NEAR");
+    else if( motion & FLAG_FAR ) printf(" FAR");
+    if( motion & FLAG_APPROACH ) printf(" APPROACHING");
+    else if( motion & FLAG_DEPART ) printf(" DEPARTING");
+}
+
+static int signExtend(unsigned v, unsigned bits)
+{
+    return (v & (1u << (bits - 1))) ? (int)v - (1 << bits) : (int)v;
+}
+
+/**
+ * Decodes one capture buffer. Returns false on a malformed stream, after
+ * printing what was decoded up to that point.
+ */
+static bool decodeCapture(const std::vector<uint8_t> &buf, unsigned gestures_expected,
+                          unsigned dropped)
+{
+    size_t pos = 0;
+    unsigned gestures = 0;
+    unsigned long records_total = 0;
+    unsigned long time_ms = 0;
+
+    while( pos < buf.size() ) {
+        static const unsigned payload[4] = { 0, 1, 2, 4 };
+        size_t start = pos;
+        uint32_t delta = 0;
+        for( unsigned shift = 0; ; shift += 7 ) {
+            if( pos >= buf.size() || shift > 28 ) {
+                printf("truncated time at byte %zu\n", start);
+                return false;
+            }
+            uint8_t b = buf[pos++];
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            if( !(b & 0x80) ) {
+                break;
+            }
+        }
+        time_ms += delta;
+        if( pos + 2 > buf.size() ) {
+            printf("truncated gesture header at byte %zu\n", start);
+            return false;
+        }
+        unsigned count = buf[pos++];
+        uint8_t motion = buf[pos++];
+
+        std::vector<record_t> records;
+        record_t prev = { 0, 0, 0, 0 };
+        uint8_t classes = 0;
+        for( unsigned n = 0; n < count; n++ ) {
+            if( !(n & 3) ) {
+                if( pos >= buf.size() ) {
+                    printf("truncated gesture at byte %zu\n", start);
+                    return false;
+                }
+                classes = buf[pos++];
+            }
+            unsigned cls = (classes >> (6 - 2 * (n & 3))) & 3;
+            if( pos + payload[cls] > buf.size() ) {
+                printf("truncated gesture at byte %zu\n", start);
+                return false;
+            }
+            int d[4] = { 0, 0, 0, 0 };
+            if( cls == CAPTURE_CRUMB ) {
+                for( int j = 0; j < 4; j++ ) {
+                    d[j] = signExtend((buf[pos] >> (6 - 2 * j)) & 3, 2);
+                }
+            } else if( cls == CAPTURE_NIBBLE ) {
+                for( int j = 0; j < 4; j++ ) {
+                    d[j] = signExtend((buf[pos + j / 2] >> ((j & 1) ? 0 : 4)) & 0x0F, 4);
+                }
+            } else if( cls == CAPTURE_BYTE ) {
+                for( int j = 0; j < 4; j++ ) {
+                    d[j] = buf[pos + j];
+                }
+            }
+            pos += payload[cls];
+            prev.u = (uint8_t)(prev.u + d[0]);
+            prev.d = (uint8_t)(prev.d + d[1]);
+            prev.l = (uint8_t)(prev.l + d[2]);
+            prev.r = (uint8_t)(prev.r + d[3]);
+            records.push_back(prev);
+        }
+        size_t bytes = pos - start;
+
+        if( csv ) {
+            for( size_t i = 0; i < records.size(); i++ ) {
+                printf("%u,%lu,%zu,%u,%u,%u,%u,%u\n", gestures, time_ms, i,
+                       records[i].u, records[i].d, records[i].l, records[i].r, motion);
+            }
+        } else {
+            printf("gesture %u at %lu ms: %zu datasets in %zu bytes (%.2f per dataset), "
+                   "motion 0x%02X", gestures, time_ms, records.size(), bytes,
+                   records.empty() ? 0.0 : (double)bytes / records.size(), motion);
+            printMotion(motion);
+            printf("\n");
+            for( size_t i = 0; print_records && i < records.size(); i++ ) {
+                printf("  %3zu: %3u %3u %3u %3u\n", i,
+                       records[i].u, records[i].d, records[i].l, records[i].r);
+            }
+        }
+        gestures++;
+        records_total += records.size();
+    }
+
+    if( !csv ) {
+        printf("%u gestures (%u expected, %u dropped), %lu datasets in %zu bytes, "
+               "%lu bytes uncompressed, ratio %.2f\n", gestures, gestures_expected,
+               dropped, records_total, buf.size(), records_total * 4,
+               buf.empty() ? 0.0 : (double)(records_total * 4) / buf.size());
+    }
+    return gestures == gestures_expected;
+}
+
+static bool finishCapture(const std::vector<uint8_t> &buf, unsigned long bytes,
+                          unsigned gestures, unsigned dropped)
+{
+    if( buf.size() != bytes ) {
+        printf("(%zu of %lu bytes received)\n", buf.size(), bytes);
+    }
+    return decodeCapture(buf, gestures, dropped);
+}
+
+static int hexNibble(char c)
+{
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    char line[256];
+    std::vector<uint8_t> buf;
+    unsigned long bytes = 0;
+    unsigned gestures = 0;
+    unsigned dropped = 0;
+    bool have_header = false;
+    bool ok = true;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--records") ) {
+            print_records = true;
+        } else if( !strcmp(argv[i], "--csv") ) {
+            csv = true;
+        } else {
+            fprintf(stderr, "usage: %s [--records] [--csv] < serial.log\n", argv[0]);
+            return 2;
+        }
+    }
+
+    while( fgets(line, sizeof(line), stdin) ) {
+        if( strncmp(line, "C:", 2) != 0 ) {
+            continue;
+        }
+        const char *p = line + 2;
+        size_t len = strcspn(p, "\r\n");
+
+        /* Header line: bytes, gestures, dropped */
+        if( memchr(p, ' ', len) ) {
+            if( have_header ) {
+                ok = finishCapture(buf, bytes, gestures, dropped) && ok;
+            }
+            if( sscanf(p, "%lu %u %u", &bytes, &gestures, &dropped) != 3 ) {
+                have_header = false;
+                continue;
+            }
+            buf.clear();
+            have_header = true;
+            continue;
+        }
+
+        for( size_t i = 0; have_header && i + 1 < len; i += 2 ) {
+            int hi = hexNibble(p[i]);
+            int lo = hexNibble(p[i + 1]);
+            if( hi < 0 || lo < 0 ) {
+                break;
+            }
+            buf.push_back((uint8_t)((hi << 4) | lo));
+        }
+    }
+    if( have_header ) {
+        ok = finishCapture(buf, bytes, gestures, dropped) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
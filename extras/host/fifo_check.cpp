@@ -0,0 +1,135 @@
+/**
+ * fifo_check.cpp
+ *
+ * Checks that readGesture() hands every gesture FIFO dataset to
+ * processing, in order, with the FIFO read synchronously and through the
+ * async transport. Built with DEBUG 1: the TRACE_RECORD events of the
+ * trace ring show which datasets were processed. Gestures of 1 to
+ * MAX_RECORDS datasets are loaded into FakeAPDS9960, so the last FIFO read
+ * is partial for most lengths.
+ *
+ * Usage: fifo_check
+ *
+ * The exit status is 1 if a dataset is missing, repeated or differs
+ * between the two paths.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "host.h"
+#include "FakeAPDS9960.h"
+
+#if !DEBUG
+#error "fifo_check needs the debug trace, build with -DDEBUG=1"
+#endif
+
+/* Access to the private driver internals */
+class APDS9960Bench
+{
+public:
+    static const trace_event_t &traceEvent(APDS9960 &a, uint16_t n)
+    {
+        uint16_t first = (a.trace_next_ - a.trace_fill_) & (TRACE_SIZE-1);
+        return a.trace_buf_[(first + n) & (TRACE_SIZE-1)];
+    }
+    static uint16_t traceFill(APDS9960 &a) { return a.trace_fill_; }
+    static uint32_t traceTotal(APDS9960 &a) { return a.trace_total_; }
+};
+
+static FakeAPDS9960 device;
+static APDS9960 apds;
+static const i2c_async_type wire_async = { host::wireReadAsync, host::wireBusy, NULL };
+
+/* Datasets the driver processed during one readGesture(), in order */
+static bool readProcessed(const std::vector<gesture_record_t> &fifo,
+                          std::vector<gesture_record_t> &seen)
+{
+    seen.clear();
+    apds.clearTrace();
+    device.loadFifo(fifo.data(), fifo.size());
+    apds.readGesture();
+
+    if( APDS9960Bench::traceTotal(apds) != APDS9960Bench::traceFill(apds) ) {
+        printf("trace ring overwritten\n");
+        return false;
+    }
+    for (uint16_t n = 0; n < APDS9960Bench::traceFill(apds); n++) {
+        const trace_event_t &ev = APDS9960Bench::traceEvent(apds, n);
+        if( ev.id != TRACE_RECORD ) {
+            continue;
+        }
+        if( ev.arg != seen.size() ) {
+            printf("record %u traced as dataset %zu\n", ev.arg, seen.size());
+            return false;
+        }
+        gesture_record_t rec = { ev.data[0], ev.data[1], ev.data[2], ev.data[3] };
+        seen.push_back(rec);
+    }
+
+    return true;
+}
+
+static bool sameDatasets(const char *path, size_t len,
+                         const std::vector<gesture_record_t> &expected,
+                         const std::vector<gesture_record_t> &seen)
+{
+    for (size_t i = 0; i < expected.size(); i++) {
+        if( i >= seen.size() ) {
+            printf("%s, %zu datasets: dataset %zu lost\n", path, len, i);
+            return false;
+        }
+        if( memcmp(&seen[i], &expected[i], sizeof(gesture_record_t)) ) {
+            printf("%s, %zu datasets: dataset %zu differs\n", path, len, i);
+            return false;
+        }
+    }
+    if( seen.size() != expected.size() ) {
+        printf("%s, %zu datasets: %zu processed\n", path, len, seen.size());
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    host::setClockMode(host::CLOCK_VIRTUAL);
+    host::attachDevice(APDS9960_I2C_ADDR, &device);
+    apds.init();
+    device.setReg(APDS9960_ENABLE, 0x4D);   // PON, PEN, WEN, GEN
+
+    unsigned checked = 0;
+    for (size_t len = 1; len <= MAX_RECORDS; len++) {
+        std::vector<gesture_record_t> fifo(len);
+        for (size_t i = 0; i < len; i++) {
+            fifo[i].u_data = (uint8_t)(i + 1);
+            fifo[i].d_data = (uint8_t)(2 * i + 1);
+            fifo[i].l_data = (uint8_t)(255 - i);
+            fifo[i].r_data = (uint8_t)(len);
+        }
+
+        std::vector<gesture_record_t> sync, async;
+        apds.setAsyncTransport(NULL);
+        if( !readProcessed(fifo, sync) ) {
+            return 1;
+        }
+        apds.setAsyncTransport(&wire_async);
+        if( !readProcessed(fifo, async) ) {
+            return 1;
+        }
+
+        /* Every dataset in order, and the same from both paths */
+        if( !sameDatasets("sync", len, fifo, sync) ||
+            !sameDatasets("async", len, sync, async) ) {
+            return 1;
+        }
+        checked += len;
+    }
+
+    printf("%u datasets processed in order, sync and async\n", checked);
+    return 0;
+}
@@ -0,0 +1,486 @@
+/**
+ * host.cpp
+ *
+ * Implementation of the Arduino shims for Linux hosts.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "host.h"
+
+/*******************************************************************************
+ * Clock
+ ******************************************************************************/
+
+namespace host {
+
+/* The clock mode is process wide, the bus and the virtual clock belong to
+   the calling thread so that threads can run independent buses */
+static clock_mode_t clock_mode = CLOCK_VIRTUAL;
+static thread_local uint64_t virtual_us = 0;
+static thread_local I2CDevice *devices[128];
+static thread_local i2c_stats_t bus_stats;
+static thread_local i2c_fault_t fault = FAULT_NONE;
+static thread_local uint32_t fault_count;
+
+static uint64_t monotonicMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void setClockMode(clock_mode_t mode)
+{
+    clock_mode = mode;
+}
+
+clock_mode_t getClockMode()
+{
+    return clock_mode;
+}
+
+uint64_t nowMicros()
+{
+    if( clock_mode == CLOCK_REAL ) {
+        return monotonicMicros();
+    }
+    return virtual_us;
+}
+
+void advanceMicros(uint64_t us)
+{
+    if( clock_mode == CLOCK_REAL ) {
+        struct timespec ts;
+        ts.tv_sec = us / 1000000;
+        ts.tv_nsec = (us % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    } else {
+        virtual_us += us;
+    }
+}
+
+void attachDevice(uint8_t addr, I2CDevice *dev)
+{
+    devices[addr & 0x7F] = dev;
+}
+
+void detachDevice(uint8_t addr)
+{
+    devices[addr & 0x7F] = NULL;
+}
+
+const i2c_stats_t &getBusStats()
+{
+    return bus_stats;
+}
+
+void resetBusStats()
+{
+    bus_stats = i2c_stats_t();
+}
+
+uint32_t transactionMicros(size_t bytes)
+{
+    /* START, address + data bytes of 9 bits each, STOP */
+    uint32_t bits = (uint32_t)(bytes + 1) * 9 + 2;
+    return (bits * 1000000UL + Wire.getClock() - 1) / Wire.getClock();
+}
+
+bool wireReadAsync(void *context, uint8_t addr, uint8_t reg, uint8_t *buf,
+                   uint8_t len, void (*done)(void *, int), void *done_context)
+{
+    (void)context;
+    return Wire.readAsync(addr, reg, buf, len, done, done_context);
+}
+
+bool wireBusy(void *context)
+{
+    (void)context;
+    return Wire.busy();
+}
+
+void injectFault(i2c_fault_t f, uint32_t count)
+{
+    fault = f;
+    fault_count = count;
+}
+
+/* Fault to apply to the transaction starting now */
+static i2c_fault_t takeFault(bool is_read)
+{
+    if( fault == FAULT_STUCK_BUS ) {
+        return FAULT_TIMEOUT;
+    }
+    if( fault == FAULT_NONE || fault_count == 0 ) {
+        return FAULT_NONE;
+    }
+    if( fault == FAULT_SHORT_READ && !is_read ) {
+        return FAULT_NONE;
+    }
+
+    i2c_fault_t f = fault;
+    if( --fault_count == 0 ) {
+        fault = FAULT_NONE;
+    }
+    return f;
+}
+
+/* A Wire timeout: the bus was held for the whole timeout period */
+static void timeout(uint32_t timeout_us)
+{
+    bus_stats.transactions++;
+    bus_stats.bus_us += timeout_us;
+    if( clock_mode == CLOCK_VIRTUAL ) {
+        virtual_us += timeout_us;
+    }
+}
+
+static I2CDevice *device(uint8_t addr)
+{
+    return devices[addr & 0x7F];
+}
+
+/* Count a transaction; background ones leave the clock to Wire.busy() */
+static uint32_t account(size_t written, size_t read, bool nack,
+                        bool advance = true)
+{
+    uint32_t us = transactionMicros(written + read);
+
+    bus_stats.transactions++;
+    bus_stats.bytes_written += written;
+    bus_stats.bytes_read += read;
+    bus_stats.bus_us += us;
+    if( nack ) {
+        bus_stats.nacks++;
+    }
+    if( advance && clock_mode == CLOCK_VIRTUAL ) {
+        virtual_us += us;
+    }
+    return us;
+}
+
+} // namespace host
+
+unsigned long millis()
+{
+    return (unsigned long)(host::nowMicros() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)host::nowMicros();
+}
+
+void delay(unsigned long ms)
+{
+    host::advanceMicros((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    host::advanceMicros(us);
+}
+
+void yield()
+{
+    /* Busy waits give the CPU to other threads; virtual time stands still */
+    if( host::clock_mode == host::CLOCK_REAL ) {
+        sched_yield();
+    }
+}
+
+/*******************************************************************************
+ * GPIO
+ ******************************************************************************/
+
+/* Pins idle high, as the I2C lines are held by their pull-ups */
+static bool pin_low[256];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if( mode == INPUT_PULLUP ) {
+        pin_low[pin] = false;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    pin_low[pin] = !val;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin_low[pin] ? LOW : HIGH;
+}
+
+/*******************************************************************************
+ * Print and Serial
+ ******************************************************************************/
+
+size_t Print::write(const uint8_t *buf, size_t len)
+{
+    size_t n = 0;
+    while( len-- ) {
+        n += write(*buf++);
+    }
+    return n;
+}
+
+size_t Print::print(unsigned long val, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *p = &buf[sizeof(buf) - 1];
+
+    if( base < 2 ) {
+        base = DEC;
+    }
+    *p = '\0';
+    do {
+        unsigned long digit = val % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        val /= base;
+    } while( val );
+
+    return write(p);
+}
+
+size_t Print::print(long val, int base)
+{
+    if( base == DEC && val < 0 ) {
+        return print('-') + print((unsigned long)-val, base);
+    }
+    return print((unsigned long)val, base);
+}
+
+size_t Print::print(double val, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, val);
+    return write(buf);
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+    return fwrite(buf, 1, len, stdout);
+}
+
+/*******************************************************************************
+ * Wire
+ ******************************************************************************/
+
+thread_local TwoWire Wire;
+
+TwoWire::TwoWire()
+    : clock_(100000), timeout_us_(25000), timeout_flag_(false), addr_(0),
+      tx_len_(0), tx_overflow_(false), rx_len_(0), rx_pos_(0),
+      async_done_(NULL), async_context_(NULL), async_count_(0), async_end_us_(0)
+{
+}
+
+void TwoWire::begin()
+{
+    tx_len_ = 0;
+    rx_len_ = rx_pos_ = 0;
+    /* As on AVR and most cores, begin() starts at 100 kHz */
+    clock_ = 100000;
+
+    /* Restarting the controller after recovery frees a stuck bus */
+    if( host::fault == host::FAULT_STUCK_BUS ) {
+        host::fault = host::FAULT_NONE;
+    }
+}
+
+void TwoWire::end()
+{
+}
+
+void TwoWire::setClock(uint32_t hz)
+{
+    clock_ = hz;
+}
+
+void TwoWire::setWireTimeout(uint32_t timeout_us, bool reset)
+{
+    (void)reset;
+    timeout_us_ = timeout_us;
+}
+
+bool TwoWire::getWireTimeoutFlag() const
+{
+    return timeout_flag_;
+}
+
+void TwoWire::clearWireTimeoutFlag()
+{
+    timeout_flag_ = false;
+}
+
+void TwoWire::beginTransmission(uint8_t addr)
+{
+    addr_ = addr;
+    tx_len_ = 0;
+    tx_overflow_ = false;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+    (void)stop;
+    host::I2CDevice *dev = host::device(addr_);
+
+    if( tx_overflow_ ) {
+        return 1;
+    }
+    switch( host::takeFault(false) ) {
+        case host::FAULT_NACK:
+            host::account(0, 0, true);
+            return 2;
+        case host::FAULT_TIMEOUT:
+            host::timeout(timeout_us_);
+            timeout_flag_ = true;
+            return 5;
+        default:
+            break;
+    }
+    if( !dev ) {
+        host::account(0, 0, true);
+        return 2;
+    }
+    bool ack = dev->write(tx_buf_, tx_len_);
+    host::account(tx_len_, 0, !ack);
+
+    return ack ? 0 : 3;
+}
+
+uint8_t TwoWire::requestFrom(int addr, int len)
+{
+    host::I2CDevice *dev = host::device(addr);
+
+    rx_len_ = rx_pos_ = 0;
+    if( len > BUFFER_LENGTH ) {
+        len = BUFFER_LENGTH;
+    }
+    if( !dev || len <= 0 ) {
+        host::account(0, 0, true);
+        return 0;
+    }
+    switch( host::takeFault(true) ) {
+        case host::FAULT_NACK:
+            host::account(0, 0, true);
+            return 0;
+        case host::FAULT_TIMEOUT:
+            host::timeout(timeout_us_);
+            timeout_flag_ = true;
+            return 0;
+        case host::FAULT_SHORT_READ:
+            len--;
+            break;
+        default:
+            break;
+    }
+    rx_len_ = len > 0 ? dev->read(rx_buf_, len) : 0;
+    host::account(0, rx_len_, false);
+
+    return rx_len_;
+}
+
+bool TwoWire::readAsync(uint8_t addr, uint8_t reg, uint8_t *buf, size_t len,
+                        wire_callback_t done, void *context)
+{
+    host::I2CDevice *dev = host::device(addr);
+
+    if( async_done_ ) {
+        return false;
+    }
+
+    /* The device answers now, the bus stays busy for the transfer time */
+    uint32_t us;
+    int count = -1;
+    if( dev && dev->write(&reg, 1) ) {
+        us = host::account(1, 0, false, false);
+        count = (int)dev->read(buf, len);
+        us += host::account(0, count, false, false);
+    } else {
+        us = host::account(0, 0, true, false);
+    }
+    async_done_ = done;
+    async_context_ = context;
+    async_count_ = count;
+    async_end_us_ = host::nowMicros() + us;
+
+    return true;
+}
+
+bool TwoWire::busy()
+{
+    if( !async_done_ ) {
+        return false;
+    }
+
+    /* In virtual time the caller waits out the rest of the transfer */
+    uint64_t now = host::nowMicros();
+    if( now < async_end_us_ ) {
+        if( host::clock_mode == host::CLOCK_REAL ) {
+            return true;
+        }
+        host::bus_stats.async_wait_us += async_end_us_ - now;
+        host::virtual_us += async_end_us_ - now;
+    }
+
+    wire_callback_t done = async_done_;
+    async_done_ = NULL;
+    done(async_context_, async_count_);
+
+    return false;
+}
+
+size_t TwoWire::write(uint8_t c)
+{
+    if( tx_len_ >= BUFFER_LENGTH ) {
+        tx_overflow_ = true;
+        return 0;
+    }
+    tx_buf_[tx_len_++] = c;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *buf, size_t len)
+{
+    size_t n = 0;
+    while( len-- ) {
+        n += write(*buf++);
+    }
+    return n;
+}
+
+int TwoWire::available()
+{
+    return rx_len_ - rx_pos_;
+}
+
+int TwoWire::read()
+{
+    if( rx_pos_ >= rx_len_ ) {
+        return -1;
+    }
+    return rx_buf_[rx_pos_++];
+}
+
+int TwoWire::peek()
+{
+    if( rx_pos_ >= rx_len_ ) {
+        return -1;
+    }
+    return rx_buf_[rx_pos_];
+}
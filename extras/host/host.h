@@ -0,0 +1,85 @@
+/**
+ * host.h
+ *
+ * Host (Linux) side of the Arduino shims in this directory: the clock
+ * behind millis()/micros()/delay(), and the I2C devices that Wire talks to.
+ *
+ * The bus (Wire, attached devices, statistics, faults) and the virtual
+ * clock are per thread: each thread drives its own bus on its own
+ * timeline. The clock mode is shared by all threads.
+ */
+
+#ifndef _APDS9960_HOST_H_
+#define _APDS9960_HOST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host {
+
+/* Clock modes */
+enum clock_mode_t
+{
+    CLOCK_VIRTUAL,      // delay() and bus traffic advance a simulated clock
+    CLOCK_REAL          // monotonic system clock, delay() sleeps
+};
+
+void setClockMode(clock_mode_t mode);
+clock_mode_t getClockMode();
+uint64_t nowMicros();
+void advanceMicros(uint64_t us);
+
+/* A device on the fake I2C bus */
+class I2CDevice
+{
+public:
+    virtual ~I2CDevice() {}
+
+    // Write transaction. Return false to NACK.
+    virtual bool write(const uint8_t *data, size_t len) = 0;
+    // Read transaction. Return the number of bytes delivered.
+    virtual size_t read(uint8_t *data, size_t len) = 0;
+};
+
+/* Bus statistics, one transaction per START..STOP */
+typedef struct i2c_stats_t
+{
+    uint32_t transactions;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t nacks;
+    uint64_t bus_us;        // time the bus was busy at the configured clock
+    uint64_t async_wait_us; // time spent in Wire.busy() for background reads
+} i2c_stats_t;
+
+void attachDevice(uint8_t addr, I2CDevice *dev);
+void detachDevice(uint8_t addr);
+const i2c_stats_t &getBusStats();
+void resetBusStats();
+
+// Bus time of one transaction carrying 'bytes' bytes after the address
+uint32_t transactionMicros(size_t bytes);
+
+// Background reads through Wire.readAsync(), the functions of an
+// i2c_async_type for APDS9960::setAsyncTransport():
+//   { host::wireReadAsync, host::wireBusy, NULL }
+bool wireReadAsync(void *context, uint8_t addr, uint8_t reg, uint8_t *buf,
+                   uint8_t len, void (*done)(void *, int), void *done_context);
+bool wireBusy(void *context);
+
+/* Faults injected into the next transactions on the bus */
+enum i2c_fault_t
+{
+    FAULT_NONE,
+    FAULT_NACK,         // address NACKed
+    FAULT_SHORT_READ,   // a read delivers one byte less than requested
+    FAULT_TIMEOUT,      // transaction hangs until the Wire timeout
+    FAULT_STUCK_BUS     // every transaction times out until Wire.begin()
+};
+
+// Apply 'fault' to the next 'count' transactions it can affect
+void injectFault(i2c_fault_t fault, uint32_t count = 1);
+
+} // namespace host
+
+#endif
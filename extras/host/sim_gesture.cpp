@@ -0,0 +1,232 @@
+/**
+ * sim_gesture.cpp
+ *
+ * Runs the GestureTest polling loop against APDS9960Sim in virtual time:
+ * four swipes and a long hover, printing what readGesture() decoded,
+ * how long it blocked and what the device model saw. The run fails if a
+ * dataset the device produced was never read.
+ *
+ * Usage: sim_gesture [--budget us] [--armed] [--tune hz] [--async]
+ *                    [--capture bytes]
+ *
+ * With --budget, readGesture(budget) is polled every millisecond and the
+ * longest single call is reported instead of the blocking time. With
+ * --armed, the gesture engine is armed by proximity (enableGestureArming)
+ * and the driver is only called while INT is low or the engine is armed.
+ * With --tune, a hand is held over the sensor for the first second and
+ * tuneGestureRate(hz) picks the gesture settings used for the swipes.
+ * The datasets the tuner clears with the FIFO are not counted as lost.
+ * With --async, FIFO reads go through the host Wire.readAsync(), plugged in
+ * with setAsyncTransport(), and gesture data is processed while they are
+ * on the bus.
+ * With --capture, the gestures are kept in a capture buffer of that many
+ * bytes and exported at the end, for extras/host/capture_decode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "host.h"
+#include "APDS9960Sim.h"
+#include "../../APDS9960.h"
+
+static APDS9960Sim sim;
+static APDS9960 apds;
+static const i2c_async_type wire_async = { host::wireReadAsync, host::wireBusy, NULL };
+
+static void printGesture(int gesture)
+{
+    if( gesture & FLAG_UP )         printf(" UP");
+    else if( gesture & FLAG_DOWN )  printf(" DOWN");
+    if( gesture & FLAG_LEFT )       printf(" LEFT");
+    else if( gesture & FLAG_RIGHT ) printf(" RIGHT");
+    if( gesture & FLAG_NEAR )       printf(" NEAR");
+    else if( gesture & FLAG_FAR )   printf(" FAR");
+    if( gesture & FLAG_APPROACH )   printf(" APPROACHING");
+    else if( gesture & FLAG_DEPART ) printf(" DEPARTING");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t budget = 0;
+    bool armed = false;
+    bool async = false;
+    uint16_t tune_hz = 0;
+    uint16_t capture_size = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if( !strcmp(argv[i], "--budget") && i + 1 < argc ) {
+            budget = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--armed") ) {
+            armed = true;
+        } else if( !strcmp(argv[i], "--tune") && i + 1 < argc ) {
+            tune_hz = atoi(argv[++i]);
+        } else if( !strcmp(argv[i], "--async") ) {
+            async = true;
+        } else if( !strcmp(argv[i], "--capture") && i + 1 < argc ) {
+            capture_size = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--budget us] [--armed] [--tune hz] [--async] "
+                            "[--capture bytes]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    sim_target_t ambient = sim_target_t();
+    ambient.prox = 0.01f;
+    ambient.u = ambient.d = ambient.l = ambient.r = 0.01f;
+    ambient.clear = 20;
+    ambient.red = 8;
+    ambient.green = 7;
+    ambient.blue = 5;
+
+    /* Hand held still at the working distance while tuning */
+    sim_target_t hand = ambient;
+    hand.u = hand.d = hand.l = hand.r = 0.1f;
+
+    Trajectory scene;
+    if( tune_hz ) {
+        scene.at(0, hand).at(900000, hand);
+    }
+    scene.at(950000, ambient);
+    scene.append(Trajectory::swipe(1000000, 300000, SWIPE_U_TO_D, 0.15f, ambient));
+    scene.append(Trajectory::swipe(3000000, 300000, SWIPE_D_TO_U, 0.15f, ambient));
+    scene.append(Trajectory::swipe(5000000, 300000, SWIPE_L_TO_R, 0.15f, ambient));
+    scene.append(Trajectory::swipe(7000000, 300000, SWIPE_R_TO_L, 0.15f, ambient));
+    scene.append(Trajectory::hover(9000000, 3000000, 0.3f, ambient));
+
+    host::setClockMode(host::CLOCK_VIRTUAL);
+    sim.setTrajectory(scene);
+    sim.setNoise(2);
+    sim.attach();
+
+    if( !apds.init() ) {
+        printf("init failed\n");
+        return 1;
+    }
+    if( async ) {
+        apds.setAsyncTransport(&wire_async);
+    }
+    unsigned tuner_cleared = 0;
+    if( tune_hz ) {
+        gesture_tuning_type tuning;
+        unsigned long start = millis();
+        if( !apds.tuneGestureRate(tune_hz, 60, tuning) ) {
+            printf("tuning failed\n");
+            return 1;
+        }
+        printf("tuned in %lu ms: GPULSE 0x%02X GCONF2 0x%02X boost %u, "
+               "signal %u, %u datasets/s\n", millis() - start, tuning.gpulse,
+               tuning.gconf2, tuning.led_boost, tuning.signal, tuning.rate_hz);
+        tuner_cleared = sim.stats().gesture_datasets - sim.stats().fifo_reads;
+    }
+    if( armed ? !apds.enableGestureArming() : !apds.enableGestureSensor(true) ) {
+        printf("gesture setup failed\n");
+        return 1;
+    }
+    std::vector<uint8_t> capture(capture_size);
+    if( capture_size && !apds.startCapture(capture.data(), capture_size) ) {
+        printf("capture setup failed\n");
+        return 1;
+    }
+    host::resetBusStats();
+
+    bool pending = false;
+    unsigned long first = 0;
+    unsigned long longest = 0;
+
+    while( armed && millis() < 14000 ) {
+        if( pending || apds.isGestureArmed() || sim.intPin() == LOW ) {
+            unsigned long start = micros();
+            if( !pending ) {
+                first = millis();
+                longest = 0;
+            }
+            int gesture = apds.pollArmedGesture(budget);
+            if( micros() - start > longest ) {
+                longest = micros() - start;
+            }
+            pending = (gesture == GESTURE_PENDING);
+            if( !pending && gesture ) {
+                printf("%6lu ms: gesture 0x%02X", first, gesture);
+                printGesture(gesture);
+                if( budget ) {
+                    printf(" (done after %lu ms, longest call %lu us, armed %d)\n",
+                           millis() - first, longest, apds.isGestureArmed());
+                } else {
+                    printf(" (blocked %lu ms, armed %d)\n", longest / 1000,
+                           apds.isGestureArmed());
+                }
+            }
+        }
+        delay(budget ? 1 : 10);
+    }
+
+    while( !armed && budget && millis() < 14000 ) {
+        /* readGesture(budget) paces its own GSTATUS polls */
+        unsigned long start = micros();
+        if( !pending ) {
+            first = millis();
+            longest = 0;
+        }
+        int gesture = apds.readGesture(budget);
+        if( micros() - start > longest ) {
+            longest = micros() - start;
+        }
+        if( gesture == GESTURE_PENDING ) {
+            pending = true;
+        } else if( pending || gesture ) {
+            pending = false;
+            printf("%6lu ms: gesture 0x%02X", first, gesture);
+            printGesture(gesture);
+            printf(" (done after %lu ms, longest call %lu us, FIFO overflows %u)\n",
+                   millis() - first, longest, sim.stats().fifo_overflows);
+        }
+        delay(1);
+    }
+
+    while( !armed && !budget && millis() < 14000 ) {
+        if( apds.isGestureAvailable() ) {
+            unsigned long start = millis();
+            int gesture = apds.readGesture();
+            printf("%6lu ms: gesture 0x%02X", start, gesture);
+            printGesture(gesture);
+            printf(" (blocked %lu ms, FIFO overflows %u)\n",
+                   millis() - start, sim.stats().fifo_overflows);
+        }
+        delay(10);
+    }
+
+    const sim_stats_t &st = sim.stats();
+    const host::i2c_stats_t &bus = host::getBusStats();
+    printf("prox cycles %u, gesture entries %u, datasets %u read %u, overflows %u\n",
+           st.prox_cycles, st.gesture_entries, st.gesture_datasets,
+           st.fifo_reads, st.fifo_overflows);
+    printf("I2C transactions %u, bus busy %llu ms\n",
+           bus.transactions, (unsigned long long)(bus.bus_us / 1000));
+    if( async ) {
+        printf("waited for background FIFO reads %llu us\n",
+               (unsigned long long)bus.async_wait_us);
+    }
+
+    if( capture_size ) {
+        capture_info_type info;
+        apds.getCaptureInfo(info);
+        printf("captured %u gestures, %lu datasets in %u bytes, %u dropped\n",
+               info.gestures, (unsigned long)info.records, info.bytes, info.dropped);
+        apds.exportCapture(Serial);
+    }
+
+    /* Every dataset must be read, also when armed and the engine stops */
+    unsigned lost = st.gesture_datasets - st.fifo_reads - tuner_cleared;
+    if( lost ) {
+        printf("%u datasets lost\n", lost);
+        return 1;
+    }
+
+    return 0;
+}
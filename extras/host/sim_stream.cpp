@@ -0,0 +1,140 @@
+/**
+ * sim_stream.cpp
+ *
+ * Streams proximity, color and gesture records from APDS9960Sim in
+ * virtual time while four swipes go by, and reports what reached the
+ * buffer: records per channel, timestamp order, drops and bus traffic.
+ *
+ * Usage: sim_stream [--rate hz] [--size n] [--drain-ms n] [--print]
+ *
+ *   --rate hz      proximity/ALS results per second (default 10)
+ *   --size n       records in the stream buffer (default 64)
+ *   --drain-ms n   time between readStream() passes (default 50)
+ *   --print        print every record
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "host.h"
+#include "APDS9960Sim.h"
+#include "../../APDS9960.h"
+
+static APDS9960Sim sim;
+static APDS9960 apds;
+
+static void printRecord(const stream_record_type &r)
+{
+    printf("%8llu us ", (unsigned long long)r.time_us);
+    if( r.channel == STREAM_COLOR ) {
+        printf("color %u %u %u %u\n",
+               r.data[0] | (r.data[1] << 8), r.data[2] | (r.data[3] << 8),
+               r.data[4] | (r.data[5] << 8), r.data[6] | (r.data[7] << 8));
+    } else if( r.channel == STREAM_PROXIMITY ) {
+        printf("prox %u\n", r.data[0]);
+    } else {
+        printf("gesture U %u D %u L %u R %u\n",
+               r.data[0], r.data[1], r.data[2], r.data[3]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t rate_hz = 10;
+    uint16_t size = 64;
+    unsigned long drain_ms = 50;
+    bool print = false;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--rate") && i + 1 < argc ) {
+            rate_hz = atoi(argv[++i]);
+        } else if( !strcmp(argv[i], "--size") && i + 1 < argc ) {
+            size = atoi(argv[++i]);
+        } else if( !strcmp(argv[i], "--drain-ms") && i + 1 < argc ) {
+            drain_ms = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--print") ) {
+            print = true;
+        } else {
+            fprintf(stderr, "usage: %s [--rate hz] [--size n] [--drain-ms n] [--print]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    sim_target_t ambient = sim_target_t();
+    ambient.prox = 0.01f;
+    ambient.u = ambient.d = ambient.l = ambient.r = 0.01f;
+    ambient.clear = 20;
+    ambient.red = 8;
+    ambient.green = 7;
+    ambient.blue = 5;
+
+    Trajectory scene;
+    scene.at(0, ambient);
+    scene.append(Trajectory::swipe(1000000, 300000, SWIPE_U_TO_D, 0.15f, ambient));
+    scene.append(Trajectory::swipe(3000000, 300000, SWIPE_D_TO_U, 0.15f, ambient));
+    scene.append(Trajectory::swipe(5000000, 300000, SWIPE_L_TO_R, 0.15f, ambient));
+    scene.append(Trajectory::swipe(7000000, 300000, SWIPE_R_TO_L, 0.15f, ambient));
+
+    host::setClockMode(host::CLOCK_VIRTUAL);
+    sim.setTrajectory(scene);
+    sim.setNoise(2);
+    sim.attach();
+
+    if( !apds.init() ) {
+        printf("init failed\n");
+        return 1;
+    }
+    std::vector<stream_record_type> buf(size);
+    if( !apds.startStreaming(STREAM_PROXIMITY | STREAM_COLOR | STREAM_GESTURE,
+                             rate_hz, buf.data(), size) ) {
+        printf("streaming setup failed\n");
+        return 1;
+    }
+    host::resetBusStats();
+
+    uint32_t counts[3] = { 0, 0, 0 };
+    uint32_t out_of_order = 0;
+    uint64_t last_time[3] = { 0, 0, 0 };
+    unsigned long next_drain = millis() + drain_ms;
+    uint32_t services = 0;
+
+    while( millis() < 10000 ) {
+        apds.serviceStreaming();
+        services++;
+        if( (long)(millis() - next_drain) >= 0 ) {
+            stream_record_type r;
+            next_drain += drain_ms;
+            while( apds.readStream(r) ) {
+                uint8_t c = r.channel == STREAM_PROXIMITY ? 0 :
+                            r.channel == STREAM_COLOR ? 1 : 2;
+                if( r.time_us < last_time[c] ) {
+                    out_of_order++;
+                }
+                last_time[c] = r.time_us;
+                counts[c]++;
+                if( print ) {
+                    printRecord(r);
+                }
+            }
+        }
+        delay(1);
+    }
+    apds.stopStreaming();
+
+    const sim_stats_t &st = sim.stats();
+    const host::i2c_stats_t &bus = host::getBusStats();
+    printf("records: prox %u, color %u, gesture %u (device datasets %u), "
+           "%u dropped, %u out of order\n", counts[0], counts[1], counts[2],
+           st.gesture_datasets, apds.getStreamDropped(), out_of_order);
+    printf("prox cycles %u, FIFO overflows %u, %u serviceStreaming() calls, "
+           "I2C transactions %u, bus busy %llu ms\n", st.prox_cycles,
+           st.fifo_overflows, services, bus.transactions,
+           (unsigned long long)(bus.bus_us / 1000));
+
+    return 0;
+}
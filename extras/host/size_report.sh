@@ -0,0 +1,64 @@
+#!/bin/sh
+# Flash and RAM used by the driver in each feature configuration of
+# APDS9960_config.h.
+#
+#   ./size_report.sh
+#   CXX=avr-g++ CXXFLAGS="-Os -mmcu=atmega328p" \
+#       CPPFLAGS="-I<core> -I<variant> -I<Wire> -I../.." ./size_report.sh
+#
+# flash  text+data of APDS9960.cpp, every driver function kept
+# static data+bss of the driver (FIFO buffer, debug trace)
+# object sizeof(APDS9960), RAM taken by each instance
+#
+# The host build uses the Arduino/Wire shims in this directory. For a
+# cross compiler, point CPPFLAGS at the core's headers; size and nm are
+# taken with the compiler's prefix (avr-g++ -> avr-size, avr-nm).
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--Os}
+CPPFLAGS=${CPPFLAGS:--I. -I../..}
+PREFIX=${CXX%g++}
+SIZE=${PREFIX}size
+NM=${PREFIX}nm
+DRIVER=../../APDS9960.cpp
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# name GESTURE ALS PROXIMITY INTERRUPTS DIAGNOSTICS STREAMING CAPTURE
+CONFIGS="
+full            1 1 1 1 1 1 1
+no-diagnostics  1 1 1 1 0 1 1
+no-streaming    1 1 1 1 0 0 1
+no-capture      1 1 1 1 0 0 0
+gesture         1 0 0 0 0 0 0
+gesture-armed   1 0 1 1 0 0 0
+als             0 1 0 0 0 0 0
+als-int         0 1 0 1 0 0 0
+proximity       0 0 1 0 0 0 0
+proximity-int   0 0 1 1 0 0 0
+als-proximity   0 1 1 1 0 0 0
+core            0 0 0 0 0 0 0
+"
+
+printf '%-16s %7s %7s %7s\n' config flash static object
+echo "$CONFIGS" | while read name g a p i d st c; do
+    [ -z "$name" ] && continue
+    FLAGS="-DAPDS9960_GESTURE=$g -DAPDS9960_ALS=$a -DAPDS9960_PROXIMITY=$p
+           -DAPDS9960_INTERRUPTS=$i -DAPDS9960_DIAGNOSTICS=$d -DAPDS9960_STREAMING=$st
+           -DAPDS9960_CAPTURE=$c"
+
+    if ! $CXX $CPPFLAGS $CXXFLAGS $FLAGS -c $DRIVER -o "$TMP/driver.o"; then
+        echo "$name: build failed" >&2
+        exit 1
+    fi
+    printf '#include "APDS9960.h"\nchar apds9960_object[sizeof(APDS9960)];\n' \
+        > "$TMP/object.cpp"
+    $CXX $CPPFLAGS $CXXFLAGS $FLAGS -c "$TMP/object.cpp" -o "$TMP/object.o" || exit 1
+
+    set -- $($SIZE "$TMP/driver.o" | tail -n 1)
+    flash=$(($1 + $2))
+    static=$(($2 + $3))
+    object=$((0x$($NM -S "$TMP/object.o" | awk '/apds9960_object/ { print $2 }')))
+    printf '%-16s %7d %7d %7d\n' "$name" "$flash" "$static" "$object"
+done
@@ -0,0 +1,218 @@
+/**
+ * trace_decode.cpp
+ *
+ * Host decoder for the APDS-9960 debug trace (DEBUG 1). Reads a captured
+ * serial log on stdin, picks the "T:" lines written by dumpTrace() and
+ * prints the FIFO dumps, counters and gesture charts the driver used to
+ * print over Serial from inside the acquisition loop.
+ *
+ * Build: g++ -O2 -o trace_decode trace_decode.cpp
+ * Usage: trace_decode < serial.log
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* Must match APDS9960.h */
+#define MAX_RECORDS         80
+
+#define FLAG_UP             0x01
+#define FLAG_DOWN           0x02
+#define FLAG_LEFT           0x04
+#define FLAG_RIGHT          0x08
+#define FLAG_FAR            0x10
+#define FLAG_NEAR           0x20
+#define FLAG_APPROACH       0x40
+#define FLAG_DEPART         0x80
+
+#define TRACE_FIFO_LEVEL    0x01
+#define TRACE_FIFO_READ     0x02
+#define TRACE_RECORD        0x03
+#define TRACE_MAX_RECORDS   0x04
+#define TRACE_DIR_UD        0x05
+#define TRACE_DIR_LR        0x06
+#define TRACE_SUM           0x07
+#define TRACE_MOTION        0x08
+
+struct record_t
+{
+    uint8_t u, d, l, r;
+};
+
+static std::vector<record_t> records;   // records of the current gesture
+static std::vector<record_t> dump;      // records of the current FIFO read
+static uint32_t time_us;                // unwrapped timestamp
+static uint16_t last_tick;
+static bool have_time;
+
+static void stamp()
+{
+    printf("[%9.3f ms] ", time_us / 1000.0);
+}
+
+static void flushDump()
+{
+    if( dump.empty() ) {
+        return;
+    }
+    printf("FIFO Dump:");
+    for (size_t i = 0; i < dump.size(); i++) {
+        printf(" %u %u %u %u,", dump[i].u, dump[i].d, dump[i].l, dump[i].r);
+    }
+    printf("\n");
+    dump.clear();
+}
+
+static void printChart(uint8_t motion, int16_t delta_udlr)
+{
+    printf("-----------------------------------------------------------------\n");
+    printf("Motion: 0x%X >>>>>", motion);
+    if( motion & FLAG_UP ) printf(" UP");
+    else if( motion & FLAG_DOWN ) printf(" DOWN");
+    else printf(" ---");
+
+    if( motion & FLAG_LEFT ) printf(" LEFT");
+    else if( motion & FLAG_RIGHT ) printf(" RIGHT");
+    else printf(" ---");
+
+    if( motion & FLAG_DEPART ) printf(" DEPARTING");
+    else if( motion & FLAG_APPROACH ) printf(" APPROACHING");
+    else printf(" ---");
+
+    if( motion & FLAG_FAR ) printf(" FAR");
+    else if( motion & FLAG_NEAR ) printf(" NEAR");
+    else printf(" ---");
+    printf("  (delta %d)\n", delta_udlr);
+
+    for (int i = 250; i >= 0; i -= 10) {
+        printf("%3d:", i);
+        for (size_t j = 0; j < records.size(); j++) {
+            const record_t &rec = records[j];
+            putchar( (i <= rec.u && i + 10 > rec.u) ? 'u' : ' ' );
+            putchar( (i <= rec.d && i + 10 > rec.d) ? 'd' : ' ' );
+            putchar( (i <= rec.l && i + 10 > rec.l) ? 'l' : ' ' );
+            putchar( (i <= rec.r && i + 10 > rec.r) ? 'r' : ' ' );
+        }
+        putchar('\n');
+    }
+    printf("-----------------------------------------------------------------\n");
+    records.clear();
+}
+
+static void decodeEvent(const uint8_t *ev)
+{
+    uint16_t tick = ev[0] | (ev[1] << 8);
+    uint8_t id = ev[2];
+    uint8_t arg = ev[3];
+    uint32_t data = ev[4] | (ev[5] << 8) | (ev[6] << 16) | ((uint32_t)ev[7] << 24);
+
+    /* Ticks are 16 us and wrap after ~1 s; events are much closer than that */
+    if( have_time ) {
+        time_us += (uint16_t)(tick - last_tick) * 16UL;
+    }
+    last_tick = tick;
+    have_time = true;
+
+    if( id != TRACE_RECORD ) {
+        flushDump();
+    }
+
+    switch( id ) {
+    case TRACE_FIFO_LEVEL:
+        stamp(); printf("> FIFO Level: %u\n", arg);
+        break;
+    case TRACE_FIFO_READ:
+        stamp(); printf("Bytes read: %u\n", arg);
+        break;
+    case TRACE_RECORD: {
+        record_t rec = { ev[4], ev[5], ev[6], ev[7] };
+        dump.push_back(rec);
+        if( records.size() < MAX_RECORDS ) {
+            records.push_back(rec);
+        }
+        break;
+    }
+    case TRACE_MAX_RECORDS:
+        stamp(); printf("<<< MAX_RECORDS >>>\n");
+        break;
+    case TRACE_DIR_UD:
+        stamp(); printf("Diff counts: U: %u, D: %u", data & 0xFFFF, data >> 16);
+        break;
+    case TRACE_DIR_LR:
+        printf(", L: %u, R: %u\n", data & 0xFFFF, data >> 16);
+        break;
+    case TRACE_SUM:
+        stamp(); printf("Total records: %u, cumulative count: %u\n", arg, data);
+        break;
+    case TRACE_MOTION:
+        stamp(); printf("Gesture decoded\n");
+        printChart(arg, (int16_t)(data & 0xFFFF));
+        break;
+    default:
+        stamp(); printf("Unknown event 0x%02X arg %u data 0x%08X\n", id, arg, data);
+        break;
+    }
+}
+
+/* Events written by the driver and received for the current dump */
+static unsigned long written;
+static unsigned long kept;
+
+static void reportLost()
+{
+    if( written > kept ) {
+        printf("(%lu older events lost to ring overwrite)\n", written - kept);
+    }
+    written = kept = 0;
+}
+
+static int hexNibble(char c)
+{
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    return -1;
+}
+
+int main()
+{
+    char line[256];
+
+    while( fgets(line, sizeof(line), stdin) ) {
+        if( strncmp(line, "T:", 2) != 0 ) {
+            continue;
+        }
+        const char *p = line + 2;
+        size_t len = strcspn(p, "\r\n");
+
+        /* Header line: total number of events written */
+        if( len != 16 ) {
+            reportLost();
+            written = strtoul(p, NULL, 10);
+            kept = 0;
+            have_time = false;
+            time_us = 0;
+            continue;
+        }
+
+        uint8_t ev[8];
+        bool ok = true;
+        for (int i = 0; i < 8 && ok; i++) {
+            int hi = hexNibble(p[2 * i]);
+            int lo = hexNibble(p[2 * i + 1]);
+            ok = (hi >= 0 && lo >= 0);
+            ev[i] = (uint8_t)((hi << 4) | lo);
+        }
+        if( ok ) {
+            kept++;
+            decodeEvent(ev);
+        }
+    }
+    flushDump();
+    reportLost();
+
+    return 0;
+}
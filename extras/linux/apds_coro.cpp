@@ -0,0 +1,200 @@
+/**
+ * apds_coro.cpp
+ *
+ * Serves several APDS-9960s from one thread with coroutines: for each
+ * sensor one task awaits gestures and one awaits color samples.
+ *
+ * Usage: apds_coro [--seconds s] bus[,gpiochip,line] ...
+ *        apds_coro --sim n [--seconds s]
+ *
+ *   apds_coro /dev/i2c-1,/dev/gpiochip0,17 /dev/i2c-3
+ *
+ * serves a sensor on i2c-1 with INT on line 17 of gpiochip0 and one on
+ * i2c-3 without an INT line (timer fallback). With --sim, n simulated
+ * sensors (APDS9960Sim) each see four swipes, offset by 250 ms per
+ * sensor, and the loop runs in virtual time.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "host.h"
+#include "APDS9960Sim.h"
+#include "event_loop.h"
+#include "gpio_line.h"
+#include "i2c_dev.h"
+#include "sensor.h"
+#include "task.h"
+
+#define SIM_SECONDS     10
+
+typedef struct sensor_counts_type {
+    uint32_t gestures;
+    uint32_t colors;
+    color_sample_type last;
+} sensor_counts_type;
+
+static EventLoop loop;
+static std::vector<sensor_counts_type> counts;
+
+static void printGesture(int gesture)
+{
+    if( gesture & FLAG_UP )         printf(" UP");
+    else if( gesture & FLAG_DOWN )  printf(" DOWN");
+    if( gesture & FLAG_LEFT )       printf(" LEFT");
+    else if( gesture & FLAG_RIGHT ) printf(" RIGHT");
+    if( gesture & FLAG_NEAR )       printf(" NEAR");
+    else if( gesture & FLAG_FAR )   printf(" FAR");
+    if( gesture & FLAG_APPROACH )   printf(" APPROACHING");
+    else if( gesture & FLAG_DEPART ) printf(" DEPARTING");
+}
+
+static Task watchGestures(Sensor &sensor, int id)
+{
+    for( ;; ) {
+        int gesture = co_await sensor.nextGesture();
+        counts[id].gestures++;
+        printf("%6lu ms: sensor %d gesture 0x%02X", millis(), id, gesture);
+        printGesture(gesture);
+        printf("\n");
+    }
+}
+
+static Task watchColor(Sensor &sensor, int id)
+{
+    for( ;; ) {
+        color_sample_type sample = co_await sensor.nextColorSample();
+        if( sample.status == ERROR ) {
+            printf("%6lu ms: sensor %d color read failed\n", millis(), id);
+            continue;
+        }
+        counts[id].colors++;
+        counts[id].last = sample;
+    }
+}
+
+static void onSignal(int)
+{
+    loop.stop();
+}
+
+static Trajectory simScene(uint64_t offset)
+{
+    sim_target_t ambient = sim_target_t();
+    ambient.prox = 0.01f;
+    ambient.u = ambient.d = ambient.l = ambient.r = 0.01f;
+    ambient.clear = 20;
+    ambient.red = 8;
+    ambient.green = 7;
+    ambient.blue = 5;
+
+    Trajectory scene;
+    scene.at(0, ambient);
+    scene.append(Trajectory::swipe(1000000 + offset, 300000, SWIPE_U_TO_D, 0.15f, ambient));
+    scene.append(Trajectory::swipe(3000000 + offset, 300000, SWIPE_D_TO_U, 0.15f, ambient));
+    scene.append(Trajectory::swipe(5000000 + offset, 300000, SWIPE_L_TO_R, 0.15f, ambient));
+    scene.append(Trajectory::swipe(7000000 + offset, 300000, SWIPE_R_TO_L, 0.15f, ambient));
+    return scene;
+}
+
+int main(int argc, char **argv)
+{
+    int sim_count = 0;
+    unsigned long seconds = 0;
+    std::vector<std::unique_ptr<host::I2CDevice> > buses;
+    std::vector<std::unique_ptr<GpioLine> > lines;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--sim") && i + 1 < argc ) {
+            sim_count = atoi(argv[++i]);
+        } else if( !strcmp(argv[i], "--seconds") && i + 1 < argc ) {
+            seconds = atol(argv[++i]);
+        } else if( argv[i][0] != '-' ) {
+            /* bus[,gpiochip,line] */
+            std::string arg(argv[i]);
+            size_t comma = arg.find(',');
+            std::unique_ptr<I2CDevBus> bus(new I2CDevBus());
+            if( !bus->open(arg.substr(0, comma).c_str(), APDS9960_I2C_ADDR) ) {
+                return 1;
+            }
+            std::unique_ptr<GpioLine> line;
+            if( comma != std::string::npos ) {
+                size_t comma2 = arg.find(',', comma + 1);
+                if( comma2 == std::string::npos ) {
+                    fprintf(stderr, "%s: expected bus,gpiochip,line\n", argv[i]);
+                    return 2;
+                }
+                line.reset(new GpioLine());
+                if( !line->open(arg.substr(comma + 1, comma2 - comma - 1).c_str(),
+                                atoi(arg.c_str() + comma2 + 1), "apds9960-int") ) {
+                    return 1;
+                }
+            }
+            buses.push_back(std::move(bus));
+            lines.push_back(std::move(line));
+        } else {
+            fprintf(stderr, "usage: %s [--seconds s] bus[,gpiochip,line] ...\n"
+                            "       %s --sim n [--seconds s]\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if( sim_count ) {
+        host::setClockMode(host::CLOCK_VIRTUAL);
+        for( int i = 0; i < sim_count; i++ ) {
+            APDS9960Sim *sim = new APDS9960Sim();
+            sim->setTrajectory(simScene(i * 250000ULL));
+            sim->setNoise(2, i + 1);
+            buses.push_back(std::unique_ptr<host::I2CDevice>(sim));
+            lines.push_back(std::unique_ptr<GpioLine>());
+        }
+        if( !seconds ) {
+            seconds = SIM_SECONDS;
+        }
+    } else {
+        host::setClockMode(host::CLOCK_REAL);
+    }
+    if( buses.empty() ) {
+        fprintf(stderr, "no sensors\n");
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<Sensor> > sensors;
+    counts.resize(buses.size());
+    for( size_t i = 0; i < buses.size(); i++ ) {
+        sensors.push_back(std::unique_ptr<Sensor>(
+            new Sensor(loop, *buses[i], lines[i].get())));
+        if( !sensors[i]->begin(true, true) ) {
+            printf("sensor %u: init failed\n", (unsigned)i);
+            return 1;
+        }
+        watchGestures(*sensors[i], i);
+        watchColor(*sensors[i], i);
+    }
+
+    if( seconds ) {
+        loop.schedule(host::nowMicros() + seconds * 1000000ULL, []() { loop.stop(); });
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    host::resetBusStats();
+    loop.run();
+
+    for( size_t i = 0; i < sensors.size(); i++ ) {
+        const color_sample_type &c = counts[i].last;
+        printf("sensor %u: %u gestures, %u color samples (last C %u R %u G %u B %u), "
+               "%u driver calls\n", (unsigned)i, counts[i].gestures, counts[i].colors,
+               c.clear, c.red, c.green, c.blue, sensors[i]->serviceCalls());
+    }
+    printf("I2C transactions %u, bus busy %llu ms, %u INT wakeups\n",
+           host::getBusStats().transactions,
+           (unsigned long long)(host::getBusStats().bus_us / 1000), loop.wakeups());
+
+    return 0;
+}
@@ -0,0 +1,295 @@
+/**
+ * apds_daemon.cpp
+ *
+ * Gateway daemon: one BusWorker thread per I2C bus reading color,
+ * proximity and gestures from every sensor on it, samples published to
+ * stdout as text lines.
+ *
+ * Usage: apds_daemon [options] --bus adapter[,adapter...] ...
+ *        apds_daemon [options] --sim BUSESxSENSORS [--virtual]
+ *
+ *   --bus a,b,..   one worker for the sensors on adapters a, b, ... (the
+ *                  channels of a mux count as one physical bus)
+ *   --sim BxS      B fake buses with S simulated sensors each; every
+ *                  transaction sleeps for its bus time at the Wire clock,
+ *                  as a blocking i2c-dev transfer does
+ *   --virtual      run the fake buses in per-thread virtual time
+ *   --seconds s    stop after s seconds (default: until SIGINT, 10 s for
+ *                  --sim)
+ *   --color-ms n   RGBC period, 0 for off (default 200)
+ *   --prox-ms n    proximity period, 0 for off (default 50)
+ *   --no-gesture   leave the gesture engine off
+ *   --quiet        count samples instead of printing them
+ *   --shm path     publish into a shared-memory ring instead (read it
+ *                  with shm_reader)
+ *   --shm-slots n  ring capacity in samples (default 4096)
+ *
+ * The summary reports per-bus job lateness and bus load, the samples per
+ * second of wall time and the mean bus occupancy. With the default
+ * periods the sample rate is set by the job periods times the sensor
+ * count; `make scale-run` polls proximity every millisecond instead, so
+ * the buses are the limit.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "Arduino.h"
+#include "host.h"
+#include "APDS9960Sim.h"
+#include "bus_worker.h"
+#include "i2c_dev.h"
+#include "sample.h"
+#include "shm_ring.h"
+
+#define SIM_SECONDS     10
+#define SHM_SLOTS       4096
+
+/* Samples as text lines, see printSample() */
+class TextSink : public SampleSink
+{
+public:
+    void publish(const apds_sample_type &s)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        printSample(stdout, s);
+    }
+
+private:
+    std::mutex mutex_;
+};
+
+/* Samples only counted */
+class CountSink : public SampleSink
+{
+public:
+    CountSink() : color(0), prox(0), gesture(0) {}
+
+    void publish(const apds_sample_type &s)
+    {
+        if( s.kind == SAMPLE_COLOR ) {
+            color++;
+        } else if( s.kind == SAMPLE_PROXIMITY ) {
+            prox++;
+        } else {
+            gesture++;
+        }
+    }
+
+    std::atomic<uint32_t> color;
+    std::atomic<uint32_t> prox;
+    std::atomic<uint32_t> gesture;
+};
+
+/* Fake bus: the device answers after the transaction's time on the wire */
+class TimedBus : public host::I2CDevice
+{
+public:
+    TimedBus(host::I2CDevice *dev) : dev_(dev) {}
+
+    bool write(const uint8_t *data, size_t len)
+    {
+        wait(len);
+        return dev_->write(data, len);
+    }
+
+    size_t read(uint8_t *data, size_t len)
+    {
+        wait(len);
+        return dev_->read(data, len);
+    }
+
+private:
+    void wait(size_t len)
+    {
+        if( host::getClockMode() == host::CLOCK_REAL ) {
+            host::advanceMicros(host::transactionMicros(len));
+        }
+    }
+
+    std::unique_ptr<host::I2CDevice> dev_;
+};
+
+static std::vector<std::unique_ptr<BusWorker> > workers;
+
+static void onSignal(int)
+{
+    for( size_t i = 0; i < workers.size(); i++ ) {
+        workers[i]->stop();
+    }
+}
+
+/* Ambient light with a swipe every two seconds, offset per sensor */
+static Trajectory simScene(uint64_t start, uint64_t seconds)
+{
+    sim_target_t ambient = sim_target_t();
+    ambient.prox = 0.01f;
+    ambient.u = ambient.d = ambient.l = ambient.r = 0.01f;
+    ambient.clear = 20;
+    ambient.red = 8;
+    ambient.green = 7;
+    ambient.blue = 5;
+
+    Trajectory scene;
+    scene.at(start, ambient);
+    for( uint64_t t = 1; t < seconds; t += 2 ) {
+        scene.append(Trajectory::swipe(start + t * 1000000, 300000,
+                                       (sim_swipe_t)(t / 2 % 4), 0.15f, ambient));
+    }
+    return scene;
+}
+
+static double wallSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    sensor_config_type config;
+    config.color_period_us = 200000;
+    config.prox_period_us = 50000;
+    config.gesture = true;
+    std::vector<std::vector<std::string> > buses;
+    int sim_buses = 0;
+    int sim_sensors = 0;
+    bool virtual_time = false;
+    unsigned long seconds = 0;
+    bool quiet = false;
+    const char *shm_path = NULL;
+    uint32_t shm_slots = SHM_SLOTS;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--bus") && i + 1 < argc ) {
+            std::vector<std::string> adapters;
+            std::string arg(argv[++i]);
+            size_t pos = 0;
+            for( ;; ) {
+                size_t comma = arg.find(',', pos);
+                adapters.push_back(arg.substr(pos, comma - pos));
+                if( comma == std::string::npos ) {
+                    break;
+                }
+                pos = comma + 1;
+            }
+            buses.push_back(adapters);
+        } else if( !strcmp(argv[i], "--sim") && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &sim_buses, &sim_sensors) == 2 ) {
+            i++;
+        } else if( !strcmp(argv[i], "--virtual") ) {
+            virtual_time = true;
+        } else if( !strcmp(argv[i], "--seconds") && i + 1 < argc ) {
+            seconds = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--color-ms") && i + 1 < argc ) {
+            config.color_period_us = atol(argv[++i]) * 1000;
+        } else if( !strcmp(argv[i], "--prox-ms") && i + 1 < argc ) {
+            config.prox_period_us = atol(argv[++i]) * 1000;
+        } else if( !strcmp(argv[i], "--no-gesture") ) {
+            config.gesture = false;
+        } else if( !strcmp(argv[i], "--quiet") ) {
+            quiet = true;
+        } else if( !strcmp(argv[i], "--shm") && i + 1 < argc ) {
+            shm_path = argv[++i];
+        } else if( !strcmp(argv[i], "--shm-slots") && i + 1 < argc ) {
+            shm_slots = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [options] --bus adapter[,adapter...] ...\n"
+                            "       %s [options] --sim BUSESxSENSORS [--virtual]\n",
+                    argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if( sim_buses > 0 ) {
+        if( !seconds ) {
+            seconds = SIM_SECONDS;
+        }
+        buses.assign(sim_buses, std::vector<std::string>(sim_sensors));
+    }
+    if( buses.empty() ) {
+        fprintf(stderr, "no buses\n");
+        return 2;
+    }
+    host::setClockMode(virtual_time ? host::CLOCK_VIRTUAL : host::CLOCK_REAL);
+
+    TextSink text;
+    CountSink count;
+    ShmRingWriter ring;
+    SampleSink *sink = quiet ? (SampleSink *)&count : (SampleSink *)&text;
+    if( shm_path ) {
+        if( !ring.create(shm_path, shm_slots) ) {
+            return 1;
+        }
+        sink = &ring;
+    }
+    uint32_t sensors = 0;
+
+    for( size_t b = 0; b < buses.size(); b++ ) {
+        workers.push_back(std::unique_ptr<BusWorker>(new BusWorker(b, *sink)));
+        for( size_t s = 0; s < buses[b].size(); s++ ) {
+            BusWorker::device_factory factory;
+            if( sim_buses > 0 ) {
+                uint64_t offset = (uint64_t)(b * buses[b].size() + s) * 50000;
+                factory = [offset, seconds](int) {
+                    APDS9960Sim *sim = new APDS9960Sim();
+                    sim->setTrajectory(simScene(host::nowMicros() + offset, seconds));
+                    sim->setNoise(2, offset / 50000 + 1);
+                    return std::unique_ptr<host::I2CDevice>(new TimedBus(sim));
+                };
+            } else {
+                std::string path = buses[b][s];
+                factory = [path](int) {
+                    std::unique_ptr<I2CDevBus> dev(new I2CDevBus());
+                    if( !dev->open(path.c_str(), APDS9960_I2C_ADDR) ) {
+                        dev.reset();
+                    }
+                    return std::unique_ptr<host::I2CDevice>(std::move(dev));
+                };
+            }
+            workers[b]->addSensor(factory, config);
+            sensors++;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    double wall = wallSeconds();
+    for( size_t b = 0; b < workers.size(); b++ ) {
+        workers[b]->start(seconds * 1000000ULL);
+    }
+    for( size_t b = 0; b < workers.size(); b++ ) {
+        workers[b]->join();
+    }
+    wall = wallSeconds() - wall;
+
+    uint32_t samples = 0;
+    double busy = 0;
+    for( size_t b = 0; b < workers.size(); b++ ) {
+        const worker_stats_type &st = workers[b]->stats();
+        double load = st.run_us ? 100.0 * st.i2c_bus_us / st.run_us : 0.0;
+        fprintf(stderr, "bus %u: %u jobs, %u samples, %u errors, late avg %llu us "
+                "max %u us, %u I2C transactions, bus busy %.1f%%\n", (unsigned)b,
+                st.jobs, st.samples, st.errors,
+                (unsigned long long)(st.jobs ? st.late_us_total / st.jobs : 0),
+                st.late_us_max, st.i2c_transactions, load);
+        samples += st.samples;
+        busy += load;
+    }
+    if( quiet ) {
+        fprintf(stderr, "color %u, proximity %u, gesture %u\n",
+                count.color.load(), count.prox.load(), count.gesture.load());
+    }
+    fprintf(stderr, "%u buses, %u sensors: %u samples in %.2f s wall, %.0f samples/s, "
+            "bus busy %.1f%%\n", (unsigned)workers.size(), sensors, samples, wall,
+            samples / wall, workers.empty() ? 0.0 : busy / workers.size());
+
+    return 0;
+}
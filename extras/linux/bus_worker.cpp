@@ -0,0 +1,223 @@
+/**
+ * bus_worker.cpp
+ *
+ * Per-bus worker thread with deadline scheduling, see bus_worker.h.
+ */
+
+#include <queue>
+
+#include "Arduino.h"
+#include "bus_worker.h"
+
+BusWorker::BusWorker(uint16_t bus, SampleSink &sink) :
+    bus_(bus),
+    sink_(sink),
+    stop_(false),
+    stats_()
+{
+}
+
+BusWorker::~BusWorker()
+{
+    stop();
+    join();
+}
+
+void BusWorker::addSensor(device_factory factory, const sensor_config_type &config)
+{
+    sensor_type sensor;
+    sensor.factory = factory;
+    sensor.config = config;
+    sensors_.push_back(std::move(sensor));
+}
+
+void BusWorker::start(uint64_t duration_us)
+{
+    stop_ = false;
+    thread_ = std::thread(&BusWorker::run, this, duration_us);
+}
+
+void BusWorker::stop()
+{
+    stop_ = true;
+}
+
+void BusWorker::join()
+{
+    if( thread_.joinable() ) {
+        thread_.join();
+    }
+}
+
+/**
+ * @brief Creates the device and driver of one sensor and enables its engines
+ *
+ * @param[in] index sensor on this bus
+ * @return True if the sensor is ready. False otherwise.
+ */
+bool BusWorker::setup(uint16_t index)
+{
+    sensor_type &s = sensors_[index];
+
+    s.dev = s.factory(index);
+    s.apds.reset(new APDS9960());
+    if( !s.dev ) {
+        return false;
+    }
+    host::attachDevice(APDS9960_I2C_ADDR, s.dev.get());
+
+    if( !s.apds->init() ) {
+        return false;
+    }
+    if( s.config.color_period_us && !s.apds->enableLightSensor(false) ) {
+        return false;
+    }
+    if( s.config.prox_period_us && !s.apds->enableProximitySensor(false) ) {
+        return false;
+    }
+    if( s.config.gesture && !s.apds->enableGestureSensor(false) ) {
+        return false;
+    }
+    return true;
+}
+
+void BusWorker::publish(uint16_t sensor, apds_sample_type &sample)
+{
+    sample.time_us = host::nowMicros();
+    sample.bus = bus_;
+    sample.sensor = sensor;
+    stats_.samples++;
+    sink_.publish(sample);
+}
+
+/**
+ * @brief Runs one job on its sensor
+ *
+ * @param[in] job job that is due
+ * @param[in] now host time the job was started
+ * @return Deadline of the next run of this job
+ */
+uint64_t BusWorker::runJob(const job_type &job, uint64_t now)
+{
+    sensor_type &s = sensors_[job.sensor];
+    APDS9960 &apds = *s.apds;
+    apds_sample_type sample = apds_sample_type();
+
+    host::attachDevice(APDS9960_I2C_ADDR, s.dev.get());
+
+    switch( job.kind ) {
+        case JOB_COLOR: {
+            uint8_t status = apds.readColorIfNew(sample.clear, sample.red,
+                                                 sample.green, sample.blue);
+            if( status == ERROR ) {
+                stats_.errors++;
+                return now + s.config.color_period_us;
+            }
+            if( status == 0 ) {
+                return apds.nextAlsReadyAt();
+            }
+            sample.kind = SAMPLE_COLOR;
+            publish(job.sensor, sample);
+
+            /* The next integration, or later if the period is longer */
+            uint64_t next = apds.nextAlsReadyAt();
+            if( next < now + s.config.color_period_us ) {
+                next = now + s.config.color_period_us;
+            }
+            return next;
+        }
+
+        case JOB_PROXIMITY:
+            if( !apds.readProximity(sample.pdata) ) {
+                stats_.errors++;
+            } else {
+                sample.kind = SAMPLE_PROXIMITY;
+                publish(job.sensor, sample);
+            }
+            return now + s.config.prox_period_us;
+
+        case JOB_GESTURE: {
+            int gesture = apds.readGesture(WORKER_GESTURE_BUDGET_US);
+            if( gesture == GESTURE_PENDING ) {
+                return host::nowMicros() + FIFO_PAUSE_TIME * 1000UL;
+            }
+            if( gesture == ERROR ) {
+                stats_.errors++;
+            } else if( gesture ) {
+                sample.kind = SAMPLE_GESTURE;
+                sample.gesture = gesture;
+                publish(job.sensor, sample);
+            }
+            return host::nowMicros() + WORKER_GESTURE_POLL_US;
+        }
+    }
+    return now;
+}
+
+/**
+ * @brief Worker thread: runs the earliest job, sleeps until the next one
+ */
+void BusWorker::run(uint64_t duration_us)
+{
+    std::priority_queue<job_type, std::vector<job_type>, std::greater<job_type> > jobs;
+    std::vector<bool> ready(sensors_.size());
+
+    host::resetBusStats();
+    for( uint16_t i = 0; i < sensors_.size(); i++ ) {
+        ready[i] = setup(i);
+        if( !ready[i] ) {
+            stats_.errors++;
+        }
+    }
+
+    /* Deadlines start once every sensor is up */
+    uint64_t start = host::nowMicros();
+    for( uint16_t i = 0; i < sensors_.size(); i++ ) {
+        const sensor_config_type &config = sensors_[i].config;
+        if( !ready[i] ) {
+            continue;
+        }
+        if( config.color_period_us ) {
+            jobs.push(job_type{start, i, JOB_COLOR});
+        }
+        if( config.prox_period_us ) {
+            jobs.push(job_type{start, i, JOB_PROXIMITY});
+        }
+        if( config.gesture ) {
+            jobs.push(job_type{start, i, JOB_GESTURE});
+        }
+    }
+
+    while( !stop_ && !jobs.empty() ) {
+        uint64_t now = host::nowMicros();
+        if( duration_us && now - start >= duration_us ) {
+            break;
+        }
+
+        job_type job = jobs.top();
+        if( job.due_us > now ) {
+            uint64_t sleep = job.due_us - now;
+            host::advanceMicros(sleep < WORKER_MAX_SLEEP_US ? sleep : WORKER_MAX_SLEEP_US);
+            continue;
+        }
+
+        uint64_t late = now - job.due_us;
+        stats_.late_us_total += late;
+        if( late > stats_.late_us_max ) {
+            stats_.late_us_max = late;
+        }
+        stats_.jobs++;
+
+        jobs.pop();
+        job.due_us = runJob(job, now);
+        jobs.push(job);
+    }
+
+    stats_.run_us = host::nowMicros() - start;
+    stats_.i2c_transactions = host::getBusStats().transactions;
+    stats_.i2c_bus_us = host::getBusStats().bus_us;
+    for( uint16_t i = 0; i < sensors_.size(); i++ ) {
+        sensors_[i].apds.reset();
+        sensors_[i].dev.reset();
+    }
+}
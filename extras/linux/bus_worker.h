@@ -0,0 +1,116 @@
+/**
+ * bus_worker.h
+ *
+ * One thread serving every APDS-9960 on one physical I2C bus. Buses are
+ * independent, so each gets a worker; the sensors of a bus share it and
+ * their transactions are serialized in that thread.
+ *
+ * Every sensor has up to three jobs (color, proximity, gesture), each
+ * with a deadline. The worker runs the job with the earliest deadline
+ * and sleeps until the next one, so a slow sensor delays the others on
+ * its bus by at most one job. Gestures are read with readGesture(budget)
+ * to keep those jobs short.
+ *
+ * Sensors behind a mux appear on Linux as separate adapters (one per mux
+ * channel), so a worker is given one host::I2CDevice per sensor and
+ * attaches it to the thread's Wire before each job. Fake buses
+ * (APDS9960Sim) are created inside the worker through a factory, because
+ * the device table and virtual clock of ../host are per thread.
+ */
+
+#ifndef _APDS9960_BUS_WORKER_H_
+#define _APDS9960_BUS_WORKER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "host.h"
+#include "APDS9960.h"
+#include "sample.h"
+
+/* Job timing */
+#define WORKER_GESTURE_BUDGET_US    2000    // Longest readGesture() call (us)
+#define WORKER_GESTURE_POLL_US      10000   // GSTATUS poll period (us)
+#define WORKER_MAX_SLEEP_US         100000  // Longest sleep between stop checks
+
+/* What to read from one sensor */
+typedef struct sensor_config_type {
+    uint32_t color_period_us;   // 0 for off, else at most one RGBC per period
+    uint32_t prox_period_us;    // 0 for off
+    bool gesture;
+} sensor_config_type;
+
+/* Per-worker counters */
+typedef struct worker_stats_type {
+    uint32_t jobs;
+    uint32_t samples;
+    uint32_t errors;            // failed reads and failed sensor setups
+    uint64_t late_us_total;     // time jobs started after their deadline
+    uint32_t late_us_max;
+    uint64_t run_us;            // host time covered by the worker
+    uint32_t i2c_transactions;
+    uint64_t i2c_bus_us;
+} worker_stats_type;
+
+class BusWorker
+{
+public:
+    // Makes the I2C device of sensor 'index', called in the worker thread
+    typedef std::function<std::unique_ptr<host::I2CDevice>(int index)> device_factory;
+
+    BusWorker(uint16_t bus, SampleSink &sink);
+    ~BusWorker();
+
+    void addSensor(device_factory factory, const sensor_config_type &config);
+
+    // Start the thread, run for duration_us of host time (0 until stop())
+    void start(uint64_t duration_us = 0);
+    void stop();
+    void join();
+
+    // Valid after join()
+    const worker_stats_type &stats() const { return stats_; }
+
+private:
+    enum job_kind
+    {
+        JOB_COLOR,
+        JOB_PROXIMITY,
+        JOB_GESTURE
+    };
+
+    struct job_type
+    {
+        uint64_t due_us;
+        uint16_t sensor;
+        job_kind kind;
+
+        bool operator>(const job_type &other) const { return due_us > other.due_us; }
+    };
+
+    struct sensor_type
+    {
+        device_factory factory;
+        sensor_config_type config;
+        std::unique_ptr<host::I2CDevice> dev;
+        std::unique_ptr<APDS9960> apds;
+    };
+
+    void run(uint64_t duration_us);
+    bool setup(uint16_t index);
+    uint64_t runJob(const job_type &job, uint64_t now);
+    void publish(uint16_t sensor, apds_sample_type &sample);
+
+    uint16_t bus_;
+    SampleSink &sink_;
+    std::vector<sensor_type> sensors_;
+    std::thread thread_;
+    std::atomic<bool> stop_;
+    worker_stats_type stats_;
+};
+
+#endif
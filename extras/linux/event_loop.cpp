@@ -0,0 +1,168 @@
+/**
+ * event_loop.cpp
+ *
+ * epoll/timerfd event loop, see event_loop.h.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "host.h"
+#include "event_loop.h"
+
+#define MAX_EVENTS      16
+
+EventLoop::EventLoop() :
+    stopped_(false),
+    wakeups_(0)
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if( epoll_fd_ < 0 || timer_fd_ < 0 ) {
+        perror("event loop");
+        return;
+    }
+
+    struct epoll_event ev = epoll_event();
+    ev.events = EPOLLIN;
+    ev.data.fd = timer_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+}
+
+EventLoop::~EventLoop()
+{
+    if( timer_fd_ >= 0 ) {
+        close(timer_fd_);
+    }
+    if( epoll_fd_ >= 0 ) {
+        close(epoll_fd_);
+    }
+}
+
+bool EventLoop::watch(int fd, std::function<void()> fn)
+{
+    struct epoll_event ev = epoll_event();
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if( epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0 ) {
+        return false;
+    }
+    fds_[fd] = fn;
+    return true;
+}
+
+void EventLoop::unwatch(int fd)
+{
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+    fds_.erase(fd);
+}
+
+void EventLoop::schedule(uint64_t at_us, std::function<void()> fn)
+{
+    timers_.insert(std::make_pair(at_us, fn));
+}
+
+void EventLoop::post(std::function<void()> fn)
+{
+    schedule(host::nowMicros(), fn);
+}
+
+/**
+ * @brief Runs every timer that is due, including ones they schedule
+ */
+void EventLoop::runTimers()
+{
+    while( !stopped_ && !timers_.empty() &&
+           timers_.begin()->first <= host::nowMicros() ) {
+        std::function<void()> fn = timers_.begin()->second;
+        timers_.erase(timers_.begin());
+        fn();
+    }
+}
+
+/**
+ * @brief Waits up to timeout_ms for file descriptors and calls their handlers
+ */
+void EventLoop::dispatch(int timeout_ms)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+    if( n < 0 && errno != EINTR ) {
+        perror("epoll_wait");
+        stopped_ = true;
+        return;
+    }
+    if( n > 0 ) {
+        wakeups_++;
+    }
+
+    for( int i = 0; i < n && !stopped_; i++ ) {
+        int fd = events[i].data.fd;
+        if( fd == timer_fd_ ) {
+            uint64_t expirations;
+            if( read(timer_fd_, &expirations, sizeof(expirations)) < 0 ) {
+                /* Spurious wakeup, the timers are checked anyway */
+            }
+            continue;
+        }
+
+        /* The handler may unwatch its own descriptor */
+        std::map<int, std::function<void()> >::iterator it = fds_.find(fd);
+        if( it != fds_.end() ) {
+            std::function<void()> fn = it->second;
+            fn();
+        }
+    }
+}
+
+/**
+ * @brief Arms the timerfd for the earliest timer
+ *
+ * host::nowMicros() reads CLOCK_MONOTONIC in CLOCK_REAL mode, so the
+ * deadline is set as an absolute time on the same clock.
+ */
+void EventLoop::armTimer()
+{
+    struct itimerspec its = itimerspec();
+
+    if( !timers_.empty() ) {
+        uint64_t at = timers_.begin()->first;
+        if( at == 0 ) {
+            at = 1;
+        }
+        its.it_value.tv_sec = at / 1000000;
+        its.it_value.tv_nsec = (at % 1000000) * 1000;
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void EventLoop::run()
+{
+    stopped_ = false;
+
+    while( !stopped_ ) {
+        runTimers();
+        if( stopped_ || (timers_.empty() && fds_.empty()) ) {
+            break;
+        }
+
+        if( host::getClockMode() == host::CLOCK_REAL ) {
+            armTimer();
+            dispatch(-1);
+        } else if( timers_.empty() ) {
+            dispatch(-1);
+        } else {
+            uint32_t before = wakeups_;
+            dispatch(0);
+            uint64_t now = host::nowMicros();
+            uint64_t next = timers_.begin()->first;
+            if( wakeups_ == before && next > now ) {
+                host::advanceMicros(next - now);
+            }
+        }
+    }
+}
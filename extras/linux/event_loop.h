@@ -0,0 +1,55 @@
+/**
+ * event_loop.h
+ *
+ * Single-threaded event loop for the Linux gateway build: file
+ * descriptors (GPIO line events) watched with epoll and one-shot timers
+ * on the host clock of ../host, armed through a timerfd.
+ *
+ * In CLOCK_VIRTUAL mode nothing happens between events, so when no file
+ * descriptor is ready the loop jumps the virtual clock straight to the
+ * next timer. The same code then runs against APDS9960Sim in
+ * deterministic time.
+ */
+
+#ifndef _APDS9960_EVENT_LOOP_H_
+#define _APDS9960_EVENT_LOOP_H_
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+
+class EventLoop
+{
+public:
+    EventLoop();
+    ~EventLoop();
+
+    // Call fn whenever fd is readable. Return false if epoll refused it.
+    bool watch(int fd, std::function<void()> fn);
+    void unwatch(int fd);
+
+    // Call fn once at host time at_us (micros() scale)
+    void schedule(uint64_t at_us, std::function<void()> fn);
+    // Call fn from the loop as soon as possible
+    void post(std::function<void()> fn);
+
+    // Dispatch until stop() or until there is nothing left to wait for
+    void run();
+    void stop() { stopped_ = true; }
+
+    uint32_t wakeups() const { return wakeups_; }
+
+private:
+    void runTimers();
+    void dispatch(int timeout_ms);
+    void armTimer();
+
+    int epoll_fd_;
+    int timer_fd_;
+    bool stopped_;
+    uint32_t wakeups_;
+    std::multimap<uint64_t, std::function<void()> > timers_;
+    std::map<int, std::function<void()> > fds_;
+};
+
+#endif
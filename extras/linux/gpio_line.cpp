@@ -0,0 +1,97 @@
+/**
+ * gpio_line.cpp
+ *
+ * GPIO character device (uAPI v2) input line, see gpio_line.h.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "gpio_line.h"
+
+GpioLine::GpioLine() :
+    fd_(-1)
+{
+}
+
+GpioLine::~GpioLine()
+{
+    close();
+}
+
+bool GpioLine::open(const char *path, uint32_t offset, const char *consumer)
+{
+    close();
+
+    int chip = ::open(path, O_RDWR | O_CLOEXEC);
+    if( chip < 0 ) {
+        perror(path);
+        return false;
+    }
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = offset;
+    req.num_lines = 1;
+    strncpy(req.consumer, consumer, GPIO_MAX_NAME_SIZE - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+                       GPIO_V2_LINE_FLAG_EDGE_FALLING |
+                       GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+
+    int ret = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+    ::close(chip);
+    if( ret < 0 ) {
+        perror("GPIO_V2_GET_LINE_IOCTL");
+        return false;
+    }
+
+    /* Events are drained until EAGAIN */
+    fd_ = req.fd;
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void GpioLine::close()
+{
+    if( fd_ >= 0 ) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+int GpioLine::level()
+{
+    struct gpio_v2_line_values values;
+
+    if( fd_ < 0 ) {
+        return -1;
+    }
+    values.bits = 0;
+    values.mask = 1;
+    if( ioctl(fd_, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0 ) {
+        return -1;
+    }
+    return (int)(values.bits & 1);
+}
+
+int GpioLine::drain()
+{
+    struct gpio_v2_line_event events[16];
+    int count = 0;
+
+    if( fd_ < 0 ) {
+        return 0;
+    }
+    for( ;; ) {
+        ssize_t n = ::read(fd_, events, sizeof(events));
+        if( n <= 0 ) {
+            break;
+        }
+        count += n / sizeof(events[0]);
+    }
+    return count;
+}
@@ -0,0 +1,36 @@
+/**
+ * gpio_line.h
+ *
+ * The APDS-9960 INT pin on a GPIO character device (/dev/gpiochipN),
+ * requested through the v2 uAPI as an input with pull-up and falling
+ * edge events. The request fd becomes readable on each edge and is
+ * watched by the EventLoop.
+ */
+
+#ifndef _APDS9960_GPIO_LINE_H_
+#define _APDS9960_GPIO_LINE_H_
+
+#include <stdint.h>
+
+class GpioLine
+{
+public:
+    GpioLine();
+    ~GpioLine();
+
+    // Request line 'offset' of the chip at 'path'
+    bool open(const char *path, uint32_t offset, const char *consumer);
+    void close();
+
+    // Request fd, readable when edge events are queued
+    int fd() const { return fd_; }
+    // Current level, LOW (0) while INT is asserted, -1 on error
+    int level();
+    // Discard queued edge events, return how many there were
+    int drain();
+
+private:
+    int fd_;
+};
+
+#endif
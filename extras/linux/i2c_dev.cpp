@@ -0,0 +1,64 @@
+/**
+ * i2c_dev.cpp
+ *
+ * Linux i2c-dev transport, see i2c_dev.h.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "i2c_dev.h"
+
+I2CDevBus::I2CDevBus() :
+    fd_(-1)
+{
+}
+
+I2CDevBus::~I2CDevBus()
+{
+    close();
+}
+
+bool I2CDevBus::open(const char *path, uint8_t addr)
+{
+    close();
+    fd_ = ::open(path, O_RDWR | O_CLOEXEC);
+    if( fd_ < 0 ) {
+        perror(path);
+        return false;
+    }
+    if( ioctl(fd_, I2C_SLAVE, (long)addr) < 0 ) {
+        perror("I2C_SLAVE");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void I2CDevBus::close()
+{
+    if( fd_ >= 0 ) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool I2CDevBus::write(const uint8_t *data, size_t len)
+{
+    if( fd_ < 0 ) {
+        return false;
+    }
+    return ::write(fd_, data, len) == (ssize_t)len;
+}
+
+size_t I2CDevBus::read(uint8_t *data, size_t len)
+{
+    if( fd_ < 0 ) {
+        return 0;
+    }
+    ssize_t n = ::read(fd_, data, len);
+    return n < 0 ? 0 : (size_t)n;
+}
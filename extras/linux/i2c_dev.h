@@ -0,0 +1,37 @@
+/**
+ * i2c_dev.h
+ *
+ * An APDS-9960 on a Linux I2C adapter (/dev/i2c-N), plugged in under the
+ * Wire shim of ../host as a host::I2CDevice. Each Wire transaction
+ * becomes one read() or write() on the adapter, so the driver's register
+ * writes and reads keep their START..STOP framing.
+ */
+
+#ifndef _APDS9960_I2C_DEV_H_
+#define _APDS9960_I2C_DEV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "host.h"
+
+class I2CDevBus : public host::I2CDevice
+{
+public:
+    I2CDevBus();
+    ~I2CDevBus();
+
+    // Open the adapter and address the device at addr
+    bool open(const char *path, uint8_t addr);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+    // I2C device
+    bool write(const uint8_t *data, size_t len);
+    size_t read(uint8_t *data, size_t len);
+
+private:
+    int fd_;
+};
+
+#endif
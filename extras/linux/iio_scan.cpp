@@ -0,0 +1,215 @@
+/**
+ * iio_scan.cpp
+ *
+ * Buffered capture with ScanBuffer: lists the scan elements, then reads
+ * the buffer in bulk each time it reaches the watermark and prints one
+ * line per read.
+ *
+ * Usage: iio_scan [options] adapter[,gpiochip,line]
+ *        iio_scan [options] --sim
+ *
+ *   --channels a,b,..  clear, red, green, blue, prox, up, down, left,
+ *                      right, timestamp (default: all)
+ *   --timer ms         timer trigger instead of data-ready
+ *   --length n         buffer length in scans (default 256)
+ *   --watermark n      scans per bulk read (default 64)
+ *   --seconds s        capture time (default 10)
+ *
+ * With --sim the sensor is APDS9960Sim in virtual time, seeing four
+ * swipes. With a GPIO line, GIEN is set and the FIFO is read on the INT
+ * edge; ALS and proximity are polled in both cases.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "Arduino.h"
+#include "host.h"
+#include "APDS9960Sim.h"
+#include "gpio_line.h"
+#include "i2c_dev.h"
+#include "scan_buffer.h"
+
+static const char *channel_names[SCAN_ELEMENTS] = {
+    "clear", "red", "green", "blue", "prox", "up", "down", "left", "right", "timestamp"
+};
+
+static bool enableChannels(ScanBuffer &buffer, const char *list)
+{
+    std::string arg(list);
+    size_t pos = 0;
+
+    for( ;; ) {
+        size_t comma = arg.find(',', pos);
+        std::string name = arg.substr(pos, comma - pos);
+        uint8_t i;
+        for( i = 0; i < SCAN_ELEMENTS; i++ ) {
+            if( name == channel_names[i] ) {
+                buffer.enableElement(i, true);
+                break;
+            }
+        }
+        if( i == SCAN_ELEMENTS ) {
+            fprintf(stderr, "unknown channel %s\n", name.c_str());
+            return false;
+        }
+        if( comma == std::string::npos ) {
+            return true;
+        }
+        pos = comma + 1;
+    }
+}
+
+static Trajectory simScene()
+{
+    sim_target_t ambient = sim_target_t();
+    ambient.prox = 0.01f;
+    ambient.u = ambient.d = ambient.l = ambient.r = 0.01f;
+    ambient.clear = 20;
+    ambient.red = 8;
+    ambient.green = 7;
+    ambient.blue = 5;
+
+    Trajectory scene;
+    scene.at(0, ambient);
+    scene.append(Trajectory::swipe(1000000, 300000, SWIPE_U_TO_D, 0.15f, ambient));
+    scene.append(Trajectory::swipe(3000000, 300000, SWIPE_D_TO_U, 0.15f, ambient));
+    scene.append(Trajectory::swipe(5000000, 300000, SWIPE_L_TO_R, 0.15f, ambient));
+    scene.append(Trajectory::swipe(7000000, 300000, SWIPE_R_TO_L, 0.15f, ambient));
+    return scene;
+}
+
+int main(int argc, char **argv)
+{
+    const char *channels = NULL;
+    const char *device = NULL;
+    bool sim_mode = false;
+    uint32_t timer_ms = 0;
+    uint32_t length = SCAN_DEFAULT_LENGTH;
+    uint32_t watermark = SCAN_DEFAULT_WATERMARK;
+    unsigned long seconds = 10;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--channels") && i + 1 < argc ) {
+            channels = argv[++i];
+        } else if( !strcmp(argv[i], "--timer") && i + 1 < argc ) {
+            timer_ms = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--length") && i + 1 < argc ) {
+            length = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--watermark") && i + 1 < argc ) {
+            watermark = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--seconds") && i + 1 < argc ) {
+            seconds = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--sim") ) {
+            sim_mode = true;
+        } else if( argv[i][0] != '-' && !device ) {
+            device = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [options] adapter[,gpiochip,line]\n"
+                            "       %s [options] --sim\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    APDS9960Sim sim;
+    I2CDevBus bus;
+    GpioLine line;
+    if( sim_mode ) {
+        host::setClockMode(host::CLOCK_VIRTUAL);
+        sim.setTrajectory(simScene());
+        sim.setNoise(2);
+        sim.attach();
+    } else if( device ) {
+        host::setClockMode(host::CLOCK_REAL);
+        std::string arg(device);
+        size_t comma = arg.find(',');
+        if( !bus.open(arg.substr(0, comma).c_str(), APDS9960_I2C_ADDR) ) {
+            return 1;
+        }
+        if( comma != std::string::npos ) {
+            size_t comma2 = arg.find(',', comma + 1);
+            if( comma2 == std::string::npos ||
+                !line.open(arg.substr(comma + 1, comma2 - comma - 1).c_str(),
+                           atoi(arg.c_str() + comma2 + 1), "apds9960-int") ) {
+                return 1;
+            }
+        }
+        host::attachDevice(APDS9960_I2C_ADDR, &bus);
+    } else {
+        fprintf(stderr, "no device\n");
+        return 2;
+    }
+
+    APDS9960 apds;
+    ScanBuffer buffer(apds);
+    if( !apds.init() ) {
+        printf("init failed\n");
+        return 1;
+    }
+    if( channels ? !enableChannels(buffer, channels) : false ) {
+        return 2;
+    }
+    for( uint8_t i = 0; !channels && i < SCAN_ELEMENTS; i++ ) {
+        buffer.enableElement(i, true);
+    }
+    if( !buffer.setTrigger(timer_ms ? SCAN_TRIGGER_TIMER : SCAN_TRIGGER_DATA_READY,
+                           timer_ms * 1000, line.fd() >= 0) ||
+        !buffer.setLength(length) || !buffer.setWatermark(watermark) ||
+        !buffer.enableBuffer() ) {
+        printf("buffer setup failed\n");
+        return 1;
+    }
+    buffer.describe(Serial);
+    printf("scan %u bytes\n", (unsigned)buffer.scanBytes());
+    host::resetBusStats();
+
+    std::vector<uint8_t> data((size_t)length * buffer.scanBytes());
+    unsigned long start = millis();
+    uint32_t reads = 0;
+    uint32_t scans = 0;
+
+    while( millis() - start < seconds * 1000 ) {
+        bool ready = buffer.poll();
+        if( ready ) {
+            size_t n = buffer.read(data.data(), data.size());
+            const uint8_t *last = &data[n - buffer.scanBytes()];
+            reads++;
+            scans += n / buffer.scanBytes();
+            printf("%6lu ms: read %u scans (%u bytes), last C %lld P %lld "
+                   "UDLR %lld %lld %lld %lld\n", millis(),
+                   (unsigned)(n / buffer.scanBytes()), (unsigned)n,
+                   (long long)buffer.value(last, SCAN_CLEAR),
+                   (long long)buffer.value(last, SCAN_PROXIMITY),
+                   (long long)buffer.value(last, SCAN_GESTURE_UP),
+                   (long long)buffer.value(last, SCAN_GESTURE_DOWN),
+                   (long long)buffer.value(last, SCAN_GESTURE_LEFT),
+                   (long long)buffer.value(last, SCAN_GESTURE_RIGHT));
+            continue;
+        }
+
+        /* Sleep until the next poll, or the INT edge */
+        long wait_us = (long)(buffer.nextPollAt() - micros());
+        if( wait_us <= 0 ) {
+            continue;
+        }
+        if( line.fd() >= 0 ) {
+            struct pollfd pfd = { line.fd(), POLLIN, 0 };
+            if( ::poll(&pfd, 1, (wait_us + 999) / 1000) > 0 ) {
+                line.drain();
+                buffer.trigger();
+            }
+        } else {
+            delayMicroseconds(wait_us);
+        }
+    }
+
+    const scan_stats_type &st = buffer.stats();
+    printf("%u scans in %u reads, %u left, %u overflows, %u polls, %u errors, "
+           "I2C transactions %u\n", scans, reads, buffer.available(), st.overflows,
+           st.polls, st.errors, host::getBusStats().transactions);
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * sample.cpp
+ *
+ * Text form of apds_sample_type, see sample.h.
+ */
+
+#include "sample.h"
+
+void printSample(FILE *out, const apds_sample_type &s)
+{
+    fprintf(out, "%llu %u %u ", (unsigned long long)(s.time_us / 1000), s.bus, s.sensor);
+    switch( s.kind ) {
+        case SAMPLE_COLOR:
+            fprintf(out, "color %u %u %u %u\n", s.clear, s.red, s.green, s.blue);
+            break;
+        case SAMPLE_PROXIMITY:
+            fprintf(out, "prox %u\n", s.pdata);
+            break;
+        case SAMPLE_GESTURE:
+            fprintf(out, "gesture 0x%02X\n", s.gesture);
+            break;
+        default:
+            fprintf(out, "kind %u\n", s.kind);
+            break;
+    }
+}
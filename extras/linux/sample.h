@@ -0,0 +1,46 @@
+/**
+ * sample.h
+ *
+ * Fixed-layout sensor sample published by the gateway daemon, and the
+ * interface samples are published through.
+ */
+
+#ifndef _APDS9960_SAMPLE_H_
+#define _APDS9960_SAMPLE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Sample kinds */
+#define SAMPLE_COLOR            1
+#define SAMPLE_PROXIMITY        2
+#define SAMPLE_GESTURE          3
+
+/* One result of one sensor, 24 bytes */
+typedef struct apds_sample_type {
+    uint64_t time_us;       // host monotonic time of the read
+    uint16_t bus;           // worker index
+    uint16_t sensor;        // sensor index on the bus
+    uint8_t kind;           // SAMPLE_*
+    uint8_t pdata;          // SAMPLE_PROXIMITY
+    uint16_t gesture;       // SAMPLE_GESTURE, DIR_* or FLAG_* bits
+    uint16_t clear;         // SAMPLE_COLOR
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+} apds_sample_type;
+
+static_assert(sizeof(apds_sample_type) == 24, "apds_sample_type layout");
+
+// One text line: time (ms), bus, sensor, kind, values
+void printSample(FILE *out, const apds_sample_type &sample);
+
+/* Receives samples from every bus worker, publish() must be thread safe */
+class SampleSink
+{
+public:
+    virtual ~SampleSink() {}
+    virtual void publish(const apds_sample_type &sample) = 0;
+};
+
+#endif
@@ -0,0 +1,373 @@
+/**
+ * scan_buffer.cpp
+ *
+ * IIO-style buffered scans, see scan_buffer.h.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "scan_buffer.h"
+
+/* STATUS..PDATA in one burst */
+#define SCAN_BURST_LEN          (APDS9960_PDATA - APDS9960_STATUS + 1)
+
+static const scan_element_type default_elements[SCAN_ELEMENTS] = {
+    { "in_intensity_clear",  SCAN_CLEAR,          false, 16, 16, false, 0 },
+    { "in_intensity_red",    SCAN_RED,            false, 16, 16, false, 0 },
+    { "in_intensity_green",  SCAN_GREEN,          false, 16, 16, false, 0 },
+    { "in_intensity_blue",   SCAN_BLUE,           false, 16, 16, false, 0 },
+    { "in_proximity",        SCAN_PROXIMITY,      false, 8,  8,  false, 0 },
+    { "in_proximity_up",     SCAN_GESTURE_UP,     false, 8,  8,  false, 0 },
+    { "in_proximity_down",   SCAN_GESTURE_DOWN,   false, 8,  8,  false, 0 },
+    { "in_proximity_left",   SCAN_GESTURE_LEFT,   false, 8,  8,  false, 0 },
+    { "in_proximity_right",  SCAN_GESTURE_RIGHT,  false, 8,  8,  false, 0 },
+    { "in_timestamp",        SCAN_TIMESTAMP,      true,  64, 64, false, 0 }
+};
+
+ScanBuffer::ScanBuffer(APDS9960 &apds) :
+    apds_(apds),
+    trigger_(SCAN_TRIGGER_DATA_READY),
+    period_us_(0),
+    int_line_(false),
+    gesture_us_(0),
+    length_(SCAN_DEFAULT_LENGTH),
+    watermark_(SCAN_DEFAULT_WATERMARK),
+    enabled_(false),
+    scan_bytes_(0),
+    head_(0),
+    count_(0),
+    next_poll_us_(0),
+    stats_()
+{
+    memcpy(elements_, default_elements, sizeof(elements_));
+    memset(values_, 0, sizeof(values_));
+}
+
+bool ScanBuffer::enableElement(uint8_t index, bool enable)
+{
+    if( enabled_ || index >= SCAN_ELEMENTS ) {
+        return false;
+    }
+    elements_[index].enabled = enable;
+    return true;
+}
+
+void ScanBuffer::describe(Print &out) const
+{
+    for( uint8_t i = 0; i < SCAN_ELEMENTS; i++ ) {
+        const scan_element_type &e = elements_[i];
+        out.print(e.name);
+        out.print(" en ");
+        out.print(e.enabled ? 1 : 0);
+        out.print(" index ");
+        out.print(e.index);
+        out.print(e.storagebits > 8 ? " le:" : " ");
+        out.print(e.is_signed ? 's' : 'u');
+        out.print(e.realbits);
+        out.print('/');
+        out.print(e.storagebits);
+        out.print(">>0");
+        if( e.enabled ) {
+            out.print(" offset ");
+            out.print(e.offset);
+        }
+        out.println();
+    }
+}
+
+bool ScanBuffer::setTrigger(scan_trigger_type trigger, uint32_t period_us,
+                            bool int_line)
+{
+    if( enabled_ || (trigger == SCAN_TRIGGER_TIMER && !period_us) ) {
+        return false;
+    }
+    trigger_ = trigger;
+    period_us_ = period_us;
+    int_line_ = int_line;
+    return true;
+}
+
+bool ScanBuffer::setLength(uint32_t scans)
+{
+    if( enabled_ || !scans ) {
+        return false;
+    }
+    length_ = scans;
+    return true;
+}
+
+bool ScanBuffer::setWatermark(uint32_t scans)
+{
+    if( !scans ) {
+        return false;
+    }
+    watermark_ = scans;
+    return true;
+}
+
+bool ScanBuffer::enabledAny(uint8_t first, uint8_t last) const
+{
+    for( uint8_t i = first; i <= last; i++ ) {
+        if( elements_[i].enabled ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Packs the enabled elements and turns on the engines behind them
+ *
+ * @return True if the buffer is running. False otherwise.
+ */
+bool ScanBuffer::enableBuffer()
+{
+    cycle_timing_type timing;
+    size_t offset = 0;
+    size_t align = 1;
+
+    if( enabled_ ) {
+        return true;
+    }
+
+    /* Each element aligned to its size, the scan to the largest one */
+    for( uint8_t i = 0; i < SCAN_ELEMENTS; i++ ) {
+        scan_element_type &e = elements_[i];
+        if( !e.enabled ) {
+            continue;
+        }
+        size_t bytes = e.storagebits / 8;
+        offset = (offset + bytes - 1) / bytes * bytes;
+        e.offset = offset;
+        offset += bytes;
+        if( bytes > align ) {
+            align = bytes;
+        }
+    }
+    if( !offset ) {
+        return false;
+    }
+    scan_bytes_ = (offset + align - 1) / align * align;
+
+    if( enabledAny(SCAN_CLEAR, SCAN_BLUE) && !apds_.enableLightSensor(false) ) {
+        return false;
+    }
+    if( enabledAny(SCAN_PROXIMITY, SCAN_PROXIMITY) &&
+        !apds_.enableProximitySensor(false) ) {
+        return false;
+    }
+    if( enabledAny(SCAN_GESTURE_UP, SCAN_GESTURE_RIGHT) &&
+        !apds_.enableGestureSensor(int_line_ && trigger_ == SCAN_TRIGGER_DATA_READY) ) {
+        return false;
+    }
+    if( !apds_.getCycleTiming(timing) ) {
+        return false;
+    }
+    gesture_us_ = timing.gesture_us;
+
+    /* Poll four times per ALS/proximity cycle, at least at the FIFO
+       read pace with gestures */
+    if( trigger_ == SCAN_TRIGGER_DATA_READY && !period_us_ ) {
+        period_us_ = FIFO_PAUSE_TIME * 1000UL;
+        if( enabledAny(SCAN_CLEAR, SCAN_PROXIMITY) &&
+            (timing.period_us / 4 < period_us_ || !gesture_us_) ) {
+            period_us_ = timing.period_us / 4;
+        }
+    }
+
+    ring_.assign((size_t)length_ * scan_bytes_, 0);
+    head_ = 0;
+    count_ = 0;
+    stats_ = scan_stats_type();
+    next_poll_us_ = micros();
+    enabled_ = true;
+    return true;
+}
+
+void ScanBuffer::disableBuffer()
+{
+    enabled_ = false;
+}
+
+bool ScanBuffer::readRegs(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    i2c_transfer_type xfer;
+
+    xfer.reg = reg;
+    xfer.buf = buf;
+    xfer.len = len;
+    xfer.read = true;
+    xfer.done = NULL;
+    xfer.context = NULL;
+    if( !apds_.submitTransfer(xfer) || apds_.waitTransfer(xfer) != len ) {
+        stats_.errors++;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads up to max_records gesture datasets from the FIFO
+ *
+ * @return Number of datasets read, -1 on error
+ */
+int ScanBuffer::readFifo(uint8_t *records, uint8_t max_records)
+{
+    uint8_t regs[2];
+
+    /* GFLVL and GSTATUS */
+    if( !readRegs(APDS9960_GFLVL, regs, 2) ) {
+        return -1;
+    }
+    if( !(regs[1] & APDS9960_GVALID) && !regs[0] ) {
+        return 0;
+    }
+
+    uint8_t level = regs[0] < max_records ? regs[0] : max_records;
+    for( uint8_t done = 0; done < level; ) {
+        uint8_t n = level - done;
+        if( n > FIFO_READ_RECORDS ) {
+            n = FIFO_READ_RECORDS;
+        }
+        if( !readRegs(APDS9960_GFIFO_U, records + done * 4, n * 4) ) {
+            return -1;
+        }
+        done += n;
+    }
+    return level;
+}
+
+/**
+ * @brief Appends one scan of the current values, dropped if the buffer is full
+ */
+void ScanBuffer::push(unsigned long time_us)
+{
+    if( count_ >= length_ ) {
+        stats_.overflows++;
+        return;
+    }
+
+    uint8_t *scan = &ring_[(size_t)((head_ + count_) % length_) * scan_bytes_];
+    memset(scan, 0, scan_bytes_);
+    for( uint8_t i = 0; i < SCAN_ELEMENTS; i++ ) {
+        const scan_element_type &e = elements_[i];
+        if( !e.enabled ) {
+            continue;
+        }
+        uint64_t v = (i == SCAN_TIMESTAMP) ? (uint64_t)time_us : values_[i];
+        for( uint8_t b = 0; b < e.storagebits / 8; b++ ) {
+            scan[e.offset + b] = (uint8_t)(v >> (8 * b));
+        }
+    }
+    count_++;
+    stats_.scans++;
+}
+
+/**
+ * @brief Runs the trigger once nextPollAt() has passed
+ *
+ * @return True once watermark scans are buffered
+ */
+bool ScanBuffer::poll()
+{
+    unsigned long now = micros();
+
+    if( !enabled_ || (long)(next_poll_us_ - now) > 0 ) {
+        return isReady();
+    }
+    next_poll_us_ += period_us_;
+    if( (long)(next_poll_us_ - now) <= 0 ) {
+        next_poll_us_ = now + period_us_;
+    }
+    return trigger();
+}
+
+/**
+ * @brief Reads the device and pushes the scans the trigger produces
+ *
+ * @return True once watermark scans are buffered
+ */
+bool ScanBuffer::trigger()
+{
+    uint8_t burst[SCAN_BURST_LEN];
+    uint8_t records[32 * 4];
+    unsigned long now = micros();
+
+    if( !enabled_ ) {
+        return false;
+    }
+    stats_.polls++;
+
+    /* STATUS, CDATA..BDATA, PDATA */
+    bool new_rgbc = false;
+    bool new_prox = false;
+    if( enabledAny(SCAN_CLEAR, SCAN_PROXIMITY) ) {
+        if( !readRegs(APDS9960_STATUS, burst, SCAN_BURST_LEN) ) {
+            return isReady();
+        }
+        if( burst[0] & APDS9960_AVALID ) {
+            for( uint8_t i = SCAN_CLEAR; i <= SCAN_BLUE; i++ ) {
+                values_[i] = burst[1 + 2 * i] | ((uint16_t)burst[2 + 2 * i] << 8);
+            }
+            new_rgbc = enabledAny(SCAN_CLEAR, SCAN_BLUE);
+        }
+        if( burst[0] & APDS9960_PVALID ) {
+            values_[SCAN_PROXIMITY] = burst[SCAN_BURST_LEN - 1];
+            new_prox = elements_[SCAN_PROXIMITY].enabled;
+        }
+    }
+
+    int level = 0;
+    if( enabledAny(SCAN_GESTURE_UP, SCAN_GESTURE_RIGHT) ) {
+        level = readFifo(records, 32);
+    }
+
+    if( trigger_ == SCAN_TRIGGER_TIMER ) {
+        if( level > 0 ) {
+            for( uint8_t j = 0; j < 4; j++ ) {
+                values_[SCAN_GESTURE_UP + j] = records[(level - 1) * 4 + j];
+            }
+        }
+        push(now);
+    } else if( level > 0 ) {
+        /* One scan per dataset, the last one was taken just now */
+        for( int r = 0; r < level; r++ ) {
+            for( uint8_t j = 0; j < 4; j++ ) {
+                values_[SCAN_GESTURE_UP + j] = records[r * 4 + j];
+            }
+            push(now - (unsigned long)(level - 1 - r) * gesture_us_);
+        }
+    } else if( new_rgbc || new_prox ) {
+        push(now);
+    }
+
+    return isReady();
+}
+
+size_t ScanBuffer::read(uint8_t *buf, size_t len)
+{
+    size_t n = 0;
+
+    while( count_ && len - n >= scan_bytes_ ) {
+        memcpy(buf + n, &ring_[(size_t)head_ * scan_bytes_], scan_bytes_);
+        head_ = (head_ + 1) % length_;
+        count_--;
+        n += scan_bytes_;
+    }
+    return n;
+}
+
+int64_t ScanBuffer::value(const uint8_t *scan, uint8_t index) const
+{
+    const scan_element_type &e = elements_[index];
+    uint64_t v = 0;
+
+    if( !e.enabled ) {
+        return 0;
+    }
+    for( uint8_t b = 0; b < e.storagebits / 8; b++ ) {
+        v |= (uint64_t)scan[e.offset + b] << (8 * b);
+    }
+    return (int64_t)v;
+}
@@ -0,0 +1,152 @@
+/**
+ * scan_buffer.h
+ *
+ * IIO-style buffered capture from one APDS-9960: a set of scan elements
+ * (channels) is enabled, a trigger decides when a scan is taken, and
+ * scans are packed into a buffer that is read in bulk, as with
+ * /dev/iio:deviceN.
+ *
+ * Scan elements, in index order:
+ *
+ *   0 in_intensity_clear   le:u16/16>>0     5 in_proximity_up      u8/8>>0
+ *   1 in_intensity_red     le:u16/16>>0     6 in_proximity_down    u8/8>>0
+ *   2 in_intensity_green   le:u16/16>>0     7 in_proximity_left    u8/8>>0
+ *   3 in_intensity_blue    le:u16/16>>0     8 in_proximity_right   u8/8>>0
+ *   4 in_proximity         u8/8>>0          9 in_timestamp         le:s64/64>>0
+ *
+ * Enabled elements are packed in index order, each aligned to its own
+ * size, and the scan is padded to the largest alignment (the IIO rule).
+ *
+ * Triggers:
+ *  - SCAN_TRIGGER_DATA_READY: a scan per new result. STATUS, RGBC and
+ *    PDATA are read in one 10-byte burst; AVALID/PVALID decide whether
+ *    a scan is pushed. Every gesture FIFO dataset becomes a scan of its
+ *    own, timestamped back from the read by the dataset period, so a
+ *    full FIFO yields 32 scans from one GFLVL read and four 32-byte
+ *    bursts. Call trigger() on the INT edge (GIEN is set) and poll()
+ *    at nextPollAt() for the ALS and proximity results.
+ *  - SCAN_TRIGGER_TIMER: a scan every period with the latest values; the
+ *    gesture elements hold the newest FIFO dataset, the rest is drained.
+ *
+ * Register reads go through the driver's submitTransfer(), the bus of
+ * the sensor must be attached to Wire when poll() and enableBuffer() run.
+ */
+
+#ifndef _APDS9960_SCAN_BUFFER_H_
+#define _APDS9960_SCAN_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "APDS9960.h"
+
+/* Scan element indices */
+#define SCAN_CLEAR              0
+#define SCAN_RED                1
+#define SCAN_GREEN              2
+#define SCAN_BLUE               3
+#define SCAN_PROXIMITY          4
+#define SCAN_GESTURE_UP         5
+#define SCAN_GESTURE_DOWN       6
+#define SCAN_GESTURE_LEFT       7
+#define SCAN_GESTURE_RIGHT      8
+#define SCAN_TIMESTAMP          9
+#define SCAN_ELEMENTS           10
+
+/* Buffer defaults */
+#define SCAN_DEFAULT_LENGTH     256     // scans held by the buffer
+#define SCAN_DEFAULT_WATERMARK  64      // scans before isReady()
+
+/* Triggers */
+enum scan_trigger_type
+{
+    SCAN_TRIGGER_DATA_READY,
+    SCAN_TRIGGER_TIMER
+};
+
+/* One scan element, as in the scan_elements sysfs directory */
+typedef struct scan_element_type {
+    const char *name;
+    uint8_t index;
+    bool is_signed;
+    uint8_t realbits;
+    uint8_t storagebits;
+    bool enabled;
+    uint8_t offset;         // byte offset in the scan, valid while enabled
+} scan_element_type;
+
+/* Buffer counters */
+typedef struct scan_stats_type {
+    uint32_t scans;         // pushed into the buffer
+    uint32_t overflows;     // dropped on a full buffer
+    uint32_t polls;         // device reads by poll()
+    uint32_t errors;        // failed register reads
+} scan_stats_type;
+
+class ScanBuffer
+{
+public:
+    ScanBuffer(APDS9960 &apds);
+
+    // Scan elements, changed only while the buffer is disabled
+    const scan_element_type &element(uint8_t index) const { return elements_[index]; }
+    bool enableElement(uint8_t index, bool enable);
+    // Print the scan_elements listing (name, en, index, type)
+    void describe(Print &out) const;
+
+    // Trigger; period_us is the timer period, or for data-ready the poll
+    // period (0 derives it from the cycle timing). int_line sets GIEN.
+    bool setTrigger(scan_trigger_type trigger, uint32_t period_us = 0,
+                    bool int_line = false);
+    bool setLength(uint32_t scans);
+    bool setWatermark(uint32_t scans);
+
+    // Pack the enabled elements, enable the engines they need and start
+    bool enableBuffer();
+    void disableBuffer();
+    bool isEnabled() const { return enabled_; }
+    size_t scanBytes() const { return scan_bytes_; }
+
+    // Run the trigger if due; true once watermark scans are buffered
+    bool poll();
+    // Read the device now, on the INT edge with a data-ready trigger
+    bool trigger();
+    unsigned long nextPollAt() const { return next_poll_us_; }
+    bool isReady() const { return count_ >= watermark_; }
+    uint32_t available() const { return count_; }
+
+    // Copy whole scans into buf, return the number of bytes
+    size_t read(uint8_t *buf, size_t len);
+
+    const scan_stats_type &stats() const { return stats_; }
+
+    // Value of an element in a packed scan
+    int64_t value(const uint8_t *scan, uint8_t index) const;
+
+private:
+    bool readRegs(uint8_t reg, uint8_t *buf, uint8_t len);
+    int readFifo(uint8_t *records, uint8_t max_records);
+    bool enabledAny(uint8_t first, uint8_t last) const;
+    void push(unsigned long time_us);
+
+    APDS9960 &apds_;
+    scan_element_type elements_[SCAN_ELEMENTS];
+    scan_trigger_type trigger_;
+    uint32_t period_us_;
+    bool int_line_;
+    uint32_t gesture_us_;
+    uint32_t length_;
+    uint32_t watermark_;
+    bool enabled_;
+    size_t scan_bytes_;
+
+    uint16_t values_[SCAN_ELEMENTS - 1];    // latest value of each channel
+    std::vector<uint8_t> ring_;
+    uint32_t head_;
+    uint32_t count_;
+    unsigned long next_poll_us_;
+    scan_stats_type stats_;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * sensor.cpp
+ *
+ * Awaitable APDS-9960, see sensor.h.
+ */
+
+#include "Arduino.h"
+#include "sensor.h"
+
+Sensor::Sensor(EventLoop &loop, host::I2CDevice &bus, GpioLine *int_line) :
+    loop_(loop),
+    bus_(bus),
+    int_line_(int_line),
+    gesture_result_(0),
+    color_result_(),
+    gesture_scheduled_(false),
+    color_scheduled_(false),
+    gesture_edge_(false),
+    service_calls_(0)
+{
+    if( int_line_ && int_line_->fd() >= 0 ) {
+        loop_.watch(int_line_->fd(), [this]() { onInterrupt(); });
+    } else {
+        int_line_ = NULL;
+    }
+}
+
+Sensor::~Sensor()
+{
+    if( int_line_ ) {
+        loop_.unwatch(int_line_->fd());
+    }
+}
+
+void Sensor::select()
+{
+    host::attachDevice(APDS9960_I2C_ADDR, &bus_);
+}
+
+/**
+ * @brief Initializes the device and enables gesture and/or color
+ *
+ * GIEN is only set when there is an INT line to wake the loop. ALS
+ * results are picked up on their own schedule, so AIEN stays off.
+ *
+ * @param[in] gesture true to enable the gesture engine
+ * @param[in] color true to enable the ALS engine
+ * @return True if initialized successfully. False otherwise.
+ */
+bool Sensor::begin(bool gesture, bool color)
+{
+    select();
+    if( !apds_.init() ) {
+        return false;
+    }
+    if( color && !apds_.enableLightSensor(false) ) {
+        return false;
+    }
+    if( gesture && !apds_.enableGestureSensor(int_line_ != NULL) ) {
+        return false;
+    }
+    return true;
+}
+
+void Sensor::GestureAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    sensor.gesture_waiter_ = h;
+    sensor.scheduleGesture(host::nowMicros());
+}
+
+void Sensor::ColorAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    sensor.color_waiter_ = h;
+    if( !sensor.color_scheduled_ ) {
+        sensor.color_scheduled_ = true;
+        sensor.loop_.post([s = &sensor]() { s->serviceColor(); });
+    }
+}
+
+void Sensor::scheduleGesture(uint64_t at_us)
+{
+    if( gesture_scheduled_ ) {
+        return;
+    }
+    gesture_scheduled_ = true;
+    loop_.schedule(at_us, [this]() { serviceGesture(); });
+}
+
+/**
+ * @brief INT fell: service the gesture engine if a coroutine is waiting
+ */
+void Sensor::onInterrupt()
+{
+    int_line_->drain();
+    if( gesture_waiter_ && gesture_edge_ ) {
+        gesture_edge_ = false;
+        scheduleGesture(host::nowMicros());
+    }
+}
+
+/**
+ * @brief Runs readGesture() for at most GESTURE_BUDGET_US
+ *
+ * A gesture in progress is continued FIFO_PAUSE_TIME later. When no
+ * gesture is available the sensor waits for the INT edge if the line is
+ * high, or polls again after GESTURE_POLL_US.
+ */
+void Sensor::serviceGesture()
+{
+    gesture_scheduled_ = false;
+    if( !gesture_waiter_ ) {
+        return;
+    }
+
+    select();
+    service_calls_++;
+    int result = apds_.readGesture(GESTURE_BUDGET_US);
+
+    if( result == GESTURE_PENDING ) {
+        scheduleGesture(host::nowMicros() + FIFO_PAUSE_TIME * 1000UL);
+    } else if( result != 0 ) {
+        std::coroutine_handle<> h = gesture_waiter_;
+        gesture_waiter_ = nullptr;
+        gesture_result_ = result;
+        h.resume();
+    } else if( int_line_ && int_line_->level() == HIGH ) {
+        /* Edges are queued by the kernel, none is lost after this check */
+        gesture_edge_ = true;
+    } else {
+        scheduleGesture(host::nowMicros() + GESTURE_POLL_US);
+    }
+}
+
+/**
+ * @brief Reads the RGBC result once the ALS cycle has completed
+ */
+void Sensor::serviceColor()
+{
+    color_scheduled_ = false;
+    if( !color_waiter_ ) {
+        return;
+    }
+
+    select();
+    service_calls_++;
+    uint8_t status = apds_.readColorIfNew(color_result_.clear, color_result_.red,
+                                          color_result_.green, color_result_.blue);
+
+    if( status == 0 ) {
+        color_scheduled_ = true;
+        loop_.schedule(apds_.nextAlsReadyAt(), [this]() { serviceColor(); });
+        return;
+    }
+
+    color_result_.status = status;
+    color_result_.time_us = host::nowMicros();
+    std::coroutine_handle<> h = color_waiter_;
+    color_waiter_ = nullptr;
+    h.resume();
+}
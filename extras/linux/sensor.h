@@ -0,0 +1,104 @@
+/**
+ * sensor.h
+ *
+ * Awaitable APDS-9960 for the Linux gateway build. Each Sensor owns a
+ * driver instance and the bus it sits on, and is serviced from one
+ * EventLoop thread:
+ *
+ *     int gesture = co_await sensor.nextGesture();
+ *     color_sample_type color = co_await sensor.nextColorSample();
+ *
+ * Gestures are read with readGesture(budget), so a sensor in the middle
+ * of a gesture never holds the loop for more than one FIFO read. With an
+ * INT line the sensor sleeps on its falling edge; without one it falls
+ * back to polling GSTATUS on a timer. Color samples are read with
+ * readColorIfNew() at nextAlsReadyAt().
+ *
+ * All sensors use the APDS-9960 address on their own bus, so the bus of
+ * a sensor is attached to the host Wire shim around each driver call.
+ * Only one coroutine at a time may await each of the two calls.
+ */
+
+#ifndef _APDS9960_SENSOR_H_
+#define _APDS9960_SENSOR_H_
+
+#include <stdint.h>
+#include <coroutine>
+
+#include "host.h"
+#include "APDS9960.h"
+#include "event_loop.h"
+#include "gpio_line.h"
+
+/* Service timing */
+#define GESTURE_BUDGET_US       2000    // Longest readGesture() call (us)
+#define GESTURE_POLL_US         10000   // GSTATUS poll period without INT (us)
+
+/* One RGBC result */
+typedef struct color_sample_type {
+    uint8_t status;         // 1 for new values, ERROR if the read failed
+    uint16_t clear;
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint64_t time_us;       // host time the result was read
+} color_sample_type;
+
+class Sensor
+{
+public:
+    Sensor(EventLoop &loop, host::I2CDevice &bus, GpioLine *int_line = NULL);
+    ~Sensor();
+
+    // Initialize the device and enable the requested engines
+    bool begin(bool gesture, bool color);
+    // Attach this sensor's bus; call before using driver() directly
+    void select();
+    APDS9960 &driver() { return apds_; }
+
+    struct GestureAwaiter
+    {
+        Sensor &sensor;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        int await_resume() { return sensor.gesture_result_; }
+    };
+
+    struct ColorAwaiter
+    {
+        Sensor &sensor;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        color_sample_type await_resume() { return sensor.color_result_; }
+    };
+
+    // Next decoded gesture (DIR_* or FLAG_* bits), ERROR on a bus failure
+    GestureAwaiter nextGesture() { return GestureAwaiter{*this}; }
+    // Next RGBC integration result
+    ColorAwaiter nextColorSample() { return ColorAwaiter{*this}; }
+
+    // Driver calls made on behalf of awaiting coroutines
+    uint32_t serviceCalls() const { return service_calls_; }
+
+private:
+    void serviceGesture();
+    void serviceColor();
+    void onInterrupt();
+    void scheduleGesture(uint64_t at_us);
+
+    EventLoop &loop_;
+    host::I2CDevice &bus_;
+    GpioLine *int_line_;
+    APDS9960 apds_;
+
+    std::coroutine_handle<> gesture_waiter_;
+    std::coroutine_handle<> color_waiter_;
+    int gesture_result_;
+    color_sample_type color_result_;
+    bool gesture_scheduled_;
+    bool color_scheduled_;
+    bool gesture_edge_;
+    uint32_t service_calls_;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * shm_reader.cpp
+ *
+ * Reads the shared-memory sample ring written by apds_daemon --shm and
+ * prints the samples as text lines, reporting overruns.
+ *
+ * Usage: shm_reader [--oldest] [--follow] [--poll-ms n] [--count] path
+ *
+ *   --oldest     start at the oldest sample in the ring, not the newest
+ *   --follow     keep reading new samples until SIGINT
+ *   --poll-ms n  sleep between polls of an up-to-date ring (default 10)
+ *   --count      only count samples and overruns
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sample.h"
+#include "shm_ring.h"
+
+static volatile sig_atomic_t stopped = 0;
+
+static void onSignal(int)
+{
+    stopped = 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    bool oldest = false;
+    bool follow = false;
+    bool count_only = false;
+    long poll_ms = 10;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp(argv[i], "--oldest") ) {
+            oldest = true;
+        } else if( !strcmp(argv[i], "--follow") ) {
+            follow = true;
+        } else if( !strcmp(argv[i], "--poll-ms") && i + 1 < argc ) {
+            poll_ms = atol(argv[++i]);
+        } else if( !strcmp(argv[i], "--count") ) {
+            count_only = true;
+        } else if( argv[i][0] != '-' && !path ) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if( !path ) {
+        fprintf(stderr, "usage: %s [--oldest] [--follow] [--poll-ms n] [--count] path\n",
+                argv[0]);
+        return 2;
+    }
+
+    ShmRingReader ring;
+    if( !ring.open(path) ) {
+        return 1;
+    }
+    if( oldest ) {
+        ring.seekOldest();
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    apds_sample_type sample;
+    uint64_t samples = 0;
+    uint32_t overruns = 0;
+
+    while( !stopped ) {
+        int result = ring.read(sample);
+        if( result == SHM_RING_SAMPLE ) {
+            samples++;
+            if( !count_only ) {
+                printSample(stdout, sample);
+            }
+        } else if( result == SHM_RING_OVERRUN ) {
+            overruns++;
+            if( !count_only ) {
+                printf("overrun, %llu samples lost so far\n",
+                       (unsigned long long)ring.lost());
+            }
+        } else if( follow ) {
+            struct timespec ts;
+            ts.tv_sec = poll_ms / 1000;
+            ts.tv_nsec = (poll_ms % 1000) * 1000000;
+            nanosleep(&ts, NULL);
+        } else {
+            break;
+        }
+    }
+
+    fprintf(stderr, "%llu samples, %u overruns, %llu lost, ring head %llu of %u slots\n",
+            (unsigned long long)samples, overruns, (unsigned long long)ring.lost(),
+            (unsigned long long)ring.head(), ring.capacity());
+    return 0;
+}
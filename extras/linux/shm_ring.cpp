@@ -0,0 +1,210 @@
+/**
+ * shm_ring.cpp
+ *
+ * Seqlock sample ring in shared memory, see shm_ring.h.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+
+/*******************************************************************************
+ * Mapping
+ ******************************************************************************/
+
+ShmRing::ShmRing() :
+    header_(NULL),
+    slots_(NULL),
+    size_(0)
+{
+}
+
+ShmRing::~ShmRing()
+{
+    unmap();
+}
+
+bool ShmRing::map(int fd, size_t size, bool writable)
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *p = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+    if( p == MAP_FAILED ) {
+        perror("mmap");
+        return false;
+    }
+    header_ = (shm_ring_header_type *)p;
+    slots_ = (shm_ring_slot_type *)((uint8_t *)p + sizeof(shm_ring_header_type));
+    size_ = size;
+    return true;
+}
+
+void ShmRing::unmap()
+{
+    if( header_ ) {
+        munmap(header_, size_);
+        header_ = NULL;
+        slots_ = NULL;
+    }
+}
+
+/*******************************************************************************
+ * Writer
+ ******************************************************************************/
+
+bool ShmRingWriter::create(const char *path, uint32_t capacity)
+{
+    uint32_t slots = 1;
+    while( slots < capacity ) {
+        slots <<= 1;
+    }
+    size_t size = sizeof(shm_ring_header_type) + (size_t)slots * sizeof(shm_ring_slot_type);
+
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if( fd < 0 ) {
+        perror(path);
+        return false;
+    }
+    bool ok = ftruncate(fd, size) == 0 && map(fd, size, true);
+    ::close(fd);
+    if( !ok ) {
+        return false;
+    }
+
+    /* The file is zero-filled: head 0, every slot unwritten. Readers
+       check the magic, which is stored last. */
+    header_->version = SHM_RING_VERSION;
+    header_->slot_size = sizeof(shm_ring_slot_type);
+    header_->capacity = slots;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SHM_RING_MAGIC;
+    return true;
+}
+
+void ShmRingWriter::publish(const apds_sample_type &sample)
+{
+    uint64_t words[SHM_RING_WORDS];
+    memcpy(words, &sample, sizeof(words));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t n = header_->head.load(std::memory_order_relaxed);
+    shm_ring_slot_type &s = slot(n);
+
+    s.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for( size_t i = 0; i < SHM_RING_WORDS; i++ ) {
+        s.data[i].store(words[i], std::memory_order_relaxed);
+    }
+    s.seq.store(2 * n + 2, std::memory_order_release);
+    header_->head.store(n + 1, std::memory_order_release);
+}
+
+/*******************************************************************************
+ * Reader
+ ******************************************************************************/
+
+ShmRingReader::ShmRingReader() :
+    next_(0),
+    lost_(0)
+{
+}
+
+bool ShmRingReader::open(const char *path)
+{
+    struct stat st;
+
+    unmap();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if( fd < 0 ) {
+        perror(path);
+        return false;
+    }
+    bool ok = fstat(fd, &st) == 0 &&
+              (size_t)st.st_size >= sizeof(shm_ring_header_type) &&
+              map(fd, st.st_size, false);
+    ::close(fd);
+    if( !ok ) {
+        return false;
+    }
+
+    const shm_ring_header_type *h = header_;
+    if( h->magic != SHM_RING_MAGIC || h->version != SHM_RING_VERSION ||
+        h->slot_size != sizeof(shm_ring_slot_type) || !h->capacity ||
+        (h->capacity & (h->capacity - 1)) ||
+        size_ < sizeof(shm_ring_header_type) + (size_t)h->capacity * h->slot_size ) {
+        fprintf(stderr, "%s: not a sample ring\n", path);
+        unmap();
+        return false;
+    }
+    next_ = head();
+    return true;
+}
+
+void ShmRingReader::seekOldest()
+{
+    uint64_t h = head();
+    next_ = h > capacity() ? h - capacity() : 0;
+}
+
+/**
+ * @brief Counts the samples the writer has overwritten and skips them
+ *
+ * One slot of margin is left, the writer may already be filling it.
+ */
+void ShmRingReader::skipLost(uint64_t head)
+{
+    uint64_t oldest = head > capacity() - 1 ? head - (capacity() - 1) : 0;
+    if( oldest > next_ ) {
+        lost_ += oldest - next_;
+        next_ = oldest;
+    } else {
+        lost_++;
+        next_++;
+    }
+}
+
+/**
+ * @brief Reads the next sample
+ *
+ * @param[out] sample the sample, valid for SHM_RING_SAMPLE
+ * @return SHM_RING_SAMPLE, SHM_RING_EMPTY if the reader is up to date,
+ *  SHM_RING_OVERRUN if samples were overwritten before they were read.
+ */
+int ShmRingReader::read(apds_sample_type &sample)
+{
+    uint64_t h = head();
+
+    if( next_ >= h ) {
+        return SHM_RING_EMPTY;
+    }
+    if( h - next_ > capacity() ) {
+        skipLost(h);
+        return SHM_RING_OVERRUN;
+    }
+
+    shm_ring_slot_type &s = slot(next_);
+    uint64_t expect = 2 * next_ + 2;
+    uint64_t words[SHM_RING_WORDS];
+
+    if( s.seq.load(std::memory_order_acquire) != expect ) {
+        skipLost(head());
+        return SHM_RING_OVERRUN;
+    }
+    for( size_t i = 0; i < SHM_RING_WORDS; i++ ) {
+        words[i] = s.data[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if( s.seq.load(std::memory_order_relaxed) != expect ) {
+        skipLost(head());
+        return SHM_RING_OVERRUN;
+    }
+
+    memcpy(&sample, words, sizeof(sample));
+    next_++;
+    return SHM_RING_SAMPLE;
+}
@@ -0,0 +1,118 @@
+/**
+ * shm_ring.h
+ *
+ * Shared-memory ring of apds_sample_type records in an mmap'd file (e.g.
+ * under /dev/shm). One process writes, any number of processes read
+ * without syscalls or locks.
+ *
+ * Layout, all little-endian host order:
+ *
+ *   header   64 bytes: magic, version, slot size, capacity (power of 2),
+ *            head = number of samples written so far
+ *   slots    capacity x 32 bytes: sequence word + 24-byte sample
+ *
+ * Each slot is a seqlock. While sample n is written its sequence word is
+ * 2n+1, afterwards 2n+2. A reader wanting sample n checks for 2n+2,
+ * copies the sample and checks the word again; any other value means
+ * the writer has lapped the reader (an overrun). Sample data is stored
+ * as relaxed atomic words so a torn read is detected, never undefined.
+ */
+
+#ifndef _APDS9960_SHM_RING_H_
+#define _APDS9960_SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "sample.h"
+
+#define SHM_RING_MAGIC          0x52393639  // "969R"
+#define SHM_RING_VERSION        1
+#define SHM_RING_WORDS          (sizeof(apds_sample_type) / 8)
+
+/* read() results */
+#define SHM_RING_EMPTY          0
+#define SHM_RING_SAMPLE         1
+#define SHM_RING_OVERRUN        (-1)
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory ring needs lock-free 64-bit atomics");
+
+typedef struct shm_ring_header_type {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    std::atomic<uint64_t> head;     // samples written
+    uint8_t pad[40];                // slots start on a cache line
+} shm_ring_header_type;
+
+typedef struct shm_ring_slot_type {
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> data[SHM_RING_WORDS];
+} shm_ring_slot_type;
+
+static_assert(sizeof(shm_ring_header_type) == 64, "shm_ring_header_type layout");
+static_assert(sizeof(shm_ring_slot_type) == 32, "shm_ring_slot_type layout");
+
+/* Mapping of a ring file, shared by the writer and the reader */
+class ShmRing
+{
+public:
+    ShmRing();
+    ~ShmRing();
+
+    uint32_t capacity() const { return header_ ? header_->capacity : 0; }
+    uint64_t head() const { return header_->head.load(std::memory_order_acquire); }
+
+protected:
+    bool map(int fd, size_t size, bool writable);
+    void unmap();
+    shm_ring_slot_type &slot(uint64_t n) { return slots_[n & (header_->capacity - 1)]; }
+
+    shm_ring_header_type *header_;
+    shm_ring_slot_type *slots_;
+    size_t size_;
+};
+
+/* Writer side, publish() may be called from several threads */
+class ShmRingWriter : public ShmRing, public SampleSink
+{
+public:
+    // Create or truncate the ring file, capacity rounded up to a power of 2
+    bool create(const char *path, uint32_t capacity);
+    void publish(const apds_sample_type &sample);
+
+private:
+    std::mutex mutex_;
+};
+
+/* Reader side, one per consumer */
+class ShmRingReader : public ShmRing
+{
+public:
+    ShmRingReader();
+
+    // Map an existing ring read-only, starting at the newest sample
+    bool open(const char *path);
+    // Start at the oldest sample still in the ring instead
+    void seekOldest();
+
+    // SHM_RING_SAMPLE, SHM_RING_EMPTY, or SHM_RING_OVERRUN after which
+    // reading continues at the oldest sample still in the ring
+    int read(apds_sample_type &sample);
+
+    uint64_t next() const { return next_; }
+    uint64_t lost() const { return lost_; }
+
+private:
+    void skipLost(uint64_t head);
+
+    uint64_t next_;
+    uint64_t lost_;
+};
+
+#endif
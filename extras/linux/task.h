@@ -0,0 +1,36 @@
+/**
+ * task.h
+ *
+ * Minimal C++20 coroutine type for the event loop: a Task starts
+ * running when it is called, runs until its first co_await and is then
+ * resumed by whatever it awaits. Its frame is freed when it returns.
+ * Nothing waits for a Task, so it is fire and forget:
+ *
+ *     Task watch(Sensor &sensor)
+ *     {
+ *         for( ;; ) {
+ *             int gesture = co_await sensor.nextGesture();
+ *             ...
+ *         }
+ *     }
+ */
+
+#ifndef _APDS9960_TASK_H_
+#define _APDS9960_TASK_H_
+
+#include <coroutine>
+#include <exception>
+
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+#endif